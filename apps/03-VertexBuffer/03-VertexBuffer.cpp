@@ -65,20 +65,9 @@ public:
     {
         Renderer::create(device, swapChain, mouseTracker);
 
-        // 创建描述符布局（对着色器资源绑定的描述）
-        std::vector<VkDescriptorSetLayoutBinding> layoutBinding(1);
-        layoutBinding[0] = yu::vk::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0);
-
-        descriptor_pool_.createDescriptorSetLayoutAndAllocDescriptorSet(&layoutBinding,
-                                                                        &descriptor_set_layout_,
-                                                                        &descriptor_set_);
-        constant_buffer_.setDescriptorSet(0, sizeof(glm::mat4) * 2, descriptor_set_);
-
+        // 相机矩阵通过推送常量传入，流水线布局中的推送常量范围由着色器反射得到，不需要描述符集
         pipeline_builder_.create(device);
-        pipeline_builder_.setShader({"02_vertexBuffer.vert", "01_shader_base.frag"});
+        pipeline_builder_.setShader({"02_vertexBuffer_push.vert", "01_shader_base.frag"});
 
         std::vector<VkVertexInputBindingDescription> bindingDesc = {Vertex::getBindingDescription()};
         auto attrDesc = Vertex::getAttributeDescriptions();
@@ -87,7 +76,7 @@ public:
         // 创建流水线
         pipeline_.create(device,
                          swapChain->getRenderPass(),
-                         descriptor_set_layout_, pipeline_builder_);
+                         VK_NULL_HANDLE, pipeline_builder_, pipeline_registry_);
 
         // 分配内存并传递顶点信息
         static_buffer_.allocBuffer(static_cast<uint32_t>(vertices.size()),
@@ -105,10 +94,6 @@ public:
         pipeline_.destroy();
         pipeline_builder_.destroy();
 
-        // 释放描述符布局
-        descriptor_pool_.freeDescriptor(descriptor_set_);
-        vkDestroyDescriptorSetLayout(device_->getHandle(), descriptor_set_layout_, nullptr);
-
         Renderer::destroy();
     }
 
@@ -119,6 +104,9 @@ public:
 
         // 切换命令列表到当前帧
         constant_buffer_.beginFrame();
+        descriptor_pool_.beginFrame();
+        descriptor_set_cache_.beginFrame();
+        static_buffer_.beginFrame();
         frame_commands_.beginFrame();
 
         // 取到一个命令缓冲区，然后开始记录
@@ -150,20 +138,22 @@ public:
         vkCmdSetScissor(cmdBuffer, 0, 1, &rect_scissor_);
         vkCmdSetViewport(cmdBuffer, 0, 1, &viewport_);
 
-        glm::mat4* mats;
-        VkDescriptorBufferInfo constantBufferInfo;
-        constant_buffer_.allocConstantBuffer(sizeof(glm::mat4) * 2, (void**) &mats, constantBufferInfo);
-        mats[0] = mouse_tracker_->camera_->view_mat;
-        mats[1] = mouse_tracker_->camera_->proj_mat;
+        // 矩阵直接写入命令缓冲区，不需要从常量缓冲区分配
+        const glm::mat4 mats[2] = {mouse_tracker_->camera_->view_mat, mouse_tracker_->camera_->proj_mat};
 
         // 绘制设定的流水线
-        pipeline_.draw(cmdBuffer,
-                       static_cast<uint32_t>(vertices.size()),
-                       &vertex_buffer_info_,
-                       &constantBufferInfo,
-                       descriptor_set_);
+        if (pipeline_.bind(cmdBuffer)) {
+            pipeline_.drawPushed(cmdBuffer,
+                                 static_cast<uint32_t>(vertices.size()),
+                                 vertex_buffer_info_,
+                                 mats,
+                                 sizeof(mats));
+        }
 
-        imGui_->draw(cmdBuffer);
+        // 无窗口运行时没有 UI
+        if (imGui_ != nullptr) {
+            imGui_->draw(cmdBuffer);
+        }
 
         // 停止 render pass 的记录
         vkCmdEndRenderPass(cmdBuffer);
@@ -171,24 +161,7 @@ public:
         // 停止记录，并提交命令缓冲区
         {
             VK_CHECK(vkEndCommandBuffer(cmdBuffer));
-
-            VkSemaphore ImageAvailableSemaphore;
-            VkSemaphore RenderFinishedSemaphores;
-            VkFence CmdBufExecutedFences;
-            swap_chain_->getSemaphores(&ImageAvailableSemaphore, &RenderFinishedSemaphores, &CmdBufExecutedFences);
-
-            VkPipelineStageFlags submitWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            auto submit_info = submitInfo();
-            submit_info.pNext = nullptr;
-            submit_info.waitSemaphoreCount = 1;
-            submit_info.pWaitSemaphores = &ImageAvailableSemaphore;
-            submit_info.pWaitDstStageMask = &submitWaitStage;
-            submit_info.commandBufferCount = 1;
-            submit_info.pCommandBuffers = &cmdBuffer;
-            submit_info.signalSemaphoreCount = 1;
-            submit_info.pSignalSemaphores = &RenderFinishedSemaphores;
-
-            VK_CHECK(vkQueueSubmit(device_->getGraphicsQueue(), 1, &submit_info, CmdBufExecutedFences));
+            swap_chain_->submit(device_->getGraphicsQueue(), cmdBuffer);
         }
 
         // 交换链提交显示当前帧的命令，并转到下一帧
@@ -200,9 +173,6 @@ private:
     PipelineBuilder pipeline_builder_;
 
     VkDescriptorBufferInfo vertex_buffer_info_{};
-
-    VkDescriptorSet descriptor_set_{};
-    VkDescriptorSetLayout descriptor_set_layout_{};
 };
 
 class AppSample03 : public AppBase
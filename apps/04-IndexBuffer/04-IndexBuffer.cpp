@@ -92,7 +92,7 @@ public:
         // 创建流水线
         pipeline_.create(device,
                          swapChain->getRenderPass(),
-                         descriptor_set_layout_, pipeline_builder_);
+                         descriptor_set_layout_, pipeline_builder_, pipeline_registry_);
 
         // 分配内存并传递顶点信息
         static_buffer_.allocBuffer(static_cast<uint32_t>(vertices.size()),
@@ -130,6 +130,9 @@ public:
 
         // 切换命令列表到当前帧
         constant_buffer_.beginFrame();
+        descriptor_pool_.beginFrame();
+        descriptor_set_cache_.beginFrame();
+        static_buffer_.beginFrame();
         frame_commands_.beginFrame();
 
         // 取到一个命令缓冲区，然后开始记录
@@ -175,7 +178,10 @@ public:
                        &constantBufferInfo,
                        descriptor_set_);
 
-        imGui_->draw(cmdBuffer);
+        // 无窗口运行时没有 UI
+        if (imGui_ != nullptr) {
+            imGui_->draw(cmdBuffer);
+        }
         
         // 停止 render pass 的记录
         vkCmdEndRenderPass(cmdBuffer);
@@ -183,24 +189,7 @@ public:
         // 停止记录，并提交命令缓冲区
         {
             VK_CHECK(vkEndCommandBuffer(cmdBuffer));
-
-            VkSemaphore ImageAvailableSemaphore;
-            VkSemaphore RenderFinishedSemaphores;
-            VkFence CmdBufExecutedFences;
-            swap_chain_->getSemaphores(&ImageAvailableSemaphore, &RenderFinishedSemaphores, &CmdBufExecutedFences);
-
-            VkPipelineStageFlags submitWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            auto submit_info = submitInfo();
-            submit_info.pNext = nullptr;
-            submit_info.waitSemaphoreCount = 1;
-            submit_info.pWaitSemaphores = &ImageAvailableSemaphore;
-            submit_info.pWaitDstStageMask = &submitWaitStage;
-            submit_info.commandBufferCount = 1;
-            submit_info.pCommandBuffers = &cmdBuffer;
-            submit_info.signalSemaphoreCount = 1;
-            submit_info.pSignalSemaphores = &RenderFinishedSemaphores;
-
-            VK_CHECK(vkQueueSubmit(device_->getGraphicsQueue(), 1, &submit_info, CmdBufExecutedFences));
+            swap_chain_->submit(device_->getGraphicsQueue(), cmdBuffer);
         }
 
         // 交换链提交显示当前帧的命令，并转到下一帧
@@ -168,7 +168,7 @@ public:
         // 创建流水线
         pipeline_.create(device,
                          swapChain->getRenderPass(),
-                         descriptor_set_layout_, pipeline_builder_);
+                         descriptor_set_layout_, pipeline_builder_, pipeline_registry_);
 
         // 分配内存并传递顶点信息
         static_buffer_.allocBuffer(static_cast<uint32_t>(vertices.size()),
@@ -211,6 +211,9 @@ public:
 
         // 切换命令列表到当前帧
         constant_buffer_.beginFrame();
+        descriptor_pool_.beginFrame();
+        descriptor_set_cache_.beginFrame();
+        static_buffer_.beginFrame();
         frame_commands_.beginFrame();
 
         // 取到一个命令缓冲区，然后开始记录
@@ -258,7 +261,10 @@ public:
                               &constantBufferInfo,
                               descriptor_set_);
 
-        imGui_->draw(cmdBuffer);
+        // 无窗口运行时没有 UI
+        if (imGui_ != nullptr) {
+            imGui_->draw(cmdBuffer);
+        }
 
         // 停止 render pass 的记录
         vkCmdEndRenderPass(cmdBuffer);
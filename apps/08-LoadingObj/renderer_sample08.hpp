@@ -0,0 +1,295 @@
+﻿#pragma once
+
+#include "RHI/vulkan/renderer.hpp"
+#include "RHI/vulkan/pipeline.hpp"
+#include "RHI/vulkan/pipeline_builder.hpp"
+#include "RHI/vulkan/initializers.hpp"
+#include "RHI/vulkan/error.hpp"
+#include "RHI/vulkan/texture.hpp"
+#include "RHI/vulkan/model_obj.hpp"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <imgui.h>
+
+namespace yu::vk {
+
+/**
+ * @brief 加载 obj 模型并绘制的渲染器，示例程序和 yu_bench 共用。
+ *        bPushConstants 为 true 时相机矩阵通过推送常量传入，否则从常量缓冲区分配并通过动态偏移绑定
+ */
+class RendererSample08 : public Renderer
+{
+public:
+    explicit RendererSample08(bool bPushConstants = false) : push_constants_(bPushConstants) {}
+
+    void create(const VulkanDevice& device, SwapChain* swapChain, const MouseTracker& mouseTracker) override
+    {
+        // 描述符集按照常量实际所在的缓冲区取得，常量缓冲区可以追加缓冲区
+        allow_constant_buffer_grow_ = true;
+        // 上传提交到传输队列，资源的所有权在每一帧开始时取回
+        use_transfer_queue_ = true;
+        Renderer::create(device, swapChain, mouseTracker);
+
+        // 创建描述符布局（对着色器资源绑定的描述）
+        std::vector<VkDescriptorSetLayoutBinding> layoutBinding;
+        // 矩阵的描述，使用推送常量时没有这个绑定
+        if (!push_constants_) {
+            layoutBinding.push_back(yu::vk::descriptorSetLayoutBinding(
+                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0));
+        }
+
+        // 采样器的描述
+        layoutBinding.push_back(yu::vk::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            1));
+
+        // 描述符集在绘制时按照常量所在的缓冲区从描述符集缓存中取得，这里只创建布局
+        descriptor_pool_.createDescriptorSetLayout(&layoutBinding, &descriptor_set_layout_);
+
+        // Uniform: 图片
+        // 加载图片
+        texture_.createFromFile2D(device, upload_heap_, "texture.jpg");
+        upload_heap_.flushAndFinish();
+
+        // 创建图片视图
+        texture_.createSRV(&texture_view_);
+
+        // 创建图片采样器
+        {
+            auto info = samplerCreateInfo();
+            info.magFilter = VK_FILTER_LINEAR;
+            info.minFilter = VK_FILTER_LINEAR;
+            info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+            info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+            info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+            info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+
+            info.anisotropyEnable = VK_TRUE;
+            info.maxAnisotropy = device.getProperties().device_properties2.properties.limits.maxSamplerAnisotropy;
+            info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+            info.unnormalizedCoordinates = VK_FALSE;
+            info.compareEnable = VK_FALSE;
+            info.compareOp = VK_COMPARE_OP_ALWAYS;
+
+            VK_CHECK(vkCreateSampler(device.getHandle(), &info, nullptr, &texture_sampler_));
+        }
+
+        // 图片的资源描述符信息，作为描述符集缓存的键的一部分
+        texture_image_info_ = descriptorImageInfo(texture_sampler_,
+                                                  texture_view_,
+                                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        std::vector<VkVertexInputBindingDescription> bindingDesc;
+        std::vector<VkVertexInputAttributeDescription> attrDesc;
+        ModelObj::SetPipelineVertexInput(bindingDesc, attrDesc);
+
+        pipeline_builder_.create(device);
+        pipeline_builder_.setShader({push_constants_ ? "05_modelObj_push.vert" : "05_modelObj.vert", "05_modelObj.frag"});
+        pipeline_builder_.setVertexInputState(bindingDesc, attrDesc);
+
+        // 创建流水线
+        pipeline_.create(device,
+                         swapChain->getRenderPass(),
+                         descriptor_set_layout_, pipeline_builder_, pipeline_registry_);
+        static_buffer_.uploadData(upload_heap_.getCommandBuffer());
+        upload_heap_.flushAndFinish();
+    }
+
+    void destroy() override
+    {
+        // 释放流水线
+        pipeline_.destroy();
+        pipeline_builder_.destroy();
+
+        // 释放描述符布局，描述符集由缓存管理
+        vkDestroyDescriptorSetLayout(device_->getHandle(), descriptor_set_layout_, nullptr);
+
+        texture_.destory(&descriptor_set_cache_);
+        vkDestroySampler(device_->getHandle(), texture_sampler_, nullptr);
+        vkDestroyImageView(device_->getHandle(), texture_view_, nullptr);
+
+        // 归还模型占用的顶点缓冲区空间
+        if (model_ != nullptr) {
+            model_->freeMemory(static_buffer_);
+        }
+
+        Renderer::destroy();
+    }
+
+    void render() override
+    {
+        // 取得当前帧缓冲区的索引
+        auto imageIndex = swap_chain_->waitForSwapChain();
+
+        // 切换命令列表到当前帧
+        constant_buffer_.beginFrame();
+        descriptor_pool_.beginFrame();
+        descriptor_set_cache_.beginFrame();
+        static_buffer_.beginFrame();
+        frame_commands_.beginFrame();
+
+        // 取到一个命令缓冲区，然后开始记录
+        auto cmdBuffer = frame_commands_.getNewCommandBuffer();
+        {
+            auto cmd_buf_info = yu::vk::commandBufferBeginInfo();
+            cmd_buf_info.pNext = nullptr;
+            cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            cmd_buf_info.pInheritanceInfo = nullptr;
+            VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmd_buf_info));
+        }
+
+        // 取回异步上传的资源的所有权；上传与图形队列属于同一个队列族时没有 barrier 需要记录，仍然要等待加载时的上传
+        auto uploadTicket = std::max(upload_heap_.recordAcquireBarriers(cmdBuffer), upload_ticket_);
+        
+        gpu_timer_.beginFrame(cmdBuffer, time_stamps_);
+        gpu_timer_.beginScope(cmdBuffer, "Main Pass", GPUTimeStamp::PipelineStatisticsQuery | GPUTimeStamp::OcclusionQuery);
+
+        // render pass 一些默认设置
+        {
+            auto renderPassInfo = renderPassBeginInfo();
+            renderPassInfo.renderPass = swap_chain_->getRenderPass();
+            renderPassInfo.framebuffer = swap_chain_->getFrameBuffer(static_cast<int>(imageIndex));
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = {width_, height_};
+
+            std::vector<VkClearValue> clearColor(2);
+            clearColor[0].color = {0.1f, 0.2f, 0.23f, 1.0f};
+            clearColor[1].depthStencil = {1.0f, 0};
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearColor.size());
+            renderPassInfo.pClearValues = clearColor.data();
+
+            vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        // 动态更新视口和裁剪矩形
+        vkCmdSetScissor(cmdBuffer, 0, 1, &rect_scissor_);
+        vkCmdSetViewport(cmdBuffer, 0, 1, &viewport_);
+
+        if (model_ != nullptr && pipeline_.bind(cmdBuffer)) {
+            gpu_timer_.beginScope(cmdBuffer, "Model");
+            if (push_constants_) {
+                drawModelPushed(cmdBuffer);
+            } else {
+                drawModelDynamic(cmdBuffer);
+            }
+            gpu_timer_.endScope(cmdBuffer);
+            gpu_timer_.getTimeStamp(cmdBuffer, "Draw Model");
+        }
+
+        // 无窗口运行时没有 UI
+        if (imGui_ != nullptr) {
+            gpu_timer_.beginScope(cmdBuffer, "ImGui");
+            imGui_->draw(cmdBuffer);
+            gpu_timer_.endScope(cmdBuffer);
+            gpu_timer_.getTimeStamp(cmdBuffer, "ImGui Rendering");
+        }
+
+        // 停止 render pass 的记录
+        vkCmdEndRenderPass(cmdBuffer);
+        gpu_timer_.endScope(cmdBuffer);
+
+        // 停止记录，并提交命令缓冲区
+        {
+            VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+            // 顶点输入和片元着色器阶段等待上传完成，已经完成的票据不会阻塞
+            swap_chain_->submit(device_->getGraphicsQueue(),
+                                cmdBuffer,
+                                upload_heap_.getTimelineSemaphore(),
+                                uploadTicket,
+                                UploadHeap::AcquireStages);
+        }
+        
+        // 切换至下一帧的记录
+        gpu_timer_.endFrame();
+
+        // 交换链提交显示当前帧的命令，并转到下一帧
+        VK_CHECK(swap_chain_->present());
+    }
+
+    int loadAssets(int loadingStage) override
+    {
+        const int stages = 12;
+        // show loading progress
+        ImGui::OpenPopup("Loading");
+        if (ImGui::BeginPopupModal("Loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+            float progress = static_cast<float>(loadingStage) / static_cast<float>(stages);
+            ImGui::ProgressBar(progress, ImVec2(0.f, 0.f), nullptr);
+            ImGui::EndPopup();
+        }
+
+        if (loadingStage == 0) {
+        } else if (loadingStage == 5) {
+            model_ = std::make_unique<yu::vk::ModelObj>();
+            model_->load("cubebox_subdivided.obj", "cubebox/mesh/");
+            model_->allocMemory(static_buffer_);
+            static_buffer_.uploadData(upload_heap_.getCommandBuffer());
+            // 不等待上传完成，绘制的提交会等待这个票据
+            upload_ticket_ = upload_heap_.flushAsync();
+        } else if (loadingStage == 9) {
+            // 释放暂存堆，上传堆中的数据在 GPU 读完之后才会被回收，不需要在这里等待
+            static_buffer_.freeUploadHeap();
+
+            return 0;
+        }
+
+        return loadingStage + 1;
+    }
+
+private:
+    void drawModelDynamic(VkCommandBuffer cmdBuffer)
+    {
+        // 常量可能分配在追加的缓冲区中，描述符集按照实际的缓冲区从缓存中取得；
+        // 绑定的范围从缓冲区开头算起，实际的位置通过动态偏移给出，所以每一帧都会命中同一个描述符集
+        glm::mat4* mats;
+        VkDescriptorBufferInfo constantInfo{};
+        if (!constant_buffer_.allocConstantBuffer(sizeof(glm::mat4) * 2, (void**) &mats, constantInfo)) {
+            return;
+        }
+        mats[0] = mouse_tracker_->camera_->view_mat;
+        mats[1] = mouse_tracker_->camera_->proj_mat;
+
+        VkDescriptorBufferInfo bufferInfo{constantInfo.buffer, 0, sizeof(glm::mat4) * 2};
+        auto descriptorSet = descriptor_set_cache_.getDescriptorSet(descriptor_set_layout_, {
+            BufferDescriptorWrite(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, bufferInfo),
+            ImageDescriptorWrite(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_image_info_)
+        });
+
+        model_->drawDynamic(pipeline_, cmdBuffer, descriptorSet, static_cast<uint32_t>(constantInfo.offset));
+    }
+
+    void drawModelPushed(VkCommandBuffer cmdBuffer)
+    {
+        // 描述符集只包含纹理，每一帧都命中缓存；矩阵直接写入命令缓冲区
+        auto descriptorSet = descriptor_set_cache_.getDescriptorSet(descriptor_set_layout_, {
+            ImageDescriptorWrite(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_image_info_)
+        });
+        pipeline_.bindDescriptorSet(cmdBuffer, descriptorSet);
+
+        const glm::mat4 mats[2] = {mouse_tracker_->camera_->view_mat, mouse_tracker_->camera_->proj_mat};
+        model_->drawPushed(pipeline_, cmdBuffer, mats, sizeof(mats));
+    }
+
+private:
+    bool push_constants_ = false;
+
+    // 加载模型时异步上传的票据
+    UploadTicket upload_ticket_ = 0;
+
+    VulkanPipeline pipeline_;
+    PipelineBuilder pipeline_builder_;
+
+    std::unique_ptr<yu::vk::ModelObj> model_ = nullptr;
+
+    Texture texture_;
+    VkImageView texture_view_{};
+    VkSampler texture_sampler_{};
+    VkDescriptorImageInfo texture_image_info_{};
+
+    VkDescriptorSetLayout descriptor_set_layout_{};
+};
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,245 @@
+﻿#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <glm/gtc/constants.hpp>
+#include "logger.hpp"
+#include "RHI/vulkan/headless_runner.hpp"
+#include "RHI/vulkan/ext_memory_budget.hpp"
+#include "renderer_sample08.hpp"
+#include "bench_report.hpp"
+
+using namespace yu;
+using namespace yu::vk;
+
+/**
+ * yu_bench：无窗口地运行一个渲染器，预热若干帧后测量固定的帧数，相机沿固定的路径环绕原点，
+ * 输出 CPU 帧时间、每个 GPUTimeStamp 标签的 GPU 时间和内存用量的 JSON 报告，并可以与基线比较。
+ *
+ *   yu_bench [--renderer 08-LoadingObj] [--warmup 60] [--frames 300] [--width 1280] [--height 720]
+ *            [--output bench_report.json] [--baseline baseline.json] [--tolerance 0.1] [--validation]
+ *
+ * 有指标比基线慢了 tolerance 以上时返回 1，可以直接用在 CI 中
+ */
+
+struct BenchOptions
+{
+    std::string renderer = "08-LoadingObj";
+    uint32_t warmup = 60;
+    uint32_t frames = 300;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    std::string output = "bench_report.json";
+    std::string baseline;
+    double tolerance = 0.1;
+    bool validation = false;
+};
+
+using RendererFactory = std::function<std::unique_ptr<Renderer>()>;
+
+// 可以测量的渲染器，新的渲染器在这里注册
+static const std::map<std::string, RendererFactory, std::less<>> Renderers = {
+    {"08-LoadingObj", [] { return std::make_unique<RendererSample08>(); }},
+    {"08-LoadingObj-Push", [] { return std::make_unique<RendererSample08>(true); }},
+};
+
+template<typename T>
+static bool ParseNumber(std::string_view str, T& value)
+{
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc{} && ptr == str.data() + str.size();
+}
+
+static bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--validation") {
+            options.validation = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            LOG_ERROR("Missing value of {}.", arg);
+            return false;
+        }
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--renderer") {
+            options.renderer = value;
+        } else if (arg == "--warmup") {
+            ok = ParseNumber(value, options.warmup);
+        } else if (arg == "--frames") {
+            ok = ParseNumber(value, options.frames) && options.frames > 0;
+        } else if (arg == "--width") {
+            ok = ParseNumber(value, options.width) && options.width > 0;
+        } else if (arg == "--height") {
+            ok = ParseNumber(value, options.height) && options.height > 0;
+        } else if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--baseline") {
+            options.baseline = value;
+        } else if (arg == "--tolerance") {
+            ok = ParseNumber(value, options.tolerance) && options.tolerance >= 0.0;
+        } else {
+            LOG_ERROR("Unknown option {}.", arg);
+            return false;
+        }
+
+        if (!ok) {
+            LOG_ERROR("Invalid value of {}: {}", arg, value);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief 固定的相机路径：在略高于原点的圆上环绕，frame 走完 period 帧转一圈。
+ *        只由帧序号决定，与帧时间无关，每次运行看到的画面完全一致
+ */
+static void ApplyCameraPath(Camera& camera, uint32_t frame, uint32_t period)
+{
+    const float angle = glm::two_pi<float>() * static_cast<float>(frame % period) / static_cast<float>(period);
+    const float radius = 5.0f;
+
+    camera.lookAt({radius * std::sin(angle), 1.5f, radius * std::cos(angle)}, {0, 0, 0});
+}
+
+int main(int argc, char* argv[])
+{
+    San::LogSystem log;
+
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    auto factory = Renderers.find(options.renderer);
+    if (factory == Renderers.end()) {
+        LOG_ERROR("Unknown renderer {}.", options.renderer);
+        for (const auto& [name, _] : Renderers) {
+            LOG_INFO("Available renderer: {}", name);
+        }
+        return 2;
+    }
+
+    HeadlessProperties props{};
+    props.width = options.width;
+    props.height = options.height;
+    props.create_depth = true;
+    props.enabled_validation = options.validation;
+
+    HeadlessRunner runner;
+    runner.create("yu_bench", props);
+
+    auto renderer = factory->second();
+    auto& camera = *runner.getMouseTracker().camera_;
+
+    // 测量期间的采样
+    std::vector<float> cpuFrameTimes;
+    cpuFrameTimes.reserve(options.frames);
+    std::map<std::string, std::vector<float>> gpuTimes;
+    std::vector<GPUScopeStats> scopeStats;
+    std::vector<MemoryHeapUsage> heapUsage;
+    DynamicBuffer::UsageStats constantBufferStats{};
+    uint32_t invalidGpuFrames = 0;
+
+    const uint32_t totalFrames = options.warmup + options.frames;
+    ApplyCameraPath(camera, 0, options.frames);
+
+    runner.run(*renderer, totalFrames, [&](uint32_t frameIndex, float cpuFrameTime) {
+        // 下一帧的相机
+        ApplyCameraPath(camera, frameIndex + 1, options.frames);
+
+        if (frameIndex < options.warmup) {
+            // 预热结束时清空范围统计，保证统计只包含测量的帧
+            if (frameIndex + 1 == options.warmup) {
+                renderer->resetScopeStats();
+            }
+            return;
+        }
+
+        cpuFrameTimes.push_back(cpuFrameTime);
+
+        // 查询结果无效的帧只有一条占位的记录，整帧不计入 GPU 时间
+        const auto& timings = renderer->getTimings();
+        const bool bGpuValid = std::none_of(timings.begin(), timings.end(), [](const TimeStamp& timeStamp) {
+            return timeStamp.label == GPUTimeStamp::InvalidCountersLabel;
+        });
+        if (bGpuValid) {
+            for (const auto& timeStamp : timings) {
+                gpuTimes[timeStamp.label].push_back(timeStamp.microseconds);
+            }
+        } else {
+            ++invalidGpuFrames;
+        }
+
+        // 渲染器在 run 结束时就会销毁，最后一帧时取走需要的状态
+        if (frameIndex + 1 == totalFrames) {
+            scopeStats = renderer->getScopeStats();
+            heapUsage = GetMemoryHeapUsage(runner.getDevice().getProperties());
+            constantBufferStats = renderer->getConstantBufferStats();
+        }
+    });
+
+    auto [deviceName, apiVersion] = runner.getDevice().getProperties().getDeviceInfo();
+    const bool supportMemoryBudget = runner.getDevice().getProperties().support_memory_budget;
+    runner.destroy();
+
+    BenchReport report;
+    report.setInfo("renderer", options.renderer);
+    report.setInfo("device", deviceName);
+    report.setInfo("api", apiVersion);
+    report.setInfo("resolution", std::to_string(options.width) + "x" + std::to_string(options.height));
+    report.setInfo("warmup", std::to_string(options.warmup));
+    report.setInfo("frames", std::to_string(options.frames));
+    report.setInfo("camera", "orbit");
+    report.setInfo("gpu_invalid_frames", std::to_string(invalidGpuFrames));
+
+    report.addSamples("cpu_frame_ms", std::move(cpuFrameTimes));
+    for (auto& [label, samples] : gpuTimes) {
+        report.addSamples("gpu_us." + label, std::move(samples));
+    }
+    for (const auto& scope : scopeStats) {
+        report.addMetric("gpu_scope_us." + scope.path + ".avg", scope.avg);
+        report.addMetric("gpu_scope_us." + scope.path + ".p95", scope.p95);
+    }
+
+    if (supportMemoryBudget) {
+        VkDeviceSize deviceLocal = 0, host = 0;
+        for (const auto& heap : heapUsage) {
+            (heap.deviceLocal ? deviceLocal : host) += heap.usage;
+        }
+        report.addMetric("memory_mb.device_local", static_cast<double>(deviceLocal) / (1024.0 * 1024.0));
+        report.addMetric("memory_mb.host", static_cast<double>(host) / (1024.0 * 1024.0));
+    }
+    report.addMetric("memory_kb.constant_buffer_frame_peak", constantBufferStats.frameHighWaterMark / 1024.0);
+    report.addMetric("memory_kb.constant_buffer_frame_reserved_peak", constantBufferStats.frameReservedHighWaterMark / 1024.0);
+    report.addMetric("memory_kb.constant_buffer_overflow", constantBufferStats.overflowSize / 1024.0);
+
+    if (!report.write(options.output)) {
+        return 2;
+    }
+
+    if (options.baseline.empty()) {
+        return 0;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!BenchReport::LoadMetrics(options.baseline, baseline)) {
+        return 2;
+    }
+
+    auto regressions = report.compare(baseline, options.tolerance);
+    if (regressions > 0) {
+        LOG_ERROR("[Bench] {} metrics regressed by more than {:.0f}% against {}.",
+                  regressions, options.tolerance * 100.0, options.baseline);
+        return 1;
+    }
+
+    LOG_INFO("[Bench] No regression against {}.", options.baseline);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,246 @@
+﻿#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <logger.hpp>
+#include "bench_report.hpp"
+
+namespace yu {
+
+static std::string EscapeJson(std::string_view str)
+{
+    std::string result;
+    result.reserve(str.size());
+    for (char c : str) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<int>(c));
+                    result += buffer;
+                } else {
+                    result += c;
+                }
+                break;
+        }
+    }
+    return result;
+}
+
+static void SkipSpace(std::string_view text, size_t& pos)
+{
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+    }
+}
+
+static bool ParseString(std::string_view text, size_t& pos, std::string& str)
+{
+    if (pos >= text.size() || text[pos] != '"') {
+        return false;
+    }
+
+    str.clear();
+    for (++pos; pos < text.size(); ++pos) {
+        char c = text[pos];
+        if (c == '"') {
+            ++pos;
+            return true;
+        }
+        if (c != '\\') {
+            str += c;
+            continue;
+        }
+
+        if (++pos >= text.size()) {
+            return false;
+        }
+        switch (text[pos]) {
+            case 'n': str += '\n'; break;
+            case 't': str += '\t'; break;
+            case 'u':
+                // 写入时只会对控制字符使用 \u 转义
+                if (pos + 4 >= text.size()) {
+                    return false;
+                }
+                str += static_cast<char>(std::stoi(std::string{text.substr(pos + 1, 4)}, nullptr, 16));
+                pos += 4;
+                break;
+            default: str += text[pos]; break;
+        }
+    }
+
+    return false;
+}
+
+SampleStats ComputeSampleStats(std::vector<float> samples)
+{
+    SampleStats stats;
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&samples](float p) {
+        auto rank = static_cast<size_t>(std::ceil(p * static_cast<float>(samples.size())));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.avg = std::accumulate(samples.begin(), samples.end(), 0.0f) / static_cast<float>(samples.size());
+    stats.p50 = percentile(0.50f);
+    stats.p95 = percentile(0.95f);
+    stats.p99 = percentile(0.99f);
+
+    return stats;
+}
+
+void BenchReport::setInfo(std::string_view key, std::string_view value)
+{
+    info_.emplace_back(key, value);
+}
+
+void BenchReport::addMetric(std::string_view name, double value)
+{
+    metrics_[std::string{name}] = value;
+}
+
+void BenchReport::addSamples(std::string_view name, std::vector<float> samples)
+{
+    auto stats = ComputeSampleStats(std::move(samples));
+    const std::string prefix{name};
+
+    addMetric(prefix + ".min", stats.min);
+    addMetric(prefix + ".avg", stats.avg);
+    addMetric(prefix + ".p50", stats.p50);
+    addMetric(prefix + ".p95", stats.p95);
+    addMetric(prefix + ".p99", stats.p99);
+    addMetric(prefix + ".max", stats.max);
+}
+
+bool BenchReport::write(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_ERROR("Failed to open benchmark report: {}", path);
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    for (const auto& [key, value] : info_) {
+        file << "  \"" << EscapeJson(key) << "\": \"" << EscapeJson(value) << "\",\n";
+    }
+
+    file << "  \"metrics\": {";
+    bool first = true;
+    for (const auto& [name, value] : metrics_) {
+        file << (first ? "\n" : ",\n") << "    \"" << EscapeJson(name) << "\": " << value;
+        first = false;
+    }
+    file << "\n  }\n}\n";
+
+    LOG_INFO("Benchmark report with {} metrics is written to {}.", metrics_.size(), path);
+    return true;
+}
+
+bool BenchReport::LoadMetrics(const std::string& path, std::map<std::string, double>& metrics)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LOG_ERROR("Failed to open benchmark baseline: {}", path);
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    size_t pos = text.find("\"metrics\"");
+    if (pos == std::string::npos || (pos = text.find('{', pos)) == std::string::npos) {
+        LOG_ERROR("Benchmark baseline {} has no metrics.", path);
+        return false;
+    }
+    ++pos;
+
+    metrics.clear();
+    while (true) {
+        SkipSpace(text, pos);
+        if (pos < text.size() && text[pos] == '}') {
+            return true;
+        }
+
+        std::string name;
+        if (!ParseString(text, pos, name)) {
+            break;
+        }
+
+        SkipSpace(text, pos);
+        if (pos >= text.size() || text[pos] != ':') {
+            break;
+        }
+        ++pos;
+
+        const char* begin = text.c_str() + pos;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin) {
+            break;
+        }
+        pos += static_cast<size_t>(end - begin);
+        metrics[name] = value;
+
+        SkipSpace(text, pos);
+        if (pos < text.size() && text[pos] == ',') {
+            ++pos;
+        }
+    }
+
+    LOG_ERROR("Benchmark baseline {} is malformed near offset {}.", path, pos);
+    return false;
+}
+
+uint32_t BenchReport::compare(const std::map<std::string, double>& baseline, double tolerance) const
+{
+    uint32_t regressions = 0;
+
+    for (const auto& [name, expected] : baseline) {
+        if (name.ends_with(".min") || name.ends_with(".max")) {
+            continue;
+        }
+
+        auto it = metrics_.find(name);
+        if (it == metrics_.end()) {
+            LOG_WARN("[Bench] {} is in the baseline but was not measured.", name);
+            continue;
+        }
+
+        const double actual = it->second;
+        // 基线为 0 的指标没有可以比较的比例
+        if (expected <= 0.0) {
+            continue;
+        }
+
+        const double change = (actual - expected) / expected;
+        if (change > tolerance) {
+            LOG_ERROR("[Bench] {} regressed: {:.4f} -> {:.4f} ({:+.1f}%)", name, expected, actual, change * 100.0);
+            ++regressions;
+        } else if (change < -tolerance) {
+            LOG_INFO("[Bench] {} improved: {:.4f} -> {:.4f} ({:+.1f}%)", name, expected, actual, change * 100.0);
+        }
+    }
+
+    return regressions;
+}
+
+} // namespace yu
\ No newline at end of file
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace yu {
+
+/**
+ * @brief 一组采样的统计，百分位数使用最近秩法
+ */
+struct SampleStats
+{
+    float min = 0.0f;
+    float avg = 0.0f;
+    float p50 = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+};
+
+SampleStats ComputeSampleStats(std::vector<float> samples);
+
+/**
+ * @brief 基准测试的报告，所有指标都是越小越好的数值，按名字平铺在 "metrics" 对象中，
+ *        这样报告本身就可以作为下一次比较的基线
+ */
+class BenchReport
+{
+public:
+    void setInfo(std::string_view key, std::string_view value);
+    void addMetric(std::string_view name, double value);
+    // 添加 name.min、name.avg、name.p50 等指标
+    void addSamples(std::string_view name, std::vector<float> samples);
+
+    const std::map<std::string, double>& getMetrics() const { return metrics_; }
+
+    bool write(const std::string& path) const;
+
+    // 只读取报告中 "metrics" 对象的内容
+    static bool LoadMetrics(const std::string& path, std::map<std::string, double>& metrics);
+
+    /**
+     * @brief 与基线比较，超过基线 (1 + tolerance) 倍的指标视为回归。
+     *        min 和 max 受个别帧的影响太大，只记录不比较
+     * @return 回归的指标数量
+     */
+    uint32_t compare(const std::map<std::string, double>& baseline, double tolerance) const;
+
+private:
+    std::vector<std::pair<std::string, std::string>> info_;
+    std::map<std::string, double> metrics_;
+};
+
+} // namespace yu
\ No newline at end of file
@@ -20,6 +20,7 @@ endif (WIN32)
 # build options
 set(YU_BUILD_APPS ON CACHE BOOL "Enable generation and building of applications.")
 set(YU_BUILD_TESTS ON CACHE BOOL "Enable generation and building of tests.")
+set(YU_BUILD_BENCH ON CACHE BOOL "Enable generation and building of the benchmark harness.")
 set(YU_WARNING_AS_ERROR ON CACHE BOOL "Enable Warnings as Errors")
 
 set(CMAKE_RUNTIME_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/bin")
@@ -0,0 +1,17 @@
+#version 460
+
+layout(location = 0) out vec3 fragColor;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout (push_constant) uniform Push 
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+} push;
+
+void main() {
+    gl_Position = push.projectionMatrix * push.viewMatrix * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+}
\ No newline at end of file
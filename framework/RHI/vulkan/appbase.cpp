@@ -217,6 +217,14 @@ void AppBase::buildUI()
         ImGui::Text("CPU        : %s", system_info_.CPUName.c_str());
         ImGui::Text("FPS        : %d (%.2f ms)", fps, frameTime_ms);
 
+        // 捕获 CPU 和 GPU 的时间线，写入工作目录下的 trace.json
+        auto& traceRecorder = renderer_->getTraceRecorder();
+        if (traceRecorder.isCapturing()) {
+            ImGui::TextUnformatted("Capturing trace...");
+        } else if (ImGui::Button("Capture Trace (120 frames)")) {
+            traceRecorder.beginCapture(120, "trace.json");
+        }
+
         if (ImGui::CollapsingHeader("GPU Timings", ImGuiTreeNodeFlags_DefaultOpen)) {
             // WARNING: If validation layer is switched on, the performance numbers may be inaccurate!
             
@@ -234,6 +242,49 @@ void AppBase::buildUI()
                 ImGui::Text("%-18s: %7.2f ms", timeStamp.label.c_str(), value);
             }
         }
+
+        // 嵌套的测量范围，显示最近若干帧的统计，子范围按照深度缩进
+        const auto& scopeStats = renderer_->getScopeStats();
+        if (!scopeStats.empty() && ImGui::CollapsingHeader("GPU Scopes (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Text("%-18s  %6s %6s %6s %6s %6s", "", "min", "avg", "p95", "p99", "max");
+            for (const auto& stats : scopeStats) {
+                auto indent = static_cast<int>(stats.depth * 2);
+                ImGui::Text("%*s%-*s: %6.3f %6.3f %6.3f %6.3f %6.3f",
+                            indent, "",
+                            std::max(18 - indent, 1), stats.label.c_str(),
+                            stats.min / 1000.0f,
+                            stats.avg / 1000.0f,
+                            stats.p95 / 1000.0f,
+                            stats.p99 / 1000.0f,
+                            stats.max / 1000.0f);
+            }
+        }
+
+        // 流水线统计和遮挡查询，片段着色器调用数除以像素数可以近似地看出过度绘制
+        if (ImGui::CollapsingHeader("GPU Scope Counters", ImGuiTreeNodeFlags_DefaultOpen)) {
+            const auto pixelCount = static_cast<double>(std::max<uint64_t>(static_cast<uint64_t>(W) * H, 1));
+            for (const auto& stats : scopeStats) {
+                if (!stats.hasPipelineStatistics && !stats.hasOcclusion) {
+                    continue;
+                }
+
+                ImGui::Text("%s", stats.path.c_str());
+                if (stats.hasPipelineStatistics) {
+                    ImGui::Text("  Primitives  : %llu in, %llu clipped in, %llu out",
+                                static_cast<unsigned long long>(stats.inputPrimitives),
+                                static_cast<unsigned long long>(stats.clippingInvocations),
+                                static_cast<unsigned long long>(stats.clippingPrimitives));
+                    ImGui::Text("  Invocations : VS %llu, FS %llu (%.2f/px), CS %llu",
+                                static_cast<unsigned long long>(stats.vertexInvocations),
+                                static_cast<unsigned long long>(stats.fragmentInvocations),
+                                static_cast<double>(stats.fragmentInvocations) / pixelCount,
+                                static_cast<unsigned long long>(stats.computeInvocations));
+                }
+                if (stats.hasOcclusion) {
+                    ImGui::Text("  Samples     : %llu passed", static_cast<unsigned long long>(stats.samplesPassed));
+                }
+            }
+        }
         ImGui::End(); // PROFILER
     }
 }
@@ -0,0 +1,132 @@
+﻿#include <logger.hpp>
+#include "bindless_table.hpp"
+#include "initializers.hpp"
+#include "error.hpp"
+
+namespace yu::vk {
+
+void BindlessTable::create(const VulkanDevice& device, uint32_t capacity)
+{
+    device_ = &device;
+
+    if (!device_->getProperties().support_descriptor_indexing) {
+        LOG_FATAL("Bindless table requires descriptor indexing support.");
+    }
+
+    // 容量不能超过设备对 update-after-bind 描述符的限制
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(device_->getProperties().physical_device, &properties2);
+
+    capacity_ = std::min({capacity,
+                          indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                          indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                          indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                          indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers});
+    if (capacity_ < capacity) {
+        LOG_WARN("Bindless table capacity is clamped to {} by the device limits.", capacity_);
+    }
+    next_index_ = 0;
+    free_indices_.clear();
+
+    // 创建描述符池
+    {
+        VkDescriptorPoolSize poolSize = descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, capacity_);
+        auto poolInfo = descriptorPoolCreateInfo(1, &poolSize, 1);
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+
+        VK_CHECK(vkCreateDescriptorPool(device_->getHandle(), &poolInfo, nullptr, &descriptor_pool_));
+    }
+
+    // 创建描述符布局，数组允许部分绑定，并且可以在绑定之后更新没有被使用的元素
+    {
+        auto binding = descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                  VK_SHADER_STAGE_ALL,
+                                                  0,
+                                                  capacity_);
+
+        VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = 1;
+        bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+        auto layoutInfo = descriptorSetLayoutCreateInfo(&binding, 1);
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+
+        VK_CHECK(vkCreateDescriptorSetLayout(device_->getHandle(), &layoutInfo, nullptr, &descriptor_set_layout_));
+    }
+
+    // 整个表只有一个描述符集
+    auto allocInfo = descriptorSetAllocateInfo(descriptor_pool_, &descriptor_set_layout_, 1);
+    VK_CHECK(vkAllocateDescriptorSets(device_->getHandle(), &allocInfo, &descriptor_set_));
+}
+
+void BindlessTable::destroy()
+{
+    if (descriptor_pool_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device_->getHandle(), descriptor_pool_, nullptr);
+        descriptor_pool_ = VK_NULL_HANDLE;
+        descriptor_set_ = VK_NULL_HANDLE;
+    }
+
+    if (descriptor_set_layout_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device_->getHandle(), descriptor_set_layout_, nullptr);
+        descriptor_set_layout_ = VK_NULL_HANDLE;
+    }
+}
+
+uint32_t BindlessTable::registerTexture(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+{
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!free_indices_.empty()) {
+            index = free_indices_.back();
+            free_indices_.pop_back();
+        } else if (next_index_ < capacity_) {
+            index = next_index_++;
+        } else {
+            LOG_FATAL("Bindless table is full, please increase the capacity.");
+            return UINT32_MAX;
+        }
+    }
+
+    auto imageInfo = descriptorImageInfo(sampler, imageView, imageLayout);
+    auto write = writeDescriptorSet(descriptor_set_, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfo);
+    write.dstArrayElement = index;
+
+    vkUpdateDescriptorSets(device_->getHandle(), 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void BindlessTable::unregisterTexture(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    assert(index < next_index_);
+    free_indices_.push_back(index);
+}
+
+void BindlessTable::bind(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, uint32_t set) const
+{
+    vkCmdBindDescriptorSets(cmdBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayout,
+                            set,
+                            1,
+                            &descriptor_set_,
+                            0,
+                            nullptr);
+}
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include "device.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 无绑定纹理表：一个 update-after-bind、允许部分绑定的 COMBINED_IMAGE_SAMPLER 大数组。
+ *        纹理注册后得到数组中的索引，着色器通过推送常量取得索引来采样，绘制时不再需要切换描述符集。
+ *        需要设备支持描述符索引（DeviceProperties::support_descriptor_indexing）
+ */
+class BindlessTable
+{
+public:
+    void create(const VulkanDevice& device, uint32_t capacity = 4096);
+    void destroy();
+
+    /**
+     * @brief 把图片视图和采样器写入表中空闲的位置，返回它的索引
+     */
+    uint32_t registerTexture(VkImageView imageView,
+                             VkSampler sampler,
+                             VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    /**
+     * @brief 归还索引，调用者需要确保已经提交的命令不再使用这个纹理
+     */
+    void unregisterTexture(uint32_t index);
+
+    void bind(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, uint32_t set) const;
+
+    VkDescriptorSetLayout getLayout() const { return descriptor_set_layout_; }
+    VkDescriptorSet getDescriptorSet() const { return descriptor_set_; }
+    uint32_t getCapacity() const { return capacity_; }
+
+private:
+    const VulkanDevice* device_ = nullptr;
+
+    VkDescriptorPool descriptor_pool_{};
+    VkDescriptorSetLayout descriptor_set_layout_{};
+    VkDescriptorSet descriptor_set_{};
+
+    uint32_t capacity_{};
+    uint32_t next_index_{};
+    std::vector<uint32_t> free_indices_;
+
+    std::mutex mutex_{};
+};
+
+} // yu::vk
\ No newline at end of file
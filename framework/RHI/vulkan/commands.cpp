@@ -14,58 +14,133 @@ void FrameCommands::create(const VulkanDevice& device, uint32_t numberOfFrames,
     number_of_frames_ = numberOfFrames;
     command_buffer_per_frame_ = commandBufferPerFrame;
 
-    // 为每一帧创建独立命令池，让命令池能够各自分配命令缓冲区
-    command_buffers.resize(number_of_frames_);
-
-    for (auto& buf : command_buffers) {
-        // 创建命令池
-        auto cmdPoolInfo = commandPoolCreateInfo();
-        cmdPoolInfo.pNext = nullptr;
-        if (isCompute) {
-            cmdPoolInfo.queueFamilyIndex = device_->getComputeQueueIndex();
-        } else {
-            cmdPoolInfo.queueFamilyIndex = device_->getGraphicsQueueIndex();
-        }
-
-        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-
-        VK_CHECK(vkCreateCommandPool(device_->getHandle(), &cmdPoolInfo, nullptr, &buf.command_pool));
-
-        // 创建命令缓冲区
-        buf.command_buffer.resize(command_buffer_per_frame_);
-        auto cmdBufferInfo = commandBufferAllocateInfo(buf.command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, command_buffer_per_frame_);
-
-        VK_CHECK(vkAllocateCommandBuffers(device_->getHandle(), &cmdBufferInfo, buf.command_buffer.data()));
-
-        buf.number_of_used = 0;
+    if (isCompute) {
+        queue_family_index_ = device_->getComputeQueueIndex();
+    } else {
+        queue_family_index_ = device_->getGraphicsQueueIndex();
     }
 
+    // 为每一帧的每个线程创建独立命令池，让命令池能够各自分配命令缓冲区；命令池在线程第一次使用时才创建
+    command_buffers = std::make_unique<CommandBufferPerFrame[]>(number_of_frames_);
+
     frame_index_ = 0;
+    current_buffer = &command_buffers[0];
 }
 
 void FrameCommands::destroy()
 {
-    for (auto& buf : command_buffers) {
-        vkFreeCommandBuffers(device_->getHandle(), buf.command_pool, command_buffer_per_frame_, buf.command_buffer.data());
-        vkDestroyCommandPool(device_->getHandle(), buf.command_pool, nullptr);
+    for (uint32_t i = 0; i < number_of_frames_; ++i) {
+        for (auto& buf : command_buffers[i].threads) {
+            if (buf.command_pool == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            // 销毁命令池时会一起释放其中的命令缓冲区
+            vkDestroyCommandPool(device_->getHandle(), buf.command_pool, nullptr);
+            buf.command_pool = VK_NULL_HANDLE;
+            buf.command_buffer.clear();
+            buf.secondary_command_buffer.clear();
+        }
     }
+
+    command_buffers.reset();
+    current_buffer = nullptr;
+    number_of_frames_ = 0;
 }
 
 void FrameCommands::beginFrame()
 {
     current_buffer = &command_buffers[frame_index_ % number_of_frames_];
-    current_buffer->number_of_used = 0;
+
+    // 一次重置整个命令池，比逐个重置命令缓冲区开销更小
+    for (auto& buf : current_buffer->threads) {
+        std::lock_guard<std::mutex> lock(buf.mutex);
+
+        if (buf.command_pool != VK_NULL_HANDLE) {
+            VK_CHECK(vkResetCommandPool(device_->getHandle(), buf.command_pool, 0));
+        }
+        buf.number_of_used = 0;
+        buf.number_of_secondary_used = 0;
+    }
     
     frame_index_ += 1;
 }
 
+FrameCommands::CommandBufferPerThread& FrameCommands::getThreadCommands()
+{
+    return current_buffer->threads[ThreadSlot()];
+}
+
+VkCommandBuffer FrameCommands::allocCommandBuffer(CommandBufferPerThread& commands, VkCommandBufferLevel level)
+{
+    if (commands.command_pool == VK_NULL_HANDLE) {
+        auto cmdPoolInfo = commandPoolCreateInfo();
+        cmdPoolInfo.pNext = nullptr;
+        cmdPoolInfo.queueFamilyIndex = queue_family_index_;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        VK_CHECK(vkCreateCommandPool(device_->getHandle(), &cmdPoolInfo, nullptr, &commands.command_pool));
+    }
+
+    const bool bPrimary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    auto& buffers = bPrimary ? commands.command_buffer : commands.secondary_command_buffer;
+    auto& used = bPrimary ? commands.number_of_used : commands.number_of_secondary_used;
+
+    // 已有的命令缓冲区用完时按批追加
+    if (used == buffers.size()) {
+        const uint32_t count = std::max(command_buffer_per_frame_, 1u);
+        auto cmdBufferInfo = commandBufferAllocateInfo(commands.command_pool, level, count);
+
+        buffers.resize(used + count);
+        VK_CHECK(vkAllocateCommandBuffers(device_->getHandle(), &cmdBufferInfo, buffers.data() + used));
+    }
+
+    return buffers[used++];
+}
+
 VkCommandBuffer FrameCommands::getNewCommandBuffer()
 {
-    auto cmdBuffer = current_buffer->command_buffer[current_buffer->number_of_used++];
+    auto& commands = getThreadCommands();
+    std::lock_guard<std::mutex> lock(commands.mutex);
+
+    return allocCommandBuffer(commands, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+}
+
+VkCommandBuffer FrameCommands::beginSecondaryCommandBuffer(VkRenderPass renderPass,
+                                                           uint32_t subpass,
+                                                           VkFramebuffer framebuffer)
+{
+    VkCommandBuffer cmdBuffer;
+    {
+        auto& commands = getThreadCommands();
+        std::lock_guard<std::mutex> lock(commands.mutex);
+
+        cmdBuffer = allocCommandBuffer(commands, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    }
+
+    // 次级命令缓冲区在渲染通道内执行，需要继承渲染通道和子通道
+    auto inheritanceInfo = commandBufferInheritanceInfo();
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    auto beginInfo = commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
 
-    assert(current_buffer->number_of_used < command_buffer_per_frame_);
-    
     return cmdBuffer;
 }
 
+void FrameCommands::ExecuteSecondaryCommandBuffers(VkCommandBuffer primaryCmdBuffer,
+                                                   const std::vector<VkCommandBuffer>& secondaryCmdBuffers)
+{
+    if (secondaryCmdBuffers.empty()) {
+        return;
+    }
+
+    vkCmdExecuteCommands(primaryCmdBuffer, static_cast<uint32_t>(secondaryCmdBuffers.size()), secondaryCmdBuffers.data());
+}
+
 } // namespace yu::vk
@@ -5,10 +5,12 @@
 #pragma once
 
 #include "device.hpp"
+#include <common/thread_slot.hpp>
+
 namespace yu::vk {
 
 /**
- * @brief 用于创建命令池和命令缓冲区
+ * @brief 用于创建命令池和命令缓冲区。每一帧的每个线程槽位都有自己的命令池，槽位由线程独占，多个线程可以同时录制命令
  */
 class FrameCommands
 {
@@ -16,24 +18,58 @@ public:
     void create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t commandBufferPerFrame, bool isCompute = false);
     void destroy();
     
+    /**
+     * @brief 切换到下一帧并重置该帧所有的命令池，调用时需要确保该帧的命令已经执行完毕
+     */
     void beginFrame();
+
+    // 从调用线程的命令池中取得一个主命令缓冲区
     VkCommandBuffer getNewCommandBuffer();
 
-private:
-    const VulkanDevice* device_ = nullptr;
+    /**
+     * @brief 从调用线程的命令池中取得一个次级命令缓冲区并开始录制，它继承渲染通道的状态，
+     *        只能在主命令缓冲区以 VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS 开始的渲染通道中执行。
+     *        录制完成后需要调用 vkEndCommandBuffer
+     */
+    VkCommandBuffer beginSecondaryCommandBuffer(VkRenderPass renderPass,
+                                                uint32_t subpass = 0,
+                                                VkFramebuffer framebuffer = VK_NULL_HANDLE);
 
-    uint32_t frame_index_{};
-    uint32_t number_of_frames_{};
-    uint32_t command_buffer_per_frame_{};
+    // 在主命令缓冲区中执行录制好的次级命令缓冲区
+    static void ExecuteSecondaryCommandBuffers(VkCommandBuffer primaryCmdBuffer,
+                                               const std::vector<VkCommandBuffer>& secondaryCmdBuffers);
 
-    struct CommandBufferPerFrame
+private:
+    struct CommandBufferPerThread
     {
         VkCommandPool command_pool{};
         std::vector<VkCommandBuffer> command_buffer{};
         uint32_t number_of_used{};
+        std::vector<VkCommandBuffer> secondary_command_buffer{};
+        uint32_t number_of_secondary_used{};
+        std::mutex mutex{};
     };
-    
-    std::vector<CommandBufferPerFrame> command_buffers{};
+
+    struct CommandBufferPerFrame
+    {
+        std::array<CommandBufferPerThread, MaxThreadSlots> threads{};
+    };
+
+    // 取得调用线程在当前帧的命令池。槽位由线程独占，录制期间不会有其他线程使用这个命令池；
+    // 锁只用来和 beginFrame 的重置互斥
+    CommandBufferPerThread& getThreadCommands();
+    // 命令池在第一次分配时创建
+    VkCommandBuffer allocCommandBuffer(CommandBufferPerThread& commands, VkCommandBufferLevel level);
+
+private:
+    const VulkanDevice* device_ = nullptr;
+
+    uint32_t frame_index_{};
+    uint32_t number_of_frames_{};
+    uint32_t command_buffer_per_frame_{};
+    uint32_t queue_family_index_{};
+
+    std::unique_ptr<CommandBufferPerFrame[]> command_buffers{};
     CommandBufferPerFrame* current_buffer = nullptr;
 };
 
@@ -0,0 +1,100 @@
+﻿#include <common/hash.hpp>
+#include "descriptor_layout_cache.hpp"
+#include "initializers.hpp"
+#include "error.hpp"
+
+namespace yu::vk {
+
+void DescriptorLayoutCache::create(const VulkanDevice& device)
+{
+    device_ = &device;
+}
+
+void DescriptorLayoutCache::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& [key, entry] : layouts_) {
+        vkDestroyDescriptorSetLayout(device_->getHandle(), entry.layout, nullptr);
+    }
+    layouts_.clear();
+}
+
+bool DescriptorLayoutCache::SameBindings(const Entry& entry, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    if (entry.bindings.size() != bindings.size()) {
+        return false;
+    }
+
+    size_t samplerIndex = 0;
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        const auto& a = entry.bindings[i];
+        const auto& b = bindings[i];
+        if (a.binding != b.binding
+            || a.descriptorType != b.descriptorType
+            || a.descriptorCount != b.descriptorCount
+            || a.stageFlags != b.stageFlags
+            || (a.pImmutableSamplers != nullptr) != (b.pImmutableSamplers != nullptr)) {
+            return false;
+        }
+
+        if (b.pImmutableSamplers != nullptr) {
+            if (!std::equal(b.pImmutableSamplers, b.pImmutableSamplers + b.descriptorCount,
+                            entry.immutable_samplers.begin() + static_cast<ptrdiff_t>(samplerIndex))) {
+                return false;
+            }
+            samplerIndex += b.descriptorCount;
+        }
+    }
+
+    return true;
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings)
+{
+    std::sort(bindings.begin(), bindings.end(),
+              [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+    uint64_t key = HashCombine(FNV_OFFSET_BASIS, bindings.size());
+    for (const auto& binding : bindings) {
+        key = HashCombine(key, binding.binding);
+        key = HashCombine(key, binding.descriptorType);
+        key = HashCombine(key, binding.descriptorCount);
+        key = HashCombine(key, binding.stageFlags);
+        if (binding.pImmutableSamplers != nullptr) {
+            key = HashBytes(binding.pImmutableSamplers, sizeof(VkSampler) * binding.descriptorCount, key);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto [begin, end] = layouts_.equal_range(key);
+    for (auto it = begin; it != end; ++it) {
+        if (SameBindings(it->second, bindings)) {
+            return it->second.layout;
+        }
+    }
+
+    auto layoutInfo = descriptorSetLayoutCreateInfo(bindings);
+
+    Entry entry{};
+    VK_CHECK(vkCreateDescriptorSetLayout(device_->getHandle(), &layoutInfo, nullptr, &entry.layout));
+
+    for (auto& binding : bindings) {
+        if (binding.pImmutableSamplers != nullptr) {
+            entry.immutable_samplers.insert(entry.immutable_samplers.end(),
+                                            binding.pImmutableSamplers,
+                                            binding.pImmutableSamplers + binding.descriptorCount);
+            // 只用来比较是否存在，不再解引用
+            binding.pImmutableSamplers = entry.immutable_samplers.data();
+        }
+    }
+    entry.bindings = std::move(bindings);
+
+    auto layout = entry.layout;
+    layouts_.emplace(key, std::move(entry));
+
+    return layout;
+}
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "device.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 描述符布局缓存，绑定信息相同的布局只创建一次，布局在缓存销毁时统一释放
+ */
+class DescriptorLayoutCache
+{
+public:
+    void create(const VulkanDevice& device);
+    void destroy();
+
+    /**
+     * @brief 取得与绑定信息一致的描述符布局，绑定的顺序不影响结果
+     */
+    VkDescriptorSetLayout getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+
+    size_t getLayoutCount() const { return layouts_.size(); }
+
+private:
+    // 保存排序后的绑定信息作为完整的键，命中时比较，哈希冲突的两组绑定不会共用布局
+    struct Entry
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        // 按照绑定的顺序保存不可变采样器，绑定中的指针指向调用者的内存，不能保存
+        std::vector<VkSampler> immutable_samplers;
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    };
+
+    static bool SameBindings(const Entry& entry, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+private:
+    const VulkanDevice* device_ = nullptr;
+
+    std::unordered_multimap<uint64_t, Entry> layouts_;
+    std::mutex mutex_{};
+};
+
+} // yu::vk
\ No newline at end of file
@@ -2,6 +2,7 @@
 // Created by 秋鱼 on 2022/6/14.
 //
 
+#include <logger.hpp>
 #include "descriptor_pool.hpp"
 #include "error.hpp"
 #include "initializers.hpp"
@@ -12,50 +13,153 @@ void DescriptorPool::create(const VulkanDevice& device,
                             uint32_t cbvDescriptorCount,
                             uint32_t srvDescriptorCount,
                             uint32_t samplerDescriptorCount,
-                            uint32_t uavDescriptorCount
+                            uint32_t uavDescriptorCount,
+                            uint32_t numberOfFrames
 )
 {
     device_ = &device;
     allocated_descriptor_count_ = 0;
+    page_count_ = 0;
 
-    const VkDescriptorPoolSize type_count[] =
-        {
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, cbvDescriptorCount},
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, cbvDescriptorCount},
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, srvDescriptorCount},
-            {VK_DESCRIPTOR_TYPE_SAMPLER, samplerDescriptorCount},
-            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, uavDescriptorCount}
-        };
+    page_sizes_ = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, cbvDescriptorCount},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, cbvDescriptorCount},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, srvDescriptorCount},
+        {VK_DESCRIPTOR_TYPE_SAMPLER, samplerDescriptorCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, uavDescriptorCount}
+    };
+    page_max_sets_ = cbvDescriptorCount + srvDescriptorCount + samplerDescriptorCount + uavDescriptorCount;
 
-    VkDescriptorPoolCreateInfo descriptor_pool = {};
-    descriptor_pool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptor_pool.pNext = nullptr;
-    descriptor_pool.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    descriptor_pool.maxSets = 8000;
-    descriptor_pool.poolSizeCount = _countof(type_count);
-    descriptor_pool.pPoolSizes = type_count;
-
-    VK_CHECK(vkCreateDescriptorPool(device_->getHandle(), &descriptor_pool, nullptr, &descriptor_pool_));
+    // 池页都是按需创建的，这里只准备临时池的容器
+    number_of_frames_ = numberOfFrames;
+    frame_index_ = 0;
+    if (number_of_frames_ > 0) {
+        transient_frames_ = std::make_unique<TransientFrame[]>(number_of_frames_);
+    }
 }
 
 void DescriptorPool::destroy()
 {
-    if (descriptor_pool_ != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(device_->getHandle(), descriptor_pool_, nullptr);
-        descriptor_pool_ = VK_NULL_HANDLE;
+    for (auto& slot : persistent_pages_) {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+
+        for (auto page : slot.pages) {
+            vkDestroyDescriptorPool(device_->getHandle(), page, nullptr);
+        }
+        slot.pages.clear();
+        slot.owners.clear();
+        slot.current_page = 0;
+    }
+
+    for (uint32_t i = 0; i < number_of_frames_; ++i) {
+        for (auto& slot : transient_frames_[i].slots) {
+            for (auto page : slot.pages) {
+                vkDestroyDescriptorPool(device_->getHandle(), page, nullptr);
+            }
+            slot.pages.clear();
+            slot.current_page = 0;
+        }
+    }
+    transient_frames_.reset();
+    number_of_frames_ = 0;
+
+    for (auto updateTemplate : update_templates_) {
+        vkDestroyDescriptorUpdateTemplate(device_->getHandle(), updateTemplate, nullptr);
+    }
+    update_templates_.clear();
+
+    page_count_ = 0;
+}
+
+void DescriptorPool::beginFrame()
+{
+    if (number_of_frames_ == 0) {
+        return;
+    }
+
+    frame_index_ = (frame_index_ + 1) % number_of_frames_;
+
+    // 整体重置临时池，比逐个释放描述符集快得多，也不会产生碎片
+    for (auto& slot : transient_frames_[frame_index_].slots) {
+        for (auto page : slot.pages) {
+            VK_CHECK(vkResetDescriptorPool(device_->getHandle(), page, 0));
+        }
+        slot.current_page = 0;
+    }
+}
+
+VkDescriptorPool DescriptorPool::createPage(bool bFreeable)
+{
+    auto poolInfo = descriptorPoolCreateInfo(page_sizes_, page_max_sets_);
+    poolInfo.flags = bFreeable ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(device_->getHandle(), &poolInfo, nullptr, &pool));
+
+    page_count_ += 1;
+
+    return pool;
+}
+
+VkDescriptorPool DescriptorPool::allocFromPages(std::vector<VkDescriptorPool>& pages,
+                                                uint32_t& currentPage,
+                                                bool bFreeable,
+                                                VkDescriptorSetLayout descriptorLayout,
+                                                VkDescriptorSet* pDescriptorSet)
+{
+    while (true) {
+        const bool bNewPage = currentPage == pages.size();
+        if (bNewPage) {
+            pages.push_back(createPage(bFreeable));
+        }
+
+        auto pool = pages[currentPage];
+        auto allocInfo = descriptorSetAllocateInfo(pool, &descriptorLayout, 1);
+        auto result = vkAllocateDescriptorSets(device_->getHandle(), &allocInfo, pDescriptorSet);
+
+        if (result == VK_SUCCESS) {
+            return pool;
+        }
+
+        // 当前页已满或者碎片过多，换到下一页
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            if (bNewPage) {
+                LOG_FATAL("Descriptor set layout does not fit in a single descriptor pool page.");
+            }
+            currentPage += 1;
+            continue;
+        }
+
+        VK_CHECK(result);
+        return VK_NULL_HANDLE;
     }
 }
 
 void DescriptorPool::allocDescriptor(VkDescriptorSetLayout descriptorLayout, VkDescriptorSet* pDescriptorSet)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = persistent_pages_[ThreadSlot()];
+    std::lock_guard<std::mutex> lock(slot.mutex);
 
-    auto alloc_info = descriptorSetAllocateInfo(descriptor_pool_, &descriptorLayout, 1);
-    VK_CHECK(vkAllocateDescriptorSets(device_->getHandle(), &alloc_info, pDescriptorSet));
+    auto pool = allocFromPages(slot.pages, slot.current_page, true, descriptorLayout, pDescriptorSet);
+    slot.owners[*pDescriptorSet] = pool;
 
     allocated_descriptor_count_ += 1;
 }
 
+VkDescriptorSet DescriptorPool::allocTransientDescriptor(VkDescriptorSetLayout descriptorLayout)
+{
+    if (number_of_frames_ == 0) {
+        LOG_FATAL("Descriptor pool is created without transient pools.");
+    }
+
+    auto& slot = transient_frames_[frame_index_].slots[ThreadSlot()];
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    allocFromPages(slot.pages, slot.current_page, false, descriptorLayout, &descriptorSet);
+
+    return descriptorSet;
+}
+
 void DescriptorPool::allocDescriptor(int size, const VkSampler* pSamplers, VkDescriptorSetLayout* pDescSetLayout, VkDescriptorSet* pDescriptorSet)
 {
 
@@ -109,10 +213,100 @@ void DescriptorPool::createDescriptorSetLayoutAndAllocDescriptorSet(std::vector<
     return allocDescriptor(*pDescSetLayout, pDescriptorSet);
 }
 
+VkDescriptorUpdateTemplate DescriptorPool::createUpdateTemplate(VkDescriptorSetLayout descriptorLayout,
+                                                                const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    entries.reserve(bindings.size());
+
+    size_t offset = 0;
+    for (const auto& binding : bindings) {
+        size_t stride;
+        switch (binding.descriptorType) {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                stride = sizeof(VkDescriptorBufferInfo);
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                stride = sizeof(VkBufferView);
+                break;
+            default:
+                stride = sizeof(VkDescriptorImageInfo);
+                break;
+        }
+
+        entries.push_back(descriptorUpdateTemplateEntry(binding.binding,
+                                                        binding.descriptorType,
+                                                        binding.descriptorCount,
+                                                        offset,
+                                                        stride));
+        offset += stride * binding.descriptorCount;
+    }
+
+    return createUpdateTemplate(descriptorLayout, entries);
+}
+
+VkDescriptorUpdateTemplate DescriptorPool::createUpdateTemplate(VkDescriptorSetLayout descriptorLayout,
+                                                                const std::vector<VkDescriptorUpdateTemplateEntry>& entries)
+{
+    auto templateInfo = descriptorUpdateTemplateCreateInfo(entries, descriptorLayout);
+
+    VkDescriptorUpdateTemplate updateTemplate;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(device_->getHandle(), &templateInfo, nullptr, &updateTemplate));
+
+    std::lock_guard<std::mutex> lock(template_mutex_);
+    update_templates_.push_back(updateTemplate);
+
+    return updateTemplate;
+}
+
+void DescriptorPool::updateDescriptorSet(VkDescriptorSet descriptorSet,
+                                         VkDescriptorUpdateTemplate updateTemplate,
+                                         const void* pData) const
+{
+    vkUpdateDescriptorSetWithTemplate(device_->getHandle(), descriptorSet, updateTemplate, pData);
+}
+
+bool DescriptorPool::freeFromSlot(uint32_t slotIndex, VkDescriptorSet descriptorSet)
+{
+    auto& slot = persistent_pages_[slotIndex];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+
+    auto it = slot.owners.find(descriptorSet);
+    if (it == slot.owners.end()) {
+        return false;
+    }
+
+    VK_CHECK(vkFreeDescriptorSets(device_->getHandle(), it->second, 1, &descriptorSet));
+
+    // 前面的页有了空间，下次分配从这一页开始尝试
+    auto page = std::find(slot.pages.begin(), slot.pages.end(), it->second);
+    slot.current_page = std::min(slot.current_page, static_cast<uint32_t>(page - slot.pages.begin()));
+
+    slot.owners.erase(it);
+
+    allocated_descriptor_count_ -= 1;
+    return true;
+}
+
 void DescriptorPool::freeDescriptor(VkDescriptorSet descriptorSet)
 {
-    allocated_descriptor_count_--;
-    vkFreeDescriptorSets(device_->getHandle(), descriptor_pool_, 1, &descriptorSet);
+    // 描述符集通常由分配它的线程释放，先查自己的槽位，找不到时再查其他槽位
+    const uint32_t ownSlot = ThreadSlot();
+    if (freeFromSlot(ownSlot, descriptorSet)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < MaxThreadSlots; ++i) {
+        if (i != ownSlot && freeFromSlot(i, descriptorSet)) {
+            return;
+        }
+    }
+
+    LOG_ERROR("Descriptor set is not allocated from this pool.");
 }
 
 } // yu::vk
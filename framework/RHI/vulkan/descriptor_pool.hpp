@@ -5,20 +5,40 @@
 #pragma once
 
 #include "device.hpp"
+#include <common/thread_slot.hpp>
+
 namespace yu::vk {
 
+/**
+ * @brief 描述符池管理器。每个线程槽位拥有自己的池页，池页用完时再追加新的页；
+ *        另外为每一帧提供只分配不释放的临时池，在 beginFrame 时整体重置
+ */
 class DescriptorPool
 {
 public:
+    /**
+     * @brief 传入的描述符数量是单个池页的大小，numberOfFrames 为 0 时不创建临时池
+     */
     void create(const VulkanDevice& device,
                 uint32_t cbvDescriptorCount,
                 uint32_t srvDescriptorCount,
                 uint32_t samplerDescriptorCount,
-                uint32_t uavDescriptorCount
+                uint32_t uavDescriptorCount,
+                uint32_t numberOfFrames = 0
     );
 
     void destroy();
 
+    /**
+     * @brief 切换到下一帧的临时池并重置它，调用时需要确保该帧的命令已经执行完毕
+     */
+    void beginFrame();
+
+    /**
+     * @brief 从当前帧的临时池分配描述符集，只在当前帧内有效，不需要也不能释放
+     */
+    VkDescriptorSet allocTransientDescriptor(VkDescriptorSetLayout descriptorLayout);
+
     /**
      * @brief 通过描述符的布局创建描述符集
      */
@@ -53,13 +73,75 @@ public:
 
     void freeDescriptor(VkDescriptorSet descriptorSet);
 
+    /**
+     * @brief 按照描述符布局的绑定信息创建更新模板。写入的数据按绑定在数组中的顺序紧密排列，
+     *        缓冲区对应 VkDescriptorBufferInfo，图片和采样器对应 VkDescriptorImageInfo，texel buffer 对应 VkBufferView。
+     *        模板归描述符池所有，在 destroy 时统一销毁
+     */
+    VkDescriptorUpdateTemplate createUpdateTemplate(VkDescriptorSetLayout descriptorLayout,
+                                                    const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    // 按照给出的模板条目创建更新模板，数据的排列方式由调用者决定
+    VkDescriptorUpdateTemplate createUpdateTemplate(VkDescriptorSetLayout descriptorLayout,
+                                                    const std::vector<VkDescriptorUpdateTemplateEntry>& entries);
+
+    /**
+     * @brief 通过更新模板一次写入整个描述符集，pData 指向与模板对应的紧密排列的结构体
+     */
+    void updateDescriptorSet(VkDescriptorSet descriptorSet, VkDescriptorUpdateTemplate updateTemplate, const void* pData) const;
+
+    uint32_t getAllocatedCount() const { return allocated_descriptor_count_; }
+    uint32_t getPageCount() const { return page_count_; }
+
+private:
+    VkDescriptorPool createPage(bool bFreeable);
+
+    // 在池页链上分配描述符集，所有池页都已满时追加新的一页
+    VkDescriptorPool allocFromPages(std::vector<VkDescriptorPool>& pages,
+                                    uint32_t& currentPage,
+                                    bool bFreeable,
+                                    VkDescriptorSetLayout descriptorLayout,
+                                    VkDescriptorSet* pDescriptorSet);
+
+    // 描述符集属于这个槽位时释放它并返回 true
+    bool freeFromSlot(uint32_t slotIndex, VkDescriptorSet descriptorSet);
+
 private:
     const VulkanDevice* device_ = nullptr;
 
-    VkDescriptorPool descriptor_pool_{};
+    std::vector<VkDescriptorPoolSize> page_sizes_;
+    uint32_t page_max_sets_{};
+
+    // 长期使用的描述符集，记录每个集来自哪个池页以便释放。
+    // 槽位由线程独占，但描述符集可以在其他线程释放，所以仍然需要锁；它只减少竞争，并不是无锁的
+    struct PersistentPages
+    {
+        std::vector<VkDescriptorPool> pages;
+        uint32_t current_page{};
+        std::unordered_map<VkDescriptorSet, VkDescriptorPool> owners;
+        std::mutex mutex;
+    };
+    std::array<PersistentPages, MaxThreadSlots> persistent_pages_;
+
+    // 每一帧的临时池页，只被占有槽位的线程访问，beginFrame 时没有线程在分配，所以不需要锁
+    struct TransientPages
+    {
+        std::vector<VkDescriptorPool> pages;
+        uint32_t current_page{};
+    };
+    struct TransientFrame
+    {
+        std::array<TransientPages, MaxThreadSlots> slots;
+    };
+    std::unique_ptr<TransientFrame[]> transient_frames_;
+    uint32_t number_of_frames_{};
+    uint32_t frame_index_{};
+
+    std::vector<VkDescriptorUpdateTemplate> update_templates_;
+    std::mutex template_mutex_{};
 
-    std::mutex mutex_{};
-    uint32_t allocated_descriptor_count_{};
+    std::atomic<uint32_t> allocated_descriptor_count_{};
+    std::atomic<uint32_t> page_count_{};
 };
 
 } // yu::vk
\ No newline at end of file
@@ -0,0 +1,211 @@
+﻿#include <algorithm>
+#include <cstddef>
+#include <common/hash.hpp>
+#include "descriptor_set_cache.hpp"
+#include "initializers.hpp"
+
+namespace yu::vk {
+
+void DescriptorSetCache::create(const VulkanDevice& device,
+                                DescriptorPool& descriptorPool,
+                                uint32_t numberOfFrames,
+                                uint32_t maxUnusedFrames)
+{
+    device_ = &device;
+    descriptor_pool_ = &descriptorPool;
+
+    // 还在被 GPU 使用的描述符集不能释放
+    max_unused_frames_ = std::max(maxUnusedFrames, numberOfFrames);
+    frame_index_ = 0;
+    hit_count_ = 0;
+    miss_count_ = 0;
+}
+
+void DescriptorSetCache::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& [key, entry] : sets_) {
+        descriptor_pool_->freeDescriptor(entry.set);
+    }
+    sets_.clear();
+
+    // 模板由描述符池在销毁时释放
+    templates_.clear();
+}
+
+template<typename Pred>
+void DescriptorSetCache::freeSetsIf(Pred pred)
+{
+    std::erase_if(sets_, [this, &pred](const auto& item)
+    {
+        if (!pred(item.second)) {
+            return false;
+        }
+
+        descriptor_pool_->freeDescriptor(item.second.set);
+        return true;
+    });
+}
+
+void DescriptorSetCache::beginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    frame_index_ += 1;
+
+    freeSetsIf([this](const Entry& entry)
+    {
+        return frame_index_ - entry.last_used_frame > max_unused_frames_;
+    });
+}
+
+void DescriptorSetCache::invalidate(VkImageView imageView)
+{
+    if (imageView == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    freeSetsIf([imageView](const Entry& entry)
+    {
+        return std::ranges::any_of(entry.writes, [imageView](const DescriptorWrite& write)
+        {
+            return write.imageInfo.imageView == imageView;
+        });
+    });
+}
+
+void DescriptorSetCache::invalidate(VkBuffer buffer)
+{
+    if (buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    freeSetsIf([buffer](const Entry& entry)
+    {
+        return std::ranges::any_of(entry.writes, [buffer](const DescriptorWrite& write)
+        {
+            return write.bufferInfo.buffer == buffer;
+        });
+    });
+}
+
+uint64_t DescriptorSetCache::HashWrites(VkDescriptorSetLayout descriptorLayout, const std::vector<DescriptorWrite>& writes)
+{
+    uint64_t hash = HashCombine(FNV_OFFSET_BASIS, descriptorLayout);
+
+    for (const auto& write : writes) {
+        hash = HashCombine(hash, write.binding);
+        hash = HashCombine(hash, write.arrayElement);
+        hash = HashCombine(hash, write.type);
+        hash = HashCombine(hash, write.bufferInfo.buffer);
+        hash = HashCombine(hash, write.bufferInfo.offset);
+        hash = HashCombine(hash, write.bufferInfo.range);
+        hash = HashCombine(hash, write.imageInfo.sampler);
+        hash = HashCombine(hash, write.imageInfo.imageView);
+        hash = HashCombine(hash, write.imageInfo.imageLayout);
+    }
+
+    return hash;
+}
+
+bool DescriptorSetCache::SameWrites(const std::vector<DescriptorWrite>& lhs, const std::vector<DescriptorWrite>& rhs)
+{
+    return std::ranges::equal(lhs, rhs, [](const DescriptorWrite& a, const DescriptorWrite& b)
+    {
+        return a.binding == b.binding
+            && a.arrayElement == b.arrayElement
+            && a.type == b.type
+            && a.bufferInfo.buffer == b.bufferInfo.buffer
+            && a.bufferInfo.offset == b.bufferInfo.offset
+            && a.bufferInfo.range == b.bufferInfo.range
+            && a.imageInfo.sampler == b.imageInfo.sampler
+            && a.imageInfo.imageView == b.imageInfo.imageView
+            && a.imageInfo.imageLayout == b.imageInfo.imageLayout;
+    });
+}
+
+// 更新模板按照 offsetof 计算的偏移读取 writes 数组
+static_assert(std::is_standard_layout_v<DescriptorWrite>);
+
+VkDescriptorUpdateTemplate DescriptorSetCache::getUpdateTemplate(VkDescriptorSetLayout descriptorLayout,
+                                                                 const std::vector<DescriptorWrite>& writes)
+{
+    std::vector<TemplateSlot> slots;
+    slots.reserve(writes.size());
+    uint64_t key = HashCombine(FNV_OFFSET_BASIS, descriptorLayout);
+    for (const auto& write : writes) {
+        slots.push_back({write.binding, write.arrayElement, write.type});
+        key = HashCombine(key, write.binding);
+        key = HashCombine(key, write.arrayElement);
+        key = HashCombine(key, write.type);
+    }
+
+    auto [first, last] = templates_.equal_range(key);
+    for (auto it = first; it != last; ++it) {
+        if (it->second.layout == descriptorLayout && it->second.slots == slots) {
+            return it->second.update_template;
+        }
+    }
+
+    // 每个条目直接指向 writes 数组中对应元素的 bufferInfo 或 imageInfo，更新时不需要再整理数据
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    entries.reserve(writes.size());
+    for (size_t i = 0; i < writes.size(); ++i) {
+        size_t offset = i * sizeof(DescriptorWrite);
+        switch (writes[i].type) {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                offset += offsetof(DescriptorWrite, bufferInfo);
+                break;
+            default:
+                offset += offsetof(DescriptorWrite, imageInfo);
+                break;
+        }
+
+        auto entry = descriptorUpdateTemplateEntry(writes[i].binding, writes[i].type, 1, offset, sizeof(DescriptorWrite));
+        entry.dstArrayElement = writes[i].arrayElement;
+        entries.push_back(entry);
+    }
+
+    auto updateTemplate = descriptor_pool_->createUpdateTemplate(descriptorLayout, entries);
+    templates_.emplace(key, TemplateEntry{descriptorLayout, std::move(slots), updateTemplate});
+
+    return updateTemplate;
+}
+
+VkDescriptorSet DescriptorSetCache::getDescriptorSet(VkDescriptorSetLayout descriptorLayout,
+                                                     const std::vector<DescriptorWrite>& writes)
+{
+    const uint64_t key = HashWrites(descriptorLayout, writes);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto [first, last] = sets_.equal_range(key);
+    for (auto it = first; it != last; ++it) {
+        auto& entry = it->second;
+        if (entry.layout == descriptorLayout && SameWrites(entry.writes, writes)) {
+            entry.last_used_frame = frame_index_;
+            hit_count_ += 1;
+            return entry.set;
+        }
+    }
+
+    VkDescriptorSet descriptorSet;
+    descriptor_pool_->allocDescriptor(descriptorLayout, &descriptorSet);
+
+    descriptor_pool_->updateDescriptorSet(descriptorSet, getUpdateTemplate(descriptorLayout, writes), writes.data());
+
+    sets_.emplace(key, Entry{descriptorLayout, writes, descriptorSet, frame_index_});
+    miss_count_ += 1;
+
+    return descriptorSet;
+}
+
+} // yu::vk
\ No newline at end of file
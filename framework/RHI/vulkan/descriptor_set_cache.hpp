@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include "descriptor_pool.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 描述符集中一个描述符的内容，缓冲区类型使用 bufferInfo，图片和采样器类型使用 imageInfo。
+ *        更新模板直接从这个结构体的数组中读取描述符信息
+ */
+struct DescriptorWrite
+{
+    uint32_t binding = 0;
+    uint32_t arrayElement = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    VkDescriptorBufferInfo bufferInfo{};
+    VkDescriptorImageInfo imageInfo{};
+};
+
+inline DescriptorWrite BufferDescriptorWrite(uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& bufferInfo)
+{
+    DescriptorWrite write{};
+    write.binding = binding;
+    write.type = type;
+    write.bufferInfo = bufferInfo;
+    return write;
+}
+
+inline DescriptorWrite ImageDescriptorWrite(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo)
+{
+    DescriptorWrite write{};
+    write.binding = binding;
+    write.type = type;
+    write.imageInfo = imageInfo;
+    return write;
+}
+
+/**
+ * @brief 描述符集缓存，按照布局和绑定的资源查找已经写好的描述符集，只有未命中时才分配和更新描述符集。
+ *        更新通过描述符更新模板完成，布局和写入的绑定相同的描述符集共用一个模板。
+ *        一段时间没有被使用的描述符集会在 beginFrame 时被释放
+ */
+class DescriptorSetCache
+{
+public:
+    /**
+     * @brief maxUnusedFrames 为描述符集在被释放前可以不被使用的帧数，不会小于 numberOfFrames
+     */
+    void create(const VulkanDevice& device, DescriptorPool& descriptorPool, uint32_t numberOfFrames, uint32_t maxUnusedFrames = 8);
+    void destroy();
+
+    void beginFrame();
+
+    VkDescriptorSet getDescriptorSet(VkDescriptorSetLayout descriptorLayout, const std::vector<DescriptorWrite>& writes);
+
+    /**
+     * @brief 释放所有引用了这个图片视图或缓冲区的描述符集，在销毁资源之前调用，
+     *        之后新建的资源即使句柄相同也不会命中旧的描述符集。调用时需要确保引用它们的命令已经执行完毕
+     */
+    void invalidate(VkImageView imageView);
+    void invalidate(VkBuffer buffer);
+
+    size_t getSetCount() const { return sets_.size(); }
+    uint32_t getHitCount() const { return hit_count_; }
+    uint32_t getMissCount() const { return miss_count_; }
+    size_t getTemplateCount() const { return templates_.size(); }
+
+private:
+    static uint64_t HashWrites(VkDescriptorSetLayout descriptorLayout, const std::vector<DescriptorWrite>& writes);
+    static bool SameWrites(const std::vector<DescriptorWrite>& lhs, const std::vector<DescriptorWrite>& rhs);
+
+    // 释放满足条件的描述符集，需要持有锁
+    template<typename Pred>
+    void freeSetsIf(Pred pred);
+
+    // 取得与布局和写入的绑定对应的更新模板，没有时创建，需要持有锁
+    VkDescriptorUpdateTemplate getUpdateTemplate(VkDescriptorSetLayout descriptorLayout, const std::vector<DescriptorWrite>& writes);
+
+private:
+    const VulkanDevice* device_ = nullptr;
+    DescriptorPool* descriptor_pool_ = nullptr;
+
+    // 保存完整的键，命中时比较，哈希冲突的两组绑定不会共用描述符集
+    struct Entry
+    {
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        std::vector<DescriptorWrite> writes;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        uint64_t last_used_frame = 0;
+    };
+    std::unordered_multimap<uint64_t, Entry> sets_;
+
+    // 更新模板只与写入的位置和类型有关，与绑定的资源无关；模板归描述符池所有
+    struct TemplateSlot
+    {
+        uint32_t binding;
+        uint32_t arrayElement;
+        VkDescriptorType type;
+
+        bool operator==(const TemplateSlot&) const = default;
+    };
+    struct TemplateEntry
+    {
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        std::vector<TemplateSlot> slots;
+        VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+    };
+    std::unordered_multimap<uint64_t, TemplateEntry> templates_;
+
+    uint64_t frame_index_{};
+    uint32_t max_unused_frames_{};
+
+    std::mutex mutex_{};
+    uint32_t hit_count_{};
+    uint32_t miss_count_{};
+};
+
+} // yu::vk
\ No newline at end of file
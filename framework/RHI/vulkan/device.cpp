@@ -9,6 +9,10 @@
 #include "error.hpp"
 #include "instance.hpp"
 #include "ext_raytracing.hpp"
+#include "ext_descriptor_indexing.hpp"
+#include "ext_timeline_semaphore.hpp"
+#include "ext_calibrated_timestamps.hpp"
+#include "ext_memory_budget.hpp"
 
 #ifdef USE_VMA
 #define VMA_IMPLEMENTATION
@@ -16,9 +20,44 @@
 #endif
 
 #include <logger.hpp>
+#include <common/common.hpp>
+#include <common/hash.hpp>
 
 namespace yu::vk {
 
+namespace {
+
+// 流水线缓存文件的头部，用于在加载时判断缓存是否属于当前的设备与驱动
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t data_hash;
+};
+
+constexpr uint32_t PipelineCacheMagic = 0x43505559;  // "YUPC"
+constexpr uint32_t PipelineCacheVersion = 1;
+
+PipelineCacheFileHeader MakePipelineCacheHeader(const VkPhysicalDeviceProperties& props)
+{
+    PipelineCacheFileHeader header{};
+    header.magic = PipelineCacheMagic;
+    header.version = PipelineCacheVersion;
+    header.vendor_id = props.vendorID;
+    header.device_id = props.deviceID;
+    header.driver_version = props.driverVersion;
+    std::memcpy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+    return header;
+}
+
+} // namespace
+
 VulkanDevice::~VulkanDevice()
 {
     destroy();
@@ -27,7 +66,8 @@ VulkanDevice::~VulkanDevice()
 void VulkanDevice::create(const VulkanInstance& instance)
 {
     properties_.init(instance.getBestDevice());
-    setEssentialExtensions();
+    // 没有 surface 时以无窗口模式创建设备，不需要交换链相关的扩展
+    setEssentialExtensions(instance.getHandle(), instance.getSurface() != VK_NULL_HANDLE);
 
     // 获取设备的队列信息
     auto queueCreateInfos = getDeviceQueueInfos(instance.getSurface());
@@ -70,6 +110,21 @@ void VulkanDevice::create(const VulkanInstance& instance)
         vkGetDeviceQueue(device_, compute_queue_index_, 0, &compute_queue_);
     }
 
+    if (graphics_queue_index_ == transfer_queue_index_) {
+        transfer_queue_ = graphics_queue_;
+    } else if (compute_queue_index_ == transfer_queue_index_) {
+        transfer_queue_ = compute_queue_;
+    } else {
+        vkGetDeviceQueue(device_, transfer_queue_index_, 0, &transfer_queue_);
+    }
+
+    // 创建流水线缓存，如果磁盘上有可用的缓存则用它初始化
+    createPipelineCache();
+
+    // 创建着色器模块缓存
+    shader_cache_ = std::make_unique<ShaderCache>();
+    shader_cache_->create(device_);
+
     // 创建命令池
     {
         auto cmdPoolInfo = commandPoolCreateInfo();
@@ -99,6 +154,11 @@ void VulkanDevice::destroy()
 
     destroyPipelineCache();
 
+    if (shader_cache_) {
+        shader_cache_->destroy();
+        shader_cache_.reset();
+    }
+
     if (command_pool_ != VK_NULL_HANDLE) {
         vkDestroyCommandPool(device_, command_pool_, nullptr);
         command_pool_ = VK_NULL_HANDLE;
@@ -110,13 +170,19 @@ void VulkanDevice::destroy()
     }
 }
 
-void VulkanDevice::setEssentialExtensions()
+void VulkanDevice::setEssentialExtensions(VkInstance instance, bool bPresent)
 {
     CheckFP16DeviceEXT(properties_);
-    CheckHDRDeviceEXT(properties_);
+    CheckDescriptorIndexingDeviceEXT(properties_);
+    CheckTimelineSemaphoreDeviceEXT(properties_);
+    CheckCalibratedTimestampsDeviceEXT(instance, properties_);
+    CheckMemoryBudgetDeviceEXT(properties_);
 //    CheckRTDeviceEXT(properties_);
 
-    properties_.addExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    if (bPresent) {
+        CheckHDRDeviceEXT(properties_);
+        properties_.addExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     properties_.addExtension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
 }
 
@@ -132,8 +198,11 @@ std::vector<VkDeviceQueueCreateInfo> VulkanDevice::getDeviceQueueInfos(VkSurface
             if (graphics_queue_index_ == UINT32_MAX)
                 graphics_queue_index_ = i;
 
-            VkBool32 supportsPresent;
-            vkGetPhysicalDeviceSurfaceSupportKHR(properties_.physical_device, i, surface, &supportsPresent);
+            // 无窗口时没有呈现操作，present 队列就是 graphics 队列
+            VkBool32 supportsPresent = VK_TRUE;
+            if (surface != VK_NULL_HANDLE) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(properties_.physical_device, i, surface, &supportsPresent);
+            }
             if (supportsPresent == VK_TRUE) {
                 graphics_queue_index_ = i;
                 present_queue_index_ = i;
@@ -188,28 +257,209 @@ std::vector<VkDeviceQueueCreateInfo> VulkanDevice::getDeviceQueueInfos(VkSurface
         queueCreateInfos.push_back(queue_info);
     }
 
+    // 创建传输队列，优先使用只支持传输的队列族（通常对应独立的 DMA 引擎），其次是不支持图形的队列族
+    for (uint32_t i = 0; i < properties_.queue_family_count; i++) {
+        auto flags = properties_.queue_family_properties[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            transfer_queue_index_ = i;
+            break;
+        }
+    }
+
+    if (transfer_queue_index_ == UINT32_MAX) {
+        for (uint32_t i = 0; i < properties_.queue_family_count; i++) {
+            auto flags = properties_.queue_family_properties[i].queueFlags;
+            if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                transfer_queue_index_ = i;
+                break;
+            }
+        }
+    }
+
+    if (transfer_queue_index_ == UINT32_MAX) {
+        transfer_queue_index_ = graphics_queue_index_;
+    } else if (transfer_queue_index_ != graphics_queue_index_ &&
+        transfer_queue_index_ != present_queue_index_ &&
+        transfer_queue_index_ != compute_queue_index_) {
+        auto queue_info = deviceQueueCreateInfo(transfer_queue_index_);
+        queue_info.pQueuePriorities = &defaultQueuePriority;
+
+        queueCreateInfos.push_back(queue_info);
+    }
+
     return queueCreateInfos;
 }
 
 void VulkanDevice::createPipelineCache()
 {
+    if (!pipeline_cache_file_) {
+        pipeline_cache_file_ = GetCacheFile("pipeline_cache.bin");
+    }
+
+    auto initialData = loadPipelineCacheData();
+
     VkPipelineCacheCreateInfo pipelineCache;
     pipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
     pipelineCache.pNext = nullptr;
-    pipelineCache.initialDataSize = 0;
-    pipelineCache.pInitialData = nullptr;
+    pipelineCache.initialDataSize = initialData.size();
+    pipelineCache.pInitialData = initialData.empty() ? nullptr : initialData.data();
     pipelineCache.flags = 0;
-    VK_CHECK(vkCreatePipelineCache(device_, &pipelineCache, nullptr, &pipeline_cache_));
+
+    // 驱动仍然可能拒绝通过了校验的数据，这种情况下退回到空的缓存
+    if (vkCreatePipelineCache(device_, &pipelineCache, nullptr, &pipeline_cache_) != VK_SUCCESS) {
+        LOG_WARN("The pipeline cache data is rejected by the driver, create an empty one.");
+
+        pipelineCache.initialDataSize = 0;
+        pipelineCache.pInitialData = nullptr;
+        VK_CHECK(vkCreatePipelineCache(device_, &pipelineCache, nullptr, &pipeline_cache_));
+    }
 }
 
 void VulkanDevice::destroyPipelineCache()
 {
     if (pipeline_cache_ != VK_NULL_HANDLE) {
+        savePipelineCache();
+
         vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
         pipeline_cache_ = VK_NULL_HANDLE;
     }
 }
 
+/**
+ * @brief 读取磁盘上的流水线缓存，只有文件头与当前设备的 UUID、驱动版本一致，并且数据校验通过时才返回数据
+ */
+std::vector<uint8_t> VulkanDevice::loadPipelineCacheData() const
+{
+    if (!pipeline_cache_file_ || pipeline_cache_file_->empty()) {
+        return {};
+    }
+
+    std::ifstream is{*pipeline_cache_file_, std::ios::binary | std::ios::in};
+    if (!is.is_open()) {
+        return {};
+    }
+
+    PipelineCacheFileHeader header{};
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!is) {
+        LOG_WARN("Pipeline cache file: {} is truncated, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+
+    const auto expected = MakePipelineCacheHeader(properties_.device_properties);
+    if (header.magic != expected.magic || header.version != expected.version) {
+        LOG_WARN("Pipeline cache file: {} has an unknown format, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+
+    if (header.vendor_id != expected.vendor_id ||
+        header.device_id != expected.device_id ||
+        header.driver_version != expected.driver_version ||
+        std::memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) != 0) {
+        LOG_INFO("Pipeline cache file: {} was created by another device or driver, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+
+    // 文件头中的大小来自磁盘，分配之前先与文件剩余的长度比较，避免损坏的文件造成巨大的分配或者读取不完整
+    const auto dataBegin = is.tellg();
+    is.seekg(0, std::ios::end);
+    const auto fileEnd = is.tellg();
+    if (dataBegin < 0 || fileEnd < dataBegin ||
+        static_cast<uint64_t>(fileEnd - dataBegin) != static_cast<uint64_t>(header.data_size)) {
+        LOG_WARN("Pipeline cache file: {} has a mismatched data size, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+    is.seekg(dataBegin);
+
+    std::vector<uint8_t> data(static_cast<size_t>(header.data_size));
+    is.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!is || is.gcount() != static_cast<std::streamsize>(data.size()) ||
+        HashBytes(data.data(), data.size()) != header.data_hash) {
+        LOG_WARN("Pipeline cache file: {} is corrupted, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+
+    // 再检查一次 vulkan 自身的缓存头，防止驱动拿到不属于自己的数据
+    VkPipelineCacheHeaderVersionOne vkHeader{};
+    if (data.size() < sizeof(vkHeader)) {
+        return {};
+    }
+    std::memcpy(&vkHeader, data.data(), sizeof(vkHeader));
+    if (vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        vkHeader.vendorID != expected.vendor_id ||
+        vkHeader.deviceID != expected.device_id ||
+        std::memcmp(vkHeader.pipelineCacheUUID, expected.uuid, VK_UUID_SIZE) != 0) {
+        LOG_WARN("Pipeline cache file: {} does not match the device, ignore it.", *pipeline_cache_file_);
+        return {};
+    }
+
+    LOG_INFO("Load pipeline cache from {} ({} bytes).", *pipeline_cache_file_, data.size());
+
+    return data;
+}
+
+/**
+ * @brief 将流水线缓存写到磁盘上。先写入临时文件，成功后再替换原文件，保证中途失败时不会留下损坏的缓存
+ */
+bool VulkanDevice::savePipelineCache() const
+{
+    if (pipeline_cache_ == VK_NULL_HANDLE || !pipeline_cache_file_ || pipeline_cache_file_->empty()) {
+        return false;
+    }
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> data(dataSize);
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &dataSize, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(dataSize);
+
+    auto header = MakePipelineCacheHeader(properties_.device_properties);
+    header.data_size = data.size();
+    header.data_hash = HashBytes(data.data(), data.size());
+
+    namespace fs = std::filesystem;
+    const fs::path cachePath{*pipeline_cache_file_};
+    const fs::path tempPath{*pipeline_cache_file_ + ".tmp"};
+
+    std::error_code ec;
+    if (cachePath.has_parent_path()) {
+        fs::create_directories(cachePath.parent_path(), ec);
+    }
+
+    {
+        std::ofstream os{tempPath, std::ios::binary | std::ios::out | std::ios::trunc};
+        if (!os.is_open()) {
+            LOG_WARN("Can not write pipeline cache file: {}.", tempPath.string());
+            return false;
+        }
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        os.flush();
+
+        if (!os) {
+            LOG_WARN("Failed to write pipeline cache file: {}.", tempPath.string());
+            os.close();
+            fs::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tempPath, cachePath, ec);
+    if (ec) {
+        LOG_WARN("Failed to replace pipeline cache file: {}, {}.", cachePath.string(), ec.message());
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
+
 /**
 * 在设备上创建一个缓冲区
 *
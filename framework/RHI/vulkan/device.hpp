@@ -12,11 +12,13 @@
 #include <vk_mem_alloc.h>
 #endif
 
+#include <optional>
 #include "device_properties.hpp"
 #include "vulkan_utils.hpp"
 #include <window.hpp>
 #include "instance.hpp"
 #include "buffer.hpp"
+#include "shader_cache.hpp"
 
 namespace yu::vk {
 
@@ -41,6 +43,10 @@ public:
     VkQueue getPresentQueue() const { return present_queue_; }
     uint32_t getPresentQueueIndex() const { return present_queue_index_; }
 
+    // 没有独立的传输队列族时与图形队列相同
+    VkQueue getTransferQueue() const { return transfer_queue_; }
+    uint32_t getTransferQueueIndex() const { return transfer_queue_index_; }
+
 #ifdef USE_VMA
     VmaAllocator getAllocator() const { return allocator_; }
 
@@ -58,6 +64,15 @@ public:
     // pipeline cache
     VkPipelineCache getPipelineCache() const { return pipeline_cache_; }
 
+    /**
+     * @brief 设置流水线缓存在磁盘上的位置，需要在 create 之前调用；默认位于 cache 目录下，设置为空则不进行持久化
+     */
+    void setPipelineCacheFile(std::string_view fileName) { pipeline_cache_file_ = fileName; }
+    bool savePipelineCache() const;
+
+    // 着色器模块缓存，在设备的整个生命周期内共享
+    ShaderCache* getShaderCache() const { return shader_cache_.get(); }
+
     VkResult createBuffer(VkBufferUsageFlags usageFlags,
                           VkMemoryPropertyFlags memoryPropertyFlags,
                           VkDeviceSize size,
@@ -78,11 +93,12 @@ public:
     void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
 
 private:
-    void setEssentialExtensions();
+    void setEssentialExtensions(VkInstance instance, bool bPresent);
     std::vector<VkDeviceQueueCreateInfo> getDeviceQueueInfos(VkSurfaceKHR surface);
 
     void createPipelineCache();
     void destroyPipelineCache();
+    std::vector<uint8_t> loadPipelineCacheData() const;
 
 private:
     DeviceProperties properties_;
@@ -98,7 +114,13 @@ private:
     VkQueue present_queue_{};
     uint32_t present_queue_index_{UINT32_MAX};
 
+    VkQueue transfer_queue_{};
+    uint32_t transfer_queue_index_{UINT32_MAX};
+
     VkPipelineCache pipeline_cache_{};
+    std::optional<std::string> pipeline_cache_file_;
+
+    std::unique_ptr<ShaderCache> shader_cache_;
 
     VkCommandPool command_pool_{};
 
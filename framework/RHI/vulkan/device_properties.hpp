@@ -29,6 +29,10 @@ struct DeviceProperties : public Properties
     bool using_fp16 = false;
     bool support_rt10 = false;
     bool support_rt11 = false;
+    bool support_descriptor_indexing = false;
+    bool support_timeline_semaphore = false;
+    bool support_calibrated_timestamps = false;
+    bool support_memory_budget = false;
 };
 
 } // namespace yu::vk
@@ -3,6 +3,7 @@
 //
 
 #include "dynamic_buffer.hpp"
+#include "descriptor_set_cache.hpp"
 #include "error.hpp"
 #include <San/utils/math_utils.hpp>
 #include <common/math_utils.hpp>
@@ -10,13 +11,31 @@
 
 namespace yu::vk {
 
-void DynamicBuffer::create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, std::string_view name)
+void DynamicBuffer::create(const VulkanDevice& device,
+                           uint32_t numberOfFrames,
+                           uint32_t totalSize,
+                           std::string_view name,
+                           bool bAllowGrow)
 {
     device_ = &device;
+    allow_grow_ = bAllowGrow;
+    name_ = name;
+
+    frame_index_ = 0;
+    overflow_buffers_ = std::vector<std::vector<OverflowBuffer>>(numberOfFrames);
+    resetUsageStats();
 
     total_size_ = static_cast<uint64_t>(AlignUp(totalSize, 256u));
 
+    // 索引数据也从这里分配，对齐至少为 16 字节
+    auto minAlignment = device_->getProperties().device_properties.limits.minUniformBufferOffsetAlignment;
+    alignment_ = std::max<uint32_t>(static_cast<uint32_t>(minAlignment), 16u);
+
     mem_.create(numberOfFrames, static_cast<uint32_t>(total_size_));
+    for (auto& chunk : chunks_) {
+        chunk.state = 0;
+        chunk.used = 0;
+    }
 
     // 创建一个可用于处理 uniform、索引、顶点数据的缓冲区
 #ifdef USE_VMA
@@ -41,6 +60,20 @@ void DynamicBuffer::create(const VulkanDevice& device, uint32_t numberOfFrames,
 
 void DynamicBuffer::destroy()
 {
+    LOG_INFO("Dynamic buffer '{}': {} bytes, peak per frame {} bytes ({} bytes reserved), peak in flight {} bytes.",
+             name_, total_size_, frame_high_water_mark_, frame_reserved_high_water_mark_, mem_.getInFlightHighWaterMark());
+
+    for (auto& overflows : overflow_buffers_) {
+        for (auto& overflow : overflows) {
+            destroyOverflowBuffer(overflow);
+        }
+    }
+    overflow_buffers_.clear();
+
+    if (descriptor_set_cache_ != nullptr) {
+        descriptor_set_cache_->invalidate(buffer_);
+    }
+
 #ifdef USE_VMA
     auto allocator = const_cast<VmaAllocator>(device_->getAllocator());
     vmaUnmapMemory(allocator, buffer_allocation_);
@@ -62,13 +95,19 @@ void DynamicBuffer::destroy()
 
 bool DynamicBuffer::allocConstantBuffer(uint32_t size, void** data, VkDescriptorBufferInfo& descOut)
 {
-    size = AlignUp(size, 256u);
+    size = AlignUp(size, alignment_);
 
     // 获取分配内存的起始偏移
     uint32_t offset;
-    if (!mem_.alloc(size, &offset)) {
-        LOG_FATAL("Out of memory of 'Dynamic Buffer', please increase the buffer size.");
-        return false;
+    if (!allocFromChunk(size, &offset)) {
+        ring_miss_count_.fetch_add(1, std::memory_order_relaxed);
+
+        if (!allow_grow_) {
+            LOG_FATAL("Out of memory of 'Dynamic Buffer', please increase the buffer size.");
+            return false;
+        }
+
+        return allocFromOverflow(size, data, descOut);
     }
 
     // 让 data 指向分配内存的起始位置
@@ -81,6 +120,29 @@ bool DynamicBuffer::allocConstantBuffer(uint32_t size, void** data, VkDescriptor
     return true;
 }
 
+bool DynamicBuffer::allocConstantBuffer(uint32_t size, void** data, uint32_t& dynamicOffset)
+{
+    size = AlignUp(size, alignment_);
+
+    // 描述符集绑定的是主缓冲区，动态偏移只能来自环形缓冲区
+    uint32_t offset;
+    if (!allocFromChunk(size, &offset)) {
+        ring_miss_count_.fetch_add(1, std::memory_order_relaxed);
+
+        if (!allow_grow_) {
+            LOG_FATAL("Out of memory of 'Dynamic Buffer', please increase the buffer size.");
+        } else {
+            LOG_ERROR("Out of memory of 'Dynamic Buffer' for dynamic offsets, please increase the buffer size.");
+        }
+        return false;
+    }
+
+    *data = static_cast<void*>(data_ + offset);
+    dynamicOffset = offset;
+
+    return true;
+}
+
 VkDescriptorBufferInfo DynamicBuffer::allocConstantBuffer(uint32_t size, void* data)
 {
     void* temp = nullptr;
@@ -92,20 +154,236 @@ VkDescriptorBufferInfo DynamicBuffer::allocConstantBuffer(uint32_t size, void* d
     return descBufferInfo;
 }
 
+bool DynamicBuffer::allocFromChunk(uint32_t size, uint32_t* offset)
+{
+    auto& chunk = chunks_[ThreadSlot()];
+
+    // 较大的分配直接从环形缓冲区取得，避免浪费块中剩余的空间
+    if (size > ChunkSize / 4) {
+        if (!allocFromRing(size, offset)) {
+            return false;
+        }
+        chunk.used.fetch_add(size, std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t state = chunk.state.load(std::memory_order_relaxed);
+    while (true) {
+        auto end = static_cast<uint32_t>(state >> 32);
+        auto begin = AlignUp(static_cast<uint32_t>(state), alignment_);
+
+        if (begin + size <= end) {
+            if (chunk.state.compare_exchange_weak(state,
+                                                  (static_cast<uint64_t>(end) << 32) | (begin + size),
+                                                  std::memory_order_relaxed)) {
+                *offset = begin;
+                chunk.used.fetch_add(size, std::memory_order_relaxed);
+                return true;
+            }
+            continue;
+        }
+
+        // 当前块的空间不足，取得一个新块
+        uint32_t chunkBegin;
+        if (!allocFromRing(ChunkSize, &chunkBegin)) {
+            return false;
+        }
+
+        uint64_t fresh = (static_cast<uint64_t>(chunkBegin + ChunkSize) << 32) | (chunkBegin + size);
+        if (chunk.state.compare_exchange_strong(state, fresh, std::memory_order_relaxed)) {
+            *offset = chunkBegin;
+            chunk.used.fetch_add(size, std::memory_order_relaxed);
+            return true;
+        }
+
+        // 块的状态在读取之后被改变，刚取得的块在这一帧内不再使用，在新块中重试
+    }
+}
+
+bool DynamicBuffer::allocFromRing(uint32_t size, uint32_t* offset)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    return mem_.alloc(size, offset);
+}
+
+bool DynamicBuffer::allocFromOverflow(uint32_t size, void** data, VkDescriptorBufferInfo& descOut)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+
+    auto& overflows = overflow_buffers_[frame_index_];
+
+    OverflowBuffer* target = nullptr;
+    for (auto& overflow : overflows) {
+        if (AlignUp(overflow.used, alignment_) + size <= overflow.size) {
+            target = &overflow;
+            break;
+        }
+    }
+
+    // 这一帧已有的追加缓冲区都放不下，再追加一个，大小为环形缓冲区的一半
+    if (target == nullptr) {
+        OverflowBuffer overflow{};
+        if (!createOverflowBuffer(AlignUp(std::max(total_size_ / 2, size), 256u), overflow)) {
+            LOG_ERROR("Failed to grow 'Dynamic Buffer' {}.", name_);
+            return false;
+        }
+
+        LOG_WARN("Dynamic buffer '{}' is full, chained an extra buffer of {} bytes.", name_, overflow.size);
+
+        overflows.push_back(overflow);
+        target = &overflows.back();
+    }
+
+    auto begin = AlignUp(target->used, alignment_);
+    overflow_used_in_frame_ += begin + size - target->used;
+    target->used = begin + size;
+
+    *data = static_cast<void*>(target->data + begin);
+
+    descOut.buffer = target->buffer;
+    descOut.offset = begin;
+    descOut.range = size;
+
+    return true;
+}
+
+bool DynamicBuffer::createOverflowBuffer(uint32_t size, OverflowBuffer& overflow)
+{
+    overflow.size = size;
+    overflow.used = 0;
+    overflow.idleRounds = 0;
+
+#ifdef USE_VMA
+    auto result = device_->createBufferVMA(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                           VMA_MEMORY_USAGE_CPU_TO_GPU,
+                                           size,
+                                           &overflow.buffer,
+                                           &overflow.allocation,
+                                           true,
+                                           (void**) &overflow.data,
+                                           name_ + " (Overflow)");
+#else
+    auto result = device_->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                        size,
+                                        &overflow.buffer,
+                                        &overflow.memory,
+                                        false,
+                                        (void**) &overflow.data);
+#endif
+
+    return result == VK_SUCCESS;
+}
+
+void DynamicBuffer::destroyOverflowBuffer(OverflowBuffer& overflow)
+{
+    if (descriptor_set_cache_ != nullptr) {
+        descriptor_set_cache_->invalidate(overflow.buffer);
+    }
+
+#ifdef USE_VMA
+    auto allocator = const_cast<VmaAllocator>(device_->getAllocator());
+    vmaUnmapMemory(allocator, overflow.allocation);
+    vmaDestroyBuffer(allocator, overflow.buffer, overflow.allocation);
+#else
+    vkUnmapMemory(device_->getHandle(), overflow.memory);
+    vkFreeMemory(device_->getHandle(), overflow.memory, nullptr);
+    vkDestroyBuffer(device_->getHandle(), overflow.buffer, nullptr);
+#endif
+
+    overflow = {};
+}
+
+void DynamicBuffer::recycleOverflowBuffers(std::vector<OverflowBuffer>& overflows)
+{
+    for (auto& overflow : overflows) {
+        overflow.idleRounds = overflow.used == 0 ? overflow.idleRounds + 1 : 0;
+        overflow.used = 0;
+    }
+
+    // 使用量长时间回落到环形缓冲区以内时，释放追加的缓冲区
+    std::erase_if(overflows, [this](OverflowBuffer& overflow) {
+        if (overflow.idleRounds < ShrinkAfterIdleRounds) {
+            return false;
+        }
+
+        LOG_INFO("Dynamic buffer '{}' released an extra buffer of {} bytes.", name_, overflow.size);
+        destroyOverflowBuffer(overflow);
+        return true;
+    });
+}
+
 void DynamicBuffer::setDescriptorSet(int bindIndex, uint32_t size, VkDescriptorSet descriptorSet)
+{
+    auto descBufferInfo = getDescriptorBufferInfo(size);
+
+    auto writeDesc = writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, bindIndex, &descBufferInfo);
+
+    vkUpdateDescriptorSets(device_->getHandle(), 1, &writeDesc, 0, nullptr);
+}
+
+VkDescriptorBufferInfo DynamicBuffer::getDescriptorBufferInfo(uint32_t size) const
 {
     VkDescriptorBufferInfo descBufferInfo{};
     descBufferInfo.buffer = buffer_;
     descBufferInfo.offset = 0;
     descBufferInfo.range = size;
 
-    auto writeDesc = writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, bindIndex, &descBufferInfo);
-
-    vkUpdateDescriptorSets(device_->getHandle(), 1, &writeDesc, 0, nullptr);
+    return descBufferInfo;
 }
 
 void DynamicBuffer::beginFrame()
 {
+    // 上一帧的块在新的一帧中不再使用，它们的空间随着环形缓冲区一起回收
+    uint32_t allocatedInFrame = 0;
+    for (auto& chunk : chunks_) {
+        chunk.state.store(0, std::memory_order_relaxed);
+        allocatedInFrame += chunk.used.exchange(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+
+    // 环形缓冲区的占用按整块计算，块中没有用到的部分只计入占用的峰值
+    frame_high_water_mark_ = std::max(frame_high_water_mark_, allocatedInFrame + overflow_used_in_frame_);
+    frame_reserved_high_water_mark_ = std::max(frame_reserved_high_water_mark_, mem_.getFrameUsage() + overflow_used_in_frame_);
+    overflow_used_in_frame_ = 0;
+
     mem_.beginFrame();
+
+    // 新的一帧使用的追加缓冲区与环形缓冲区中被回收的部分一样，已经不再被 GPU 使用
+    frame_index_ = (frame_index_ + 1) % static_cast<uint32_t>(overflow_buffers_.size());
+    recycleOverflowBuffers(overflow_buffers_[frame_index_]);
+}
+
+DynamicBuffer::UsageStats DynamicBuffer::getUsageStats() const
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+
+    UsageStats stats{};
+    stats.ringSize = mem_.getSize();
+    stats.ringFrameHighWaterMark = mem_.getFrameHighWaterMark();
+    stats.ringInFlightHighWaterMark = mem_.getInFlightHighWaterMark();
+    stats.frameHighWaterMark = frame_high_water_mark_;
+    stats.frameReservedHighWaterMark = frame_reserved_high_water_mark_;
+    stats.ringMissCount = ring_miss_count_.load(std::memory_order_relaxed);
+
+    for (const auto& overflows : overflow_buffers_) {
+        for (const auto& overflow : overflows) {
+            stats.overflowSize += overflow.size;
+            stats.overflowBufferCount += 1;
+        }
+    }
+
+    return stats;
+}
+
+void DynamicBuffer::resetUsageStats()
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+
+    mem_.resetHighWaterMark();
+    frame_high_water_mark_ = 0;
+    frame_reserved_high_water_mark_ = 0;
+    ring_miss_count_.store(0, std::memory_order_relaxed);
 }
 } // yu::vk
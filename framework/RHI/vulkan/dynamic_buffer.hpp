@@ -4,33 +4,132 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
 #include <common/buffer_ring.hpp>
+#include <common/thread_slot.hpp>
 #include "device.hpp"
 namespace yu::vk {
 
+class DescriptorSetCache;
+
 /**
  * @brief 一个动态缓冲区的抽象，通过从一块巨大的内存中分配内存，使用环形缓冲区来实现；其中的内容会在每一帧更新。
+ *        每个线程从环形缓冲区取得一整块，之后在块内用原子操作分配，多个线程可以同时分配。
+ *        允许增长时，环形缓冲区用完后从追加的缓冲区中分配，追加的缓冲区长时间不再使用时会被释放
  */
 class DynamicBuffer
 {
 public:
-    void create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, std::string_view name);
+    void create(const VulkanDevice& device,
+                uint32_t numberOfFrames,
+                uint32_t totalSize,
+                std::string_view name,
+                bool bAllowGrow = false);
     void destroy();
 
+    // 从追加的缓冲区中分配时 descOut.buffer 不是主缓冲区，描述符集需要按照 descOut.buffer 取得，例如通过 DescriptorSetCache
     bool allocConstantBuffer(uint32_t size, void** data, VkDescriptorBufferInfo& descOut);
     VkDescriptorBufferInfo allocConstantBuffer(uint32_t size, void* data);
+    // 只给出分配的偏移，作为动态 uniform 的偏移传给 VulkanPipeline::drawIndexedDynamic；偏移总是相对于主缓冲区，不会从追加的缓冲区中分配
+    bool allocConstantBuffer(uint32_t size, void** data, uint32_t& dynamicOffset);
 
     void setDescriptorSet(int bindIndex, uint32_t size, VkDescriptorSet descriptorSet);
 
+    // 设置后，释放追加的缓冲区和销毁时会先清理描述符集缓存中引用它们的描述符集
+    void setDescriptorSetCache(DescriptorSetCache* pDescriptorSetCache) { descriptor_set_cache_ = pDescriptorSetCache; }
+
+    // 动态 uniform 绑定的基础信息，偏移在绑定描述符集时给出，可以用作 DescriptorSetCache 的键
+    VkDescriptorBufferInfo getDescriptorBufferInfo(uint32_t size) const;
+
+    // 需要在没有其他线程分配时调用
     void beginFrame();
 
+    uint32_t getAlignment() const { return alignment_; }
+
+    struct UsageStats
+    {
+        uint32_t ringSize = 0;
+        // 环形缓冲区中单帧和所有在途帧占用的峰值
+        uint32_t ringFrameHighWaterMark = 0;
+        uint32_t ringInFlightHighWaterMark = 0;
+        // 单帧实际分配的字节数的峰值，包含追加缓冲区中的分配
+        uint32_t frameHighWaterMark = 0;
+        // 单帧占用的峰值，环形缓冲区中的块按整块计算，包含块中没有用到的部分
+        uint32_t frameReservedHighWaterMark = 0;
+        // 环形缓冲区空间不足的分配次数
+        uint32_t ringMissCount = 0;
+        uint32_t overflowSize = 0;
+        uint32_t overflowBufferCount = 0;
+    };
+
+    UsageStats getUsageStats() const;
+    void resetUsageStats();
+
+private:
+    bool allocFromChunk(uint32_t size, uint32_t* offset);
+    bool allocFromRing(uint32_t size, uint32_t* offset);
+
+    struct OverflowBuffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+#ifdef USE_VMA
+        VmaAllocation allocation = VK_NULL_HANDLE;
+#else
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+#endif
+        char* data = nullptr;
+        uint32_t size = 0;
+        uint32_t used = 0;
+        // 连续没有被使用的轮数
+        uint32_t idleRounds = 0;
+    };
+
+    bool allocFromOverflow(uint32_t size, void** data, VkDescriptorBufferInfo& descOut);
+    bool createOverflowBuffer(uint32_t size, OverflowBuffer& overflow);
+    void destroyOverflowBuffer(OverflowBuffer& overflow);
+    void recycleOverflowBuffers(std::vector<OverflowBuffer>& overflows);
+
 private:
     const VulkanDevice* device_ = nullptr;
+    DescriptorSetCache* descriptor_set_cache_ = nullptr;
 
     BufferRing mem_;
     uint32_t total_size_{};
     char* data_ = nullptr;
 
+    // 分配的对齐，来自设备的 minUniformBufferOffsetAlignment
+    uint32_t alignment_ = 256;
+
+    // 每个线程槽位当前使用的块。槽位由线程独占，块内的原子操作没有竞争，只是保留为无锁的写法
+    static constexpr uint32_t ChunkSize = 64 * 1024;
+    struct alignas(64) ThreadChunk
+    {
+        // 高 32 位是块的结束位置，低 32 位是块内下一次分配的位置
+        std::atomic<uint64_t> state{0};
+        // 这个槽位在当前帧实际分配的字节数，包括直接从环形缓冲区取得的较大分配
+        std::atomic<uint32_t> used{0};
+    };
+    std::array<ThreadChunk, MaxThreadSlots> chunks_{};
+
+    // 环形缓冲区本身不是线程安全的，只在取得新块时加锁
+    mutable std::mutex ring_mutex_{};
+
+    // 追加的缓冲区按照帧划分，与环形缓冲区一样，轮到同一帧时上一次的分配已经不再被 GPU 使用
+    bool allow_grow_ = false;
+    std::string name_{};
+    uint32_t frame_index_ = 0;
+    std::vector<std::vector<OverflowBuffer>> overflow_buffers_{};
+    // 连续这么多轮没有被使用的追加缓冲区会被释放
+    static constexpr uint32_t ShrinkAfterIdleRounds = 60;
+
+    uint32_t overflow_used_in_frame_ = 0;
+    uint32_t frame_high_water_mark_ = 0;
+    uint32_t frame_reserved_high_water_mark_ = 0;
+    std::atomic<uint32_t> ring_miss_count_{0};
+
     VkBuffer buffer_{};
 
 #ifdef USE_VMA
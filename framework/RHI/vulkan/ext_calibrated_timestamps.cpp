@@ -0,0 +1,93 @@
+﻿#include <vector>
+#include <logger.hpp>
+#include "ext_calibrated_timestamps.hpp"
+
+namespace yu::vk {
+
+// steady_clock 在 Windows 上基于 QueryPerformanceCounter，在其他平台上基于 CLOCK_MONOTONIC
+#ifdef _WIN32
+static constexpr VkTimeDomainEXT HostTimeDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+static constexpr VkTimeDomainEXT HostTimeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+// 设备是否同时支持 GPU 和 CPU 两个时间域，请求不支持的时间域是无效的用法
+static bool SupportsTimeDomains(VkInstance instance, VkPhysicalDevice physicalDevice)
+{
+    auto getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    if (getTimeDomains == nullptr) {
+        return false;
+    }
+
+    uint32_t count = 0;
+    if (getTimeDomains(physicalDevice, &count, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+    std::vector<VkTimeDomainEXT> domains(count);
+    if (getTimeDomains(physicalDevice, &count, domains.data()) != VK_SUCCESS) {
+        return false;
+    }
+
+    bool hasDevice = false;
+    bool hasHost = false;
+    for (auto domain : domains) {
+        hasDevice |= domain == VK_TIME_DOMAIN_DEVICE_EXT;
+        hasHost |= domain == HostTimeDomain;
+    }
+
+    return hasDevice && hasHost;
+}
+
+void CheckCalibratedTimestampsDeviceEXT(VkInstance instance, DeviceProperties& dp)
+{
+    dp.support_calibrated_timestamps = dp.IsExtensionExist(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)
+        && SupportsTimeDomains(instance, dp.physical_device)
+        && dp.addExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    if (!dp.support_calibrated_timestamps) {
+        LOG_WARN("Calibrated timestamps are not supported, GPU events in traces are aligned to the CPU approximately.");
+    }
+}
+
+PFN_vkGetCalibratedTimestampsEXT LoadCalibratedTimestampsEXT(VkDevice device)
+{
+    return (PFN_vkGetCalibratedTimestampsEXT) vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+}
+
+bool GetCalibratedTimestamps(PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps,
+                             VkDevice device,
+                             uint64_t& gpuTimestamp,
+                             uint64_t& cpuNanoseconds)
+{
+    if (getCalibratedTimestamps == nullptr) {
+        return false;
+    }
+
+    VkCalibratedTimestampInfoEXT infos[2] = {};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = HostTimeDomain;
+
+    uint64_t timestamps[2] = {};
+    uint64_t maxDeviation = 0;
+    if (getCalibratedTimestamps(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS) {
+        return false;
+    }
+
+    gpuTimestamp = timestamps[0];
+
+#ifdef _WIN32
+    // 与 steady_clock 相同的换算方式，避免乘法溢出
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    const auto freq = static_cast<uint64_t>(frequency.QuadPart);
+    cpuNanoseconds = (timestamps[1] / freq) * 1000000000ull + (timestamps[1] % freq) * 1000000000ull / freq;
+#else
+    cpuNanoseconds = timestamps[1];
+#endif
+
+    return true;
+}
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include "device_properties.hpp"
+namespace yu::vk {
+
+// 扩展存在、并且设备同时支持 GPU 和 CPU 时钟的时间域时才启用
+void CheckCalibratedTimestampsDeviceEXT(VkInstance instance, DeviceProperties& dp);
+
+// 函数指针属于创建它的设备，设备重新创建后需要重新加载
+PFN_vkGetCalibratedTimestampsEXT LoadCalibratedTimestampsEXT(VkDevice device);
+
+/**
+ * @brief 取得同一时刻的 GPU 时间戳和 CPU 时间，CPU 时间以纳秒为单位，与 std::chrono::steady_clock 使用同一个时钟。
+ *        getCalibratedTimestamps 是从 device 加载的函数指针，失败时返回 false
+ */
+bool GetCalibratedTimestamps(PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps,
+                             VkDevice device,
+                             uint64_t& gpuTimestamp,
+                             uint64_t& cpuNanoseconds);
+
+} // yu::vk
\ No newline at end of file
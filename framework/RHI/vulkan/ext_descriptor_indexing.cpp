@@ -0,0 +1,44 @@
+﻿#include <logger.hpp>
+#include "ext_descriptor_indexing.hpp"
+
+namespace yu::vk {
+
+static VkPhysicalDeviceDescriptorIndexingFeatures DescriptorIndexingFeatures = {};
+
+void CheckDescriptorIndexingDeviceEXT(DeviceProperties& dp)
+{
+    // 描述符索引在 Vulkan 1.2 中已经是核心功能，不需要启用扩展，只查询需要的特性
+    DescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    DescriptorIndexingFeatures.pNext = nullptr;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &DescriptorIndexingFeatures;
+
+    vkGetPhysicalDeviceFeatures2(dp.physical_device, &features);
+
+    bool bSupported = DescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+        DescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+        DescriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+        DescriptorIndexingFeatures.descriptorBindingPartiallyBound &&
+        DescriptorIndexingFeatures.runtimeDescriptorArray;
+
+    if (bSupported) {
+        // 只启用无绑定纹理表需要的特性
+        DescriptorIndexingFeatures = {};
+        DescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        DescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        DescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        DescriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        DescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        DescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        DescriptorIndexingFeatures.pNext = dp.pNext;
+
+        dp.pNext = &DescriptorIndexingFeatures;
+    } else {
+        LOG_WARN("Descriptor indexing is not supported, bindless textures are disabled.");
+    }
+
+    dp.support_descriptor_indexing = bSupported;
+}
+
+} // yu::vk
\ No newline at end of file
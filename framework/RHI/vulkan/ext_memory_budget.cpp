@@ -0,0 +1,40 @@
+﻿#include <logger.hpp>
+#include "ext_memory_budget.hpp"
+
+namespace yu::vk {
+
+void CheckMemoryBudgetDeviceEXT(DeviceProperties& dp)
+{
+    dp.support_memory_budget = dp.addExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (!dp.support_memory_budget) {
+        LOG_WARN("Memory budget is not supported, memory usage of heaps can not be queried.");
+    }
+}
+
+std::vector<MemoryHeapUsage> GetMemoryHeapUsage(const DeviceProperties& dp)
+{
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = dp.support_memory_budget ? &budgetProperties : nullptr;
+
+    vkGetPhysicalDeviceMemoryProperties2(dp.physical_device, &memoryProperties);
+
+    const auto& properties = memoryProperties.memoryProperties;
+    std::vector<MemoryHeapUsage> heaps(properties.memoryHeapCount);
+    for (uint32_t i = 0; i < properties.memoryHeapCount; ++i) {
+        heaps[i].size = properties.memoryHeaps[i].size;
+        heaps[i].deviceLocal = (properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+        if (dp.support_memory_budget) {
+            heaps[i].usage = budgetProperties.heapUsage[i];
+            heaps[i].budget = budgetProperties.heapBudget[i];
+        }
+    }
+
+    return heaps;
+}
+
+} // yu::vk
\ No newline at end of file
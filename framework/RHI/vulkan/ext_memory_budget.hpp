@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include "device_properties.hpp"
+namespace yu::vk {
+
+void CheckMemoryBudgetDeviceEXT(DeviceProperties& dp);
+
+struct MemoryHeapUsage
+{
+    VkDeviceSize size = 0;
+    // 本进程在这个堆上的用量，以及驱动估计的可用预算
+    VkDeviceSize usage = 0;
+    VkDeviceSize budget = 0;
+    bool deviceLocal = false;
+};
+
+/**
+ * @brief 查询每个内存堆的用量。设备没有启用 VK_EXT_memory_budget 时只有堆的大小，usage 和 budget 为 0
+ */
+std::vector<MemoryHeapUsage> GetMemoryHeapUsage(const DeviceProperties& dp);
+
+} // yu::vk
\ No newline at end of file
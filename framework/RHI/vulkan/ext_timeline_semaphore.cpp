@@ -0,0 +1,31 @@
+﻿#include <logger.hpp>
+#include "ext_timeline_semaphore.hpp"
+
+namespace yu::vk {
+
+static VkPhysicalDeviceTimelineSemaphoreFeatures TimelineSemaphoreFeatures = {};
+
+void CheckTimelineSemaphoreDeviceEXT(DeviceProperties& dp)
+{
+    // 时间线信号量在 Vulkan 1.2 中已经是核心功能，只需要查询并启用特性
+    TimelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    TimelineSemaphoreFeatures.pNext = nullptr;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &TimelineSemaphoreFeatures;
+
+    vkGetPhysicalDeviceFeatures2(dp.physical_device, &features);
+
+    bool bSupported = TimelineSemaphoreFeatures.timelineSemaphore;
+
+    if (bSupported) {
+        TimelineSemaphoreFeatures.pNext = dp.pNext;
+        dp.pNext = &TimelineSemaphoreFeatures;
+    } else {
+        LOG_WARN("Timeline semaphore is not supported, asynchronous uploads fall back to blocking flushes.");
+    }
+
+    dp.support_timeline_semaphore = bSupported;
+}
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,8 @@
+﻿#pragma once
+
+#include "device_properties.hpp"
+namespace yu::vk {
+
+void CheckTimelineSemaphoreDeviceEXT(DeviceProperties& dp);
+
+} // yu::vk
\ No newline at end of file
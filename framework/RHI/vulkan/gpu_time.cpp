@@ -2,48 +2,242 @@
 // Created by 秋鱼 on 2022/7/27.
 //
 
+#include <cmath>
 #include "gpu_time.hpp"
 #include "error.hpp"
 #include "initializers.hpp"
 
 namespace yu::vk {
 
-void GPUTimeStamp::create(const VulkanDevice& device, uint32_t numberOfBackBuffers)
+void GPUTimeStamp::create(const VulkanDevice& device, uint32_t numberOfBackBuffers, uint32_t statsWindow)
 {
     device_ = &device;
     backBuffer_count_ = numberOfBackBuffers;
+    stats_window_ = std::max(statsWindow, 1u);
 
-    auto createInfo = VkQueryPoolCreateInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
-    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-    createInfo.queryCount = MaxQueryCountPerFrame * numberOfBackBuffers;
+    // 设备创建时启用了所有支持的特性
+    support_statistics_ = device.getProperties().features.pipelineStatisticsQuery;
+    precise_occlusion_ = device.getProperties().features.occlusionQueryPrecise;
 
-    VK_CHECK(vkCreateQueryPool(device.getHandle(), &createInfo, nullptr, &query_pool_));
+    frames_ = std::vector<FrameQueries>(numberOfBackBuffers);
+    for (auto& frame : frames_) {
+        createQueryPool(frame.timeStamps, VK_QUERY_TYPE_TIMESTAMP, InitialQueryCountPerFrame);
+        createQueryPool(frame.occlusion, VK_QUERY_TYPE_OCCLUSION, InitialScopeQueryCountPerFrame);
+        if (support_statistics_) {
+            createQueryPool(frame.statistics, VK_QUERY_TYPE_PIPELINE_STATISTICS, InitialScopeQueryCountPerFrame);
+        }
+    }
 }
 
 void GPUTimeStamp::destroy()
 {
-    vkDestroyQueryPool(device_->getHandle(), query_pool_, nullptr);
+    for (auto& frame : frames_) {
+        for (auto* querySet : {&frame.timeStamps, &frame.statistics, &frame.occlusion}) {
+            if (querySet->queryPool != VK_NULL_HANDLE) {
+                vkDestroyQueryPool(device_->getHandle(), querySet->queryPool, nullptr);
+            }
+        }
+    }
+    frames_.clear();
+    open_scopes_.clear();
+
+    resetScopeStats();
+}
+
+void GPUTimeStamp::createQueryPool(QuerySet& querySet, VkQueryType type, uint32_t capacity)
+{
+    if (querySet.queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device_->getHandle(), querySet.queryPool, nullptr);
+    }
+
+    auto createInfo = VkQueryPoolCreateInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    createInfo.queryType = type;
+    createInfo.queryCount = capacity;
+    if (type == VK_QUERY_TYPE_PIPELINE_STATISTICS) {
+        createInfo.pipelineStatistics = StatisticsFlags;
+    }
+
+    VK_CHECK(vkCreateQueryPool(device_->getHandle(), &createInfo, nullptr, &querySet.queryPool));
+    querySet.capacity = capacity;
+}
+
+void GPUTimeStamp::resetQuerySet(VkCommandBuffer cmdBuffer, QuerySet& querySet, VkQueryType type)
+{
+    if (querySet.queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // 上一次使用这个查询池的帧已经完成，可以换成更大的查询池
+    if (querySet.overflowed) {
+        LOG_INFO("GPU queries exceed {} per frame, grow the query pool.", querySet.capacity);
+        createQueryPool(querySet, type, querySet.capacity * 2);
+    }
+
+    // 查询之后重置 query pool
+    vkCmdResetQueryPool(cmdBuffer, querySet.queryPool, 0, querySet.capacity);
+
+    querySet.count = 0;
+    querySet.overflowed = false;
+}
+
+bool GPUTimeStamp::allocQuery(QuerySet& querySet, uint32_t& query)
+{
+    if (querySet.queryPool == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    if (querySet.count >= querySet.capacity) {
+        querySet.overflowed = true;
+        return false;
+    }
+
+    query = querySet.count++;
+    return true;
+}
+
+bool GPUTimeStamp::writeTimeStamp(VkCommandBuffer cmdBuffer, VkPipelineStageFlagBits stage, uint32_t& query)
+{
+    auto& timeStamps = frames_[frame_].timeStamps;
+    if (!allocQuery(timeStamps, query)) {
+        return false;
+    }
+
+    vkCmdWriteTimestamp(cmdBuffer, stage, timeStamps.queryPool, query);
+
+    return true;
 }
 
 void GPUTimeStamp::getTimeStamp(VkCommandBuffer cmdBuffer, std::string_view label)
 {
-    auto measurementCount = static_cast<uint32_t>(labels_[frame_].size());
-    auto offset = frame_ * MaxQueryCountPerFrame + measurementCount;
-    
-    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool_, offset);
-    
-    labels_[frame_].emplace_back(label.data());
+    uint32_t query;
+    if (writeTimeStamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query)) {
+        frames_[frame_].labels.emplace_back(label, query);
+    }
 }
 
 void GPUTimeStamp::setCpuTimeStamp(TimeStamp ts)
 {
-    cpu_time_stamps_[frame_].push_back(std::move(ts));
+    if (trace_recorder_ != nullptr) {
+        trace_recorder_->addCpuCounter(ts.label, ts.microseconds);
+    }
+
+    frames_[frame_].cpuTimeStamps.push_back(std::move(ts));
+}
+
+void GPUTimeStamp::beginScope(VkCommandBuffer cmdBuffer, std::string_view label, uint32_t queryFlags)
+{
+    auto& frame = frames_[frame_];
+    auto& scopes = frame.scopes;
+
+    ScopeRecord scope{};
+    scope.label = label;
+    scope.depth = static_cast<uint32_t>(open_scopes_.size());
+    if (open_scopes_.empty()) {
+        scope.path = label;
+    } else {
+        scope.path = scopes[open_scopes_.back()].path + "/" + std::string{label};
+    }
+
+    // 查询用完时仍然记录这个范围，保证 begin 和 end 的配对，只是不参与统计
+    writeTimeStamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, scope.beginQuery);
+
+    if ((queryFlags & PipelineStatisticsQuery) && !statistics_active_ &&
+        allocQuery(frame.statistics, scope.statisticsQuery)) {
+        vkCmdBeginQuery(cmdBuffer, frame.statistics.queryPool, scope.statisticsQuery, 0);
+        statistics_active_ = true;
+    }
+
+    if ((queryFlags & OcclusionQuery) && !occlusion_active_ &&
+        allocQuery(frame.occlusion, scope.occlusionQuery)) {
+        vkCmdBeginQuery(cmdBuffer, frame.occlusion.queryPool, scope.occlusionQuery,
+                        precise_occlusion_ ? VK_QUERY_CONTROL_PRECISE_BIT : 0);
+        occlusion_active_ = true;
+    }
+
+    open_scopes_.push_back(static_cast<uint32_t>(scopes.size()));
+    scopes.push_back(std::move(scope));
+}
+
+void GPUTimeStamp::endScope(VkCommandBuffer cmdBuffer)
+{
+    if (open_scopes_.empty()) {
+        LOG_ERROR("GPU scope ends without a matching begin.");
+        return;
+    }
+
+    auto& frame = frames_[frame_];
+    auto& scope = frame.scopes[open_scopes_.back()];
+    open_scopes_.pop_back();
+
+    // 与开始时的顺序相反地结束附加的查询
+    if (scope.occlusionQuery != InvalidQuery) {
+        vkCmdEndQuery(cmdBuffer, frame.occlusion.queryPool, scope.occlusionQuery);
+        occlusion_active_ = false;
+    }
+
+    if (scope.statisticsQuery != InvalidQuery) {
+        vkCmdEndQuery(cmdBuffer, frame.statistics.queryPool, scope.statisticsQuery);
+        statistics_active_ = false;
+    }
+
+    writeTimeStamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, scope.endQuery);
+}
+
+void GPUTimeStamp::readScopeQueries(FrameQueries& frame)
+{
+    if (frame.statistics.count > 0) {
+        std::vector<uint64_t> results(frame.statistics.count * StatisticsCount, 0);
+        auto result = vkGetQueryPoolResults(device_->getHandle(),
+                                            frame.statistics.queryPool,
+                                            0,
+                                            frame.statistics.count,
+                                            results.size() * sizeof(uint64_t),
+                                            results.data(),
+                                            StatisticsCount * sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS) {
+            for (auto& scope : frame.scopes) {
+                if (scope.statisticsQuery != InvalidQuery) {
+                    auto first = results.begin() + scope.statisticsQuery * StatisticsCount;
+                    std::copy(first, first + StatisticsCount, scope.statistics.begin());
+                    scope.hasStatistics = true;
+                }
+            }
+        }
+    }
+
+    if (frame.occlusion.count > 0) {
+        std::vector<uint64_t> results(frame.occlusion.count, 0);
+        auto result = vkGetQueryPoolResults(device_->getHandle(),
+                                            frame.occlusion.queryPool,
+                                            0,
+                                            frame.occlusion.count,
+                                            results.size() * sizeof(uint64_t),
+                                            results.data(),
+                                            sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS) {
+            for (auto& scope : frame.scopes) {
+                if (scope.occlusionQuery != InvalidQuery) {
+                    scope.samplesPassed = results[scope.occlusionQuery];
+                    scope.hasOcclusion = true;
+                }
+            }
+        }
+    }
 }
 
 void GPUTimeStamp::beginFrame(VkCommandBuffer cmdBuffer, std::vector<TimeStamp>& timeStamp)
 {
-    auto& cpuTimeStamps = cpu_time_stamps_[frame_];
-    auto& gpuLabels = labels_[frame_];
+    auto& frame = frames_[frame_];
+    auto& cpuTimeStamps = frame.cpuTimeStamps;
+    auto& gpuLabels = frame.labels;
+
+    if (trace_recorder_ != nullptr) {
+        trace_recorder_->nextFrame();
+    }
 
     timeStamp.clear();
 
@@ -53,47 +247,71 @@ void GPUTimeStamp::beginFrame(VkCommandBuffer cmdBuffer, std::vector<TimeStamp>&
         std::copy(std::execution::par, cpuTimeStamps.begin(), cpuTimeStamps.end(), timeStamp.begin());
     }
 
+    if (!open_scopes_.empty()) {
+        LOG_WARN("{} GPU scopes are not ended in the last frame.", open_scopes_.size());
+        open_scopes_.clear();
+    }
+    statistics_active_ = false;
+    occlusion_active_ = false;
+
     // 拷贝 GPU 的测量时间
-    uint32_t offset = frame_ * MaxQueryCountPerFrame;
-    auto measurementCount = static_cast<uint32_t>(gpuLabels.size());
-    if (measurementCount > 0) {
-        // timestampPeriod 表示每次 tick 的时间间隔，以纳秒为单位，所以转换成毫秒
-        const double msPerTick = device_->getProperties().device_properties.limits.timestampPeriod * 1e-3f;
+    if (frame.timeStamps.count > 0) {
+        // timestampPeriod 表示每次 tick 的时间间隔，以纳秒为单位，所以转换成微秒
+        const double usPerTick = device_->getProperties().device_properties.limits.timestampPeriod * 1e-3f;
         {
-            std::vector<uint64_t> timingsInTick(measurementCount, 0);
+            std::vector<uint64_t> timingsInTick(frame.timeStamps.count, 0);
             auto result = vkGetQueryPoolResults(device_->getHandle(),
-                                                query_pool_,
-                                                offset,
-                                                measurementCount,
-                                                measurementCount * sizeof(uint64_t),
+                                                frame.timeStamps.queryPool,
+                                                0,
+                                                frame.timeStamps.count,
+                                                frame.timeStamps.count * sizeof(uint64_t),
                                                 timingsInTick.data(),
                                                 sizeof(uint64_t),
                                                 VK_QUERY_RESULT_64_BIT);
 
             if (result == VK_SUCCESS) {
+                auto ticks = [&](uint32_t from, uint32_t to) {
+                    return static_cast<float>(usPerTick * static_cast<double>(timingsInTick[to] - timingsInTick[from]));
+                };
+
                 // 每个测量部分的时间
-                for (uint32_t i = 1; i < measurementCount; i++) {
-                    auto ts = TimeStamp{gpuLabels[i], static_cast<float>(msPerTick * static_cast<double>(timingsInTick[i] - timingsInTick[i - 1]))};
-                    timeStamp.push_back(std::move(ts));
+                for (size_t i = 1; i < gpuLabels.size(); i++) {
+                    timeStamp.push_back(TimeStamp{gpuLabels[i].first, ticks(gpuLabels[i - 1].second, gpuLabels[i].second)});
                 }
 
                 // 总的测量时间
-                auto ts = TimeStamp{"Total GPU Time",
-                                    static_cast<float>(msPerTick * static_cast<double>(timingsInTick[measurementCount - 1] - timingsInTick[0]))};
-                timeStamp.push_back(std::move(ts));
+                if (!gpuLabels.empty()) {
+                    timeStamp.push_back(TimeStamp{"Total GPU Time", ticks(gpuLabels.front().second, gpuLabels.back().second)});
+                }
+
+                // 每个范围的时间加入到统计中
+                readScopeQueries(frame);
+                for (const auto& scope : frame.scopes) {
+                    if (scope.beginQuery != InvalidQuery && scope.endQuery != InvalidQuery) {
+                        addScopeSample(scope, ticks(scope.beginQuery, scope.endQuery));
+                    }
+                }
+                updateScopeStats();
+
+                if (trace_recorder_ != nullptr && trace_recorder_->isCapturing()) {
+                    exportToTrace(frame, timingsInTick);
+                }
             } else {
-                timeStamp.emplace_back(TimeStamp{"GPU counters are invalid", 0.0f});
+                timeStamp.emplace_back(TimeStamp{std::string{InvalidCountersLabel}, 0.0f});
             }
         }
     }
-    
-    // 查询之后重置 query pool
-    vkCmdResetQueryPool(cmdBuffer, query_pool_, offset, MaxQueryCountPerFrame);
-    
+
+    resetQuerySet(cmdBuffer, frame.timeStamps, VK_QUERY_TYPE_TIMESTAMP);
+    resetQuerySet(cmdBuffer, frame.statistics, VK_QUERY_TYPE_PIPELINE_STATISTICS);
+    resetQuerySet(cmdBuffer, frame.occlusion, VK_QUERY_TYPE_OCCLUSION);
+
     cpuTimeStamps.clear();
     gpuLabels.clear();
-    
+    frame.scopes.clear();
+
     // 添加一个记录作为起始测量时间点
+    frame.cpuBeginTime = TraceRecorder::Now();
     getTimeStamp(cmdBuffer, "Begin Frame");
 }
 
@@ -102,4 +320,115 @@ void GPUTimeStamp::endFrame()
     frame_ = (frame_ + 1) % backBuffer_count_;
 }
 
+void GPUTimeStamp::exportToTrace(const FrameQueries& frame, const std::vector<uint64_t>& timingsInTick)
+{
+    if (!frame.labels.empty()) {
+        trace_recorder_->calibrateApproximately(timingsInTick[frame.labels.front().second], frame.cpuBeginTime);
+    }
+
+    for (size_t i = 1; i < frame.labels.size(); i++) {
+        trace_recorder_->addGpuEvent(frame.labels[i].first,
+                                     timingsInTick[frame.labels[i - 1].second],
+                                     timingsInTick[frame.labels[i].second],
+                                     TraceRecorder::GpuTrack::TimeStamps);
+    }
+
+    for (const auto& scope : frame.scopes) {
+        if (scope.beginQuery == InvalidQuery || scope.endQuery == InvalidQuery) {
+            continue;
+        }
+
+        // 流水线统计和遮挡查询的结果作为事件的参数
+        std::vector<std::pair<std::string_view, uint64_t>> args;
+        if (scope.hasStatistics) {
+            args.emplace_back("inputPrimitives", scope.statistics[0]);
+            args.emplace_back("vertexInvocations", scope.statistics[1]);
+            args.emplace_back("clippingInvocations", scope.statistics[2]);
+            args.emplace_back("clippingPrimitives", scope.statistics[3]);
+            args.emplace_back("fragmentInvocations", scope.statistics[4]);
+            args.emplace_back("computeInvocations", scope.statistics[5]);
+        }
+        if (scope.hasOcclusion) {
+            args.emplace_back("samplesPassed", scope.samplesPassed);
+        }
+
+        trace_recorder_->addGpuEvent(scope.label,
+                                     timingsInTick[scope.beginQuery],
+                                     timingsInTick[scope.endQuery],
+                                     TraceRecorder::GpuTrack::Scopes,
+                                     args);
+    }
+}
+
+void GPUTimeStamp::addScopeSample(const ScopeRecord& scope, float microseconds)
+{
+    auto [it, inserted] = scope_indices_.try_emplace(scope.path, scope_histories_.size());
+    if (inserted) {
+        scope_histories_.push_back({std::vector<float>(stats_window_, 0.0f), 0, 0});
+
+        GPUScopeStats stats{};
+        stats.label = scope.label;
+        stats.path = scope.path;
+        stats.depth = scope.depth;
+        scope_stats_.push_back(std::move(stats));
+    }
+
+    auto& history = scope_histories_[it->second];
+    history.samples[history.next] = microseconds;
+    history.next = (history.next + 1) % stats_window_;
+    history.count = std::min(history.count + 1, stats_window_);
+
+    auto& stats = scope_stats_[it->second];
+    stats.last = microseconds;
+
+    stats.hasPipelineStatistics = scope.hasStatistics;
+    if (scope.hasStatistics) {
+        stats.inputPrimitives = scope.statistics[0];
+        stats.vertexInvocations = scope.statistics[1];
+        stats.clippingInvocations = scope.statistics[2];
+        stats.clippingPrimitives = scope.statistics[3];
+        stats.fragmentInvocations = scope.statistics[4];
+        stats.computeInvocations = scope.statistics[5];
+    }
+
+    stats.hasOcclusion = scope.hasOcclusion;
+    stats.samplesPassed = scope.samplesPassed;
+}
+
+void GPUTimeStamp::updateScopeStats()
+{
+    std::vector<float> sorted;
+    for (size_t i = 0; i < scope_histories_.size(); ++i) {
+        const auto& history = scope_histories_[i];
+        auto& stats = scope_stats_[i];
+
+        stats.sampleCount = history.count;
+        if (history.count == 0) {
+            continue;
+        }
+
+        sorted.assign(history.samples.begin(), history.samples.begin() + history.count);
+        std::sort(sorted.begin(), sorted.end());
+
+        // 取最近的排名作为百分位数
+        auto percentile = [&](float p) {
+            auto rank = static_cast<size_t>(std::ceil(p * static_cast<float>(sorted.size())));
+            return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+        };
+
+        stats.min = sorted.front();
+        stats.max = sorted.back();
+        stats.avg = std::accumulate(sorted.begin(), sorted.end(), 0.0f) / static_cast<float>(sorted.size());
+        stats.p95 = percentile(0.95f);
+        stats.p99 = percentile(0.99f);
+    }
+}
+
+void GPUTimeStamp::resetScopeStats()
+{
+    scope_indices_.clear();
+    scope_histories_.clear();
+    scope_stats_.clear();
+}
+
 } // yu::vk
\ No newline at end of file
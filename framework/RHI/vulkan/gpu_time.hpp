@@ -5,6 +5,7 @@
 #pragma once
 
 #include "device.hpp"
+#include "trace_recorder.hpp"
 namespace yu::vk {
 
 struct TimeStamp
@@ -13,29 +14,173 @@ struct TimeStamp
     float microseconds;
 };
 
+/**
+ * @brief 某个 GPU 测量范围在最近若干帧中的统计，时间以微秒为单位
+ */
+struct GPUScopeStats
+{
+    std::string label;
+    // 包含所有父范围的路径，例如 "Scene/Shadow"
+    std::string path;
+    uint32_t depth = 0;
+    uint32_t sampleCount = 0;
+
+    float last = 0.0f;
+    float min = 0.0f;
+    float avg = 0.0f;
+    float max = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+
+    // 流水线统计，为最近一帧的值，范围开启了 PipelineStatisticsQuery 时才有效
+    bool hasPipelineStatistics = false;
+    uint64_t inputPrimitives = 0;
+    uint64_t vertexInvocations = 0;
+    uint64_t clippingInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentInvocations = 0;
+    uint64_t computeInvocations = 0;
+
+    // 通过深度和模板测试的采样数，范围开启了 OcclusionQuery 时才有效
+    bool hasOcclusion = false;
+    uint64_t samplesPassed = 0;
+};
+
 class GPUTimeStamp
 {
 public:
-    void create(const VulkanDevice& device, uint32_t numberOfBackBuffers);
+    /**
+     * @brief statsWindow 为统计使用的帧数，每一帧的查询数量会按需增长
+     */
+    void create(const VulkanDevice& device, uint32_t numberOfBackBuffers, uint32_t statsWindow = 120);
     void destroy();
     
     void getTimeStamp(VkCommandBuffer cmdBuffer, std::string_view label);
     void setCpuTimeStamp(TimeStamp ts);
-    
+
+    // beginScope 的附加查询
+    static constexpr uint32_t PipelineStatisticsQuery = 1 << 0;
+    static constexpr uint32_t OcclusionQuery = 1 << 1;
+
+    // 查询结果无效的帧只有一条这个标签、时间为 0 的记录
+    static constexpr std::string_view InvalidCountersLabel = "GPU counters are invalid";
+
+    /**
+     * @brief 开始一个可以嵌套的测量范围，开始时在 TOP_OF_PIPE、结束时在 BOTTOM_OF_PIPE 写入时间戳，
+     *        得到的是范围内命令从开始执行到全部完成的时间。begin 和 end 需要在同一帧中成对调用。
+     *        queryFlags 可以附加流水线统计和遮挡查询，同一类查询不能嵌套，已经有同类查询的范围内会忽略；
+     *        附加查询的范围不能跨越渲染通道的边界
+     */
+    void beginScope(VkCommandBuffer cmdBuffer, std::string_view label, uint32_t queryFlags = 0);
+    void endScope(VkCommandBuffer cmdBuffer);
+
+    // 设备是否支持流水线统计查询
+    bool supportsPipelineStatistics() const { return support_statistics_; }
+
     void beginFrame(VkCommandBuffer cmdBuffer, std::vector<TimeStamp>& timeStamp);
     void endFrame();
 
+    // 各个测量范围的统计，按照范围第一次出现的顺序排列，父范围在子范围之前
+    const std::vector<GPUScopeStats>& getScopeStats() const { return scope_stats_; }
+    void resetScopeStats();
+
+    // 读回的时间戳和 CPU 的测量同时交给记录器，用于导出时间线
+    void setTraceRecorder(TraceRecorder* recorder) { trace_recorder_ = recorder; }
+
 private:
-    const VulkanDevice* device_ = nullptr;
-    const uint32_t MaxQueryCountPerFrame = 128;
+    struct ScopeRecord
+    {
+        std::string label;
+        std::string path;
+        uint32_t depth = 0;
+        uint32_t beginQuery = InvalidQuery;
+        uint32_t endQuery = InvalidQuery;
+
+        uint32_t statisticsQuery = InvalidQuery;
+        uint32_t occlusionQuery = InvalidQuery;
+        // 读回的流水线统计和遮挡查询结果
+        bool hasStatistics = false;
+        bool hasOcclusion = false;
+        std::array<uint64_t, 6> statistics{};
+        uint64_t samplesPassed = 0;
+    };
+
+    // 一帧中某一类查询使用的查询池
+    struct QuerySet
+    {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        uint32_t capacity = 0;
+        uint32_t count = 0;
+        // 这一帧的查询超过了容量，读取结果之后扩大查询池
+        bool overflowed = false;
+    };
+
+    struct FrameQueries
+    {
+        QuerySet timeStamps;
+        QuerySet statistics;
+        QuerySet occlusion;
 
-    VkQueryPool query_pool_{};
+        // 写入第一个时间戳时的 CPU 时间，不支持校准时间戳时用来对齐时间线
+        uint64_t cpuBeginTime = 0;
+
+        std::vector<std::pair<std::string, uint32_t>> labels;
+        std::vector<ScopeRecord> scopes;
+        std::vector<TimeStamp> cpuTimeStamps;
+    };
+
+    struct ScopeHistory
+    {
+        std::vector<float> samples;
+        uint32_t next = 0;
+        uint32_t count = 0;
+    };
+
+    void createQueryPool(QuerySet& querySet, VkQueryType type, uint32_t capacity);
+    void resetQuerySet(VkCommandBuffer cmdBuffer, QuerySet& querySet, VkQueryType type);
+    bool allocQuery(QuerySet& querySet, uint32_t& query);
+    bool writeTimeStamp(VkCommandBuffer cmdBuffer, VkPipelineStageFlagBits stage, uint32_t& query);
+    void readScopeQueries(FrameQueries& frame);
+    void addScopeSample(const ScopeRecord& scope, float microseconds);
+    void exportToTrace(const FrameQueries& frame, const std::vector<uint64_t>& timingsInTick);
+    void updateScopeStats();
+
+private:
+    static constexpr uint32_t InvalidQuery = UINT32_MAX;
+    static constexpr uint32_t InitialQueryCountPerFrame = 128;
+    static constexpr uint32_t InitialScopeQueryCountPerFrame = 16;
+
+    // 读回的统计依次为图元装配的图元数、顶点着色器调用数、裁剪调用数、裁剪输出的图元数、片段着色器调用数、计算着色器调用数
+    static constexpr VkQueryPipelineStatisticFlags StatisticsFlags =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+    static constexpr uint32_t StatisticsCount = 6;
+
+    const VulkanDevice* device_ = nullptr;
 
     uint32_t frame_ = 0;
     uint32_t backBuffer_count_ = 0;
 
-    std::vector<std::string> labels_[3];
-    std::vector<TimeStamp> cpu_time_stamps_[3];
+    std::vector<FrameQueries> frames_;
+    // 当前帧中还没有结束的范围，是 scopes 中的下标
+    std::vector<uint32_t> open_scopes_;
+
+    bool support_statistics_ = false;
+    bool precise_occlusion_ = false;
+    // 同一类查询在命令缓冲区中不能同时进行
+    bool statistics_active_ = false;
+    bool occlusion_active_ = false;
+
+    uint32_t stats_window_ = 120;
+    std::unordered_map<std::string, size_t> scope_indices_;
+    std::vector<ScopeHistory> scope_histories_;
+    std::vector<GPUScopeStats> scope_stats_;
+
+    TraceRecorder* trace_recorder_ = nullptr;
 };
 
 } // yu::vk
\ No newline at end of file
@@ -0,0 +1,96 @@
+﻿#include <chrono>
+#include <logger.hpp>
+#include <imgui.h>
+#include "headless_runner.hpp"
+
+namespace yu::vk {
+
+void HeadlessRunner::create(std::string_view appName, const HeadlessProperties& properties)
+{
+    properties_ = properties;
+
+    // 1. 创建不带 surface 扩展的实例
+    InstanceProperties instanceProps{};
+    instanceProps.enabled_validation = properties_.enabled_validation;
+    instanceProps.headless = true;
+    instance_ = std::make_unique<VulkanInstance>(appName, std::move(instanceProps));
+
+    // 2. 没有 surface，设备不会启用交换链扩展，present 队列就是 graphics 队列
+    device_ = std::make_unique<VulkanDevice>();
+    device_->create(*instance_);
+
+    auto [deviceName, apiVersion] = device_->getProperties().getDeviceInfo();
+    LOG_INFO("Headless device: {}, API: {}", deviceName, apiVersion);
+
+    // 3. 离屏图像环代替交换链
+    swap_chain_ = std::make_unique<SwapChain>(*device_, properties_.create_depth);
+    swap_chain_->createHeadless(properties_.width, properties_.height, properties_.image_count);
+
+    // 与 AppBase 相同的默认相机
+    mouse_tracker_ = std::make_unique<MouseTracker>();
+    mouse_tracker_->camera_->setFov(glm::radians(60.0f), properties_.width, properties_.height, 0.1f, 1000.0f);
+    mouse_tracker_->camera_->lookAt({0, 0, 5}, {0, 0, 0});
+
+    // 渲染器的 loadAssets 和 createWindowSizeDependency 会使用 ImGui，只创建上下文和字体图集，不创建绘制资源
+    imgui_context_ = ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DeltaTime = 1.0f / 60.0f;
+    io.Fonts->Build();
+}
+
+void HeadlessRunner::destroy()
+{
+    if (swap_chain_) {
+        vkDeviceWaitIdle(device_->getHandle());
+        swap_chain_->destroyWindowSizeDependency();
+        swap_chain_.reset();
+    }
+
+    if (imgui_context_ != nullptr) {
+        ImGui::DestroyContext(imgui_context_);
+        imgui_context_ = nullptr;
+    }
+
+    mouse_tracker_.reset();
+    device_.reset();
+    instance_.reset();
+}
+
+uint32_t HeadlessRunner::run(Renderer& renderer, uint32_t frameCount, const FrameCallback& onFrame)
+{
+    renderer.create(*device_, swap_chain_.get(), *mouse_tracker_);
+    renderer.createWindowSizeDependency(properties_.width, properties_.height);
+
+    // 一次加载完全部资源，与 AppBase 一样每个阶段都在一帧 ImGui 中进行
+    int loadingStage = 0;
+    do {
+        ImGui::NewFrame();
+        loadingStage = renderer.loadAssets(loadingStage);
+        ImGui::EndFrame();
+    } while (loadingStage != 0);
+
+    uint32_t frameIndex = 0;
+    for (; frameIndex < frameCount; ++frameIndex) {
+        ImGui::NewFrame();
+
+        auto begin = std::chrono::steady_clock::now();
+        renderer.render();
+        auto end = std::chrono::steady_clock::now();
+
+        // 渲染器没有 ImGUI 时不会调用 ImGui::Render，需要手动结束这一帧
+        ImGui::EndFrame();
+
+        if (onFrame) {
+            onFrame(frameIndex, std::chrono::duration<float, std::milli>(end - begin).count());
+        }
+    }
+
+    vkDeviceWaitIdle(device_->getHandle());
+    renderer.destroyWindowSizeDependency();
+    renderer.destroy();
+
+    return frameIndex;
+}
+
+} // yu::vk
\ No newline at end of file
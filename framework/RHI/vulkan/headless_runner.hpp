@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <functional>
+#include "instance.hpp"
+#include "renderer.hpp"
+
+struct ImGuiContext;
+
+namespace yu::vk {
+
+struct HeadlessProperties
+{
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    // 离屏图像环中的图像数量
+    uint32_t image_count = 3;
+    bool create_depth = false;
+    bool enabled_validation = false;
+};
+
+/**
+ * @brief 无窗口地运行渲染器：不创建 surface，用离屏图像环代替交换链，加载资源后渲染固定的帧数。
+ *        可以在没有显示器的 CI 机器上用软件驱动（例如 lavapipe）运行任意的渲染器；
+ *        渲染器不会创建 ImGUI 的绘制资源，但 ImGui 的上下文存在，loadAssets 中的 ImGui 调用依然有效
+ */
+class HeadlessRunner
+{
+public:
+    // 每一帧渲染之后调用，cpuFrameTime 为这一帧 render 的 CPU 时间，单位为毫秒
+    using FrameCallback = std::function<void(uint32_t frameIndex, float cpuFrameTime)>;
+
+    void create(std::string_view appName, const HeadlessProperties& properties);
+    void destroy();
+
+    /**
+     * @brief 创建渲染器并加载全部资源，渲染 frameCount 帧后等待设备空闲并销毁渲染器
+     * @return 实际渲染的帧数
+     */
+    uint32_t run(Renderer& renderer, uint32_t frameCount, const FrameCallback& onFrame = {});
+
+    const VulkanDevice& getDevice() const { return *device_; }
+    SwapChain& getSwapChain() { return *swap_chain_; }
+    MouseTracker& getMouseTracker() { return *mouse_tracker_; }
+
+private:
+    HeadlessProperties properties_;
+
+    std::unique_ptr<VulkanInstance> instance_ = nullptr;
+    std::unique_ptr<VulkanDevice> device_ = nullptr;
+    std::unique_ptr<SwapChain> swap_chain_ = nullptr;
+    std::unique_ptr<MouseTracker> mouse_tracker_ = nullptr;
+
+    ImGuiContext* imgui_context_ = nullptr;
+};
+
+} // yu::vk
\ No newline at end of file
@@ -225,6 +225,29 @@ inline VkSemaphoreCreateInfo semaphoreCreateInfo()
     return semaphoreCreateInfo;
 }
 
+inline VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo(VkSemaphoreType semaphoreType, uint64_t initialValue = 0)
+{
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo{};
+    semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeCreateInfo.semaphoreType = semaphoreType;
+    semaphoreTypeCreateInfo.initialValue = initialValue;
+    return semaphoreTypeCreateInfo;
+}
+
+inline VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo()
+{
+    VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo{};
+    timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    return timelineSemaphoreSubmitInfo;
+}
+
+inline VkSemaphoreWaitInfo semaphoreWaitInfo()
+{
+    VkSemaphoreWaitInfo semaphoreWaitInfo{};
+    semaphoreWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    return semaphoreWaitInfo;
+}
+
 inline VkFenceCreateInfo fenceCreateInfo(VkFenceCreateFlags flags = 0)
 {
     VkFenceCreateInfo fenceCreateInfo{};
@@ -440,6 +463,36 @@ inline VkWriteDescriptorSet writeDescriptorSet(
     return writeDescriptorSet;
 }
 
+inline VkDescriptorUpdateTemplateEntry descriptorUpdateTemplateEntry(
+    uint32_t binding,
+    VkDescriptorType type,
+    uint32_t descriptorCount,
+    size_t offset,
+    size_t stride)
+{
+    VkDescriptorUpdateTemplateEntry descriptorUpdateTemplateEntry{};
+    descriptorUpdateTemplateEntry.dstBinding = binding;
+    descriptorUpdateTemplateEntry.dstArrayElement = 0;
+    descriptorUpdateTemplateEntry.descriptorCount = descriptorCount;
+    descriptorUpdateTemplateEntry.descriptorType = type;
+    descriptorUpdateTemplateEntry.offset = offset;
+    descriptorUpdateTemplateEntry.stride = stride;
+    return descriptorUpdateTemplateEntry;
+}
+
+inline VkDescriptorUpdateTemplateCreateInfo descriptorUpdateTemplateCreateInfo(
+    const std::vector<VkDescriptorUpdateTemplateEntry>& entries,
+    VkDescriptorSetLayout descriptorSetLayout)
+{
+    VkDescriptorUpdateTemplateCreateInfo descriptorUpdateTemplateCreateInfo{};
+    descriptorUpdateTemplateCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    descriptorUpdateTemplateCreateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    descriptorUpdateTemplateCreateInfo.pDescriptorUpdateEntries = entries.data();
+    descriptorUpdateTemplateCreateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    descriptorUpdateTemplateCreateInfo.descriptorSetLayout = descriptorSetLayout;
+    return descriptorUpdateTemplateCreateInfo;
+}
+
 inline VkVertexInputBindingDescription vertexInputBindingDescription(
     uint32_t binding,
     uint32_t stride,
@@ -65,6 +65,12 @@ void VulkanInstance::setEssentialExtensions()
     if (properties_.enabled_validation) {
         CheckDebugUtilsInstanceEXT(properties_);
     }
+
+    // 无窗口时不需要 surface，软件驱动（例如 lavapipe）在没有显示器的机器上也可以创建实例
+    if (properties_.headless) {
+        return;
+    }
+
     CheckHDRInstanceEXT(properties_);
 
     properties_.addExtension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
@@ -121,6 +127,11 @@ VkPhysicalDevice VulkanInstance::getBestDevice() const
 
 void VulkanInstance::createSurface(const San::Window* window)
 {
+    if (properties_.headless) {
+        LOG_WARN("Headless instance can not create a surface.");
+        return;
+    }
+
     if (surface_ != VK_NULL_HANDLE)
         destroySurface();
     
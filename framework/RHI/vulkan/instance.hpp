@@ -19,6 +19,7 @@ public:
     void destroySurface();
     
     VkSurfaceKHR getSurface() const { return surface_; }
+    bool isHeadless() const { return properties_.headless; }
     VkInstance getHandle() const { return instance_; }
     VkPhysicalDevice getBestDevice() const;
 private:
@@ -19,6 +19,9 @@ struct InstanceProperties : public Properties
     bool enabled_validation = true;
 #endif
 
+    // 无窗口模式，不启用 surface 相关的扩展，交换链由离屏图像代替
+    bool headless = false;
+
     InstanceProperties();
 };
 
@@ -108,10 +108,31 @@ void ModelObj::allocMemory(StaticBuffer& staticBuffer)
                              &index_info_);
 }
 
+void ModelObj::freeMemory(StaticBuffer& staticBuffer)
+{
+    staticBuffer.freeBuffer(vertex_info_);
+    staticBuffer.freeBuffer(index_info_);
+
+    vertex_info_ = {};
+    index_info_ = {};
+}
+
 void ModelObj::draw(VulkanPipeline& pipeline, VkCommandBuffer cmdBuffer, VkDescriptorBufferInfo* pConstantBuffer, VkDescriptorSet descriptorSet)
 {
     pipeline.drawIndexed(cmdBuffer, static_cast<uint32_t>(obj_.indices.size()),
                          &vertex_info_, &index_info_, pConstantBuffer, descriptorSet);
 }
 
+void ModelObj::drawDynamic(VulkanPipeline& pipeline, VkCommandBuffer cmdBuffer, VkDescriptorSet descriptorSet, uint32_t dynamicOffset)
+{
+    pipeline.drawIndexedDynamic(cmdBuffer, static_cast<uint32_t>(obj_.indices.size()),
+                                vertex_info_, index_info_, descriptorSet, dynamicOffset);
+}
+
+void ModelObj::drawPushed(VulkanPipeline& pipeline, VkCommandBuffer cmdBuffer, const void* pushData, uint32_t pushSize)
+{
+    pipeline.drawIndexedPushed(cmdBuffer, static_cast<uint32_t>(obj_.indices.size()),
+                               vertex_info_, index_info_, pushData, pushSize);
+}
+
 } // yu::vk
\ No newline at end of file
@@ -84,11 +84,23 @@ public:
                                        std::vector<VkVertexInputAttributeDescription>& attrDesc);
 
     void allocMemory(StaticBuffer& staticBuffer);
+    // 卸载模型时归还顶点和索引数据占用的空间
+    void freeMemory(StaticBuffer& staticBuffer);
 
     void draw(VulkanPipeline& pipeline,
               VkCommandBuffer cmdBuffer,
               VkDescriptorBufferInfo* pConstantBuffer,
               VkDescriptorSet descriptorSet);
+    // 流水线需要先通过 VulkanPipeline::bind 绑定，每次绘制只改变常量缓冲区的动态偏移
+    void drawDynamic(VulkanPipeline& pipeline,
+                     VkCommandBuffer cmdBuffer,
+                     VkDescriptorSet descriptorSet,
+                     uint32_t dynamicOffset);
+    // 每个物体的数据（例如变换矩阵）通过推送常量传递，流水线和描述符集需要事先绑定
+    void drawPushed(VulkanPipeline& pipeline,
+                    VkCommandBuffer cmdBuffer,
+                    const void* pushData,
+                    uint32_t pushSize);
 
 private:
     ModelDataObj obj_;
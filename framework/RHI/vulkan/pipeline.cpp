@@ -17,10 +17,73 @@ void VulkanPipeline::create(const VulkanDevice& device,
                             PipelineBuilder& pipelineBuilder)
 {
     device_ = &device;
+    push_constant_ranges_ = pipelineBuilder.getPushConstantRanges();
 
+    createPipelineLayout(descriptorSetLayout);
+
+    pipelineBuilder.createPipeline(renderPass, pipeline_layout_, pipeline_);
+}
+
+void VulkanPipeline::create(const VulkanDevice& device,
+                            VkRenderPass renderPass,
+                            VkDescriptorSetLayout descriptorSetLayout,
+                            PipelineBuilder& pipelineBuilder,
+                            PipelineRegistry& registry)
+{
+    device_ = &device;
+    registry_ = &registry;
+    push_constant_ranges_ = pipelineBuilder.getPushConstantRanges();
+
+    pipeline_layout_ = registry.acquireLayout(descriptorSetLayout, push_constant_ranges_);
+    pipeline_ = registry.acquirePipeline(pipelineBuilder, renderPass, pipeline_layout_);
+}
+
+void VulkanPipeline::create(const VulkanDevice& device,
+                            VkRenderPass renderPass,
+                            PipelineBuilder& pipelineBuilder,
+                            PipelineRegistry& registry,
+                            DescriptorLayoutCache& layoutCache)
+{
+    device_ = &device;
+    registry_ = &registry;
+
+    descriptor_set_layouts_.clear();
+    const uint32_t setCount = pipelineBuilder.getReflectedSetCount();
+    for (uint32_t set = 0; set < setCount; ++set) {
+        auto overrideLayout = pipelineBuilder.getDescriptorSetLayoutOverride(set);
+        if (overrideLayout != VK_NULL_HANDLE) {
+            descriptor_set_layouts_.push_back(overrideLayout);
+        } else {
+            descriptor_set_layouts_.push_back(layoutCache.getLayout(pipelineBuilder.getReflectedBindings(set)));
+        }
+    }
+
+    push_constant_ranges_ = pipelineBuilder.getPushConstantRanges();
+    pipeline_layout_ = registry.acquireLayout(descriptor_set_layouts_, push_constant_ranges_);
+    pipeline_ = registry.acquirePipeline(pipelineBuilder, renderPass, pipeline_layout_);
+}
+
+void VulkanPipeline::createAsync(const VulkanDevice& device,
+                                 VkRenderPass renderPass,
+                                 VkDescriptorSetLayout descriptorSetLayout,
+                                 PipelineBuilder& pipelineBuilder,
+                                 TaskQueue& taskQueue,
+                                 VulkanPipeline* fallback)
+{
+    device_ = &device;
+    fallback_ = fallback;
+    push_constant_ranges_ = pipelineBuilder.getPushConstantRanges();
+
+    createPipelineLayout(descriptorSetLayout);
+
+    pending_pipeline_ = pipelineBuilder.createPipelineAsync(taskQueue, renderPass, pipeline_layout_);
+}
+
+void VulkanPipeline::createPipelineLayout(VkDescriptorSetLayout descriptorSetLayout)
+{
     auto pipelineLayoutInfo = pipelineLayoutCreateInfo();
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(push_constant_ranges_.size());
+    pipelineLayoutInfo.pPushConstantRanges = push_constant_ranges_.data();
     if (descriptorSetLayout != VK_NULL_HANDLE) {
         pipelineLayoutInfo.setLayoutCount = 1;
         pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
@@ -29,12 +92,67 @@ void VulkanPipeline::create(const VulkanDevice& device,
     }
 
     VK_CHECK(vkCreatePipelineLayout(device_->getHandle(), &pipelineLayoutInfo, nullptr, &pipeline_layout_));
+}
 
-    pipelineBuilder.createPipeline(renderPass, pipeline_layout_, pipeline_);
+bool VulkanPipeline::isReady()
+{
+    if (pipeline_ != VK_NULL_HANDLE) {
+        return true;
+    }
+
+    if (pending_pipeline_.valid() &&
+        pending_pipeline_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        // 取回结果后就不再需要 future
+        pipeline_ = pending_pipeline_.get();
+        pending_pipeline_ = {};
+        return true;
+    }
+
+    return false;
+}
+
+VkPipeline VulkanPipeline::resolvePipeline()
+{
+    if (isReady()) {
+        return pipeline_;
+    }
+
+    if (!pending_pipeline_.valid()) {
+        LOG_WARN("Pipeline is not valid.");
+        return VK_NULL_HANDLE;
+    }
+
+    if (fallback_ != nullptr && fallback_->isReady()) {
+        return fallback_->pipeline_;
+    }
+
+    return VK_NULL_HANDLE;
 }
 
 void VulkanPipeline::destroy()
 {
+    // 等待还在编译中的流水线，确保它能被正确地销毁
+    if (pending_pipeline_.valid()) {
+        pipeline_ = pending_pipeline_.get();
+        pending_pipeline_ = {};
+    }
+
+    push_constant_ranges_.clear();
+
+    if (registry_ != nullptr) {
+        if (pipeline_ != VK_NULL_HANDLE) {
+            registry_->releasePipeline(pipeline_);
+            pipeline_ = VK_NULL_HANDLE;
+        }
+        if (pipeline_layout_ != VK_NULL_HANDLE) {
+            registry_->releaseLayout(pipeline_layout_);
+            pipeline_layout_ = VK_NULL_HANDLE;
+        }
+        registry_ = nullptr;
+        descriptor_set_layouts_.clear();
+        return;
+    }
+
     if (pipeline_ != VK_NULL_HANDLE) {
         vkDestroyPipeline(device_->getHandle(), pipeline_, nullptr);
         pipeline_ = VK_NULL_HANDLE;
@@ -50,8 +168,8 @@ void VulkanPipeline::draw(VkCommandBuffer cmdBuffer,
                           VkDescriptorBufferInfo* pConstantBuffer,
                           VkDescriptorSet descriptorSet)
 {
-    if (pipeline_ == VK_NULL_HANDLE) {
-        LOG_WARN("Pipeline is not valid.");
+    auto pipeline = resolvePipeline();
+    if (pipeline == VK_NULL_HANDLE) {
         return;
     }
 
@@ -76,7 +194,7 @@ void VulkanPipeline::draw(VkCommandBuffer cmdBuffer,
     }
 
     // 绑定流水线
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
     // 绘制命令
     vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
@@ -88,8 +206,8 @@ void VulkanPipeline::draw(VkCommandBuffer cmdBuffer,
                           VkDescriptorBufferInfo* pConstantBuffer,
                           VkDescriptorSet descriptorSet)
 {
-    if (pipeline_ == VK_NULL_HANDLE) {
-        LOG_WARN("Pipeline is not valid.");
+    auto pipeline = resolvePipeline();
+    if (pipeline == VK_NULL_HANDLE) {
         return;
     }
 
@@ -120,7 +238,7 @@ void VulkanPipeline::draw(VkCommandBuffer cmdBuffer,
     vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &pVertexBuffer->buffer, &pVertexBuffer->offset);
 
     // 绑定流水线
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
     // 绘制命令
     vkCmdDraw(cmdBuffer, vertexCount, 1, 0, 0);
@@ -133,8 +251,8 @@ void VulkanPipeline::drawIndexed(VkCommandBuffer cmdBuffer,
                                  VkDescriptorBufferInfo* pConstantBuffer,
                                  VkDescriptorSet descriptorSet)
 {
-    if (pipeline_ == VK_NULL_HANDLE) {
-        LOG_WARN("Pipeline is not valid.");
+    auto pipeline = resolvePipeline();
+    if (pipeline == VK_NULL_HANDLE) {
         return;
     }
 
@@ -166,10 +284,126 @@ void VulkanPipeline::drawIndexed(VkCommandBuffer cmdBuffer,
     vkCmdBindIndexBuffer(cmdBuffer, pIndexBuffer->buffer, pIndexBuffer->offset, VK_INDEX_TYPE_UINT32);
 
     // 绑定流水线
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
     // 绘制命令
     vkCmdDrawIndexed(cmdBuffer, indicesCount, 1, 0, 0, 0);
 }
 
+bool VulkanPipeline::bind(VkCommandBuffer cmdBuffer)
+{
+    auto pipeline = resolvePipeline();
+    if (pipeline == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    return true;
+}
+
+void VulkanPipeline::drawDynamic(VkCommandBuffer cmdBuffer,
+                                 uint32_t vertexCount,
+                                 const VkDescriptorBufferInfo& vertexBuffer,
+                                 VkDescriptorSet descriptorSet,
+                                 uint32_t dynamicOffset)
+{
+    // 动态偏移只能在绑定描述符集时给出，重新绑定同一个描述符集不需要写入描述符
+    vkCmdBindDescriptorSets(cmdBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipeline_layout_,
+                            0,
+                            1,
+                            &descriptorSet,
+                            1,
+                            &dynamicOffset);
+
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer.buffer, &vertexBuffer.offset);
+
+    vkCmdDraw(cmdBuffer, vertexCount, 1, 0, 0);
+}
+
+void VulkanPipeline::drawIndexedDynamic(VkCommandBuffer cmdBuffer,
+                                        uint32_t indicesCount,
+                                        const VkDescriptorBufferInfo& vertexBuffer,
+                                        const VkDescriptorBufferInfo& indexBuffer,
+                                        VkDescriptorSet descriptorSet,
+                                        uint32_t dynamicOffset)
+{
+    vkCmdBindDescriptorSets(cmdBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipeline_layout_,
+                            0,
+                            1,
+                            &descriptorSet,
+                            1,
+                            &dynamicOffset);
+
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer.buffer, &vertexBuffer.offset);
+    vkCmdBindIndexBuffer(cmdBuffer, indexBuffer.buffer, indexBuffer.offset, VK_INDEX_TYPE_UINT32);
+
+    vkCmdDrawIndexed(cmdBuffer, indicesCount, 1, 0, 0, 0);
+}
+
+void VulkanPipeline::bindDescriptorSet(VkCommandBuffer cmdBuffer,
+                                       VkDescriptorSet descriptorSet,
+                                       const std::vector<uint32_t>& dynamicOffsets,
+                                       uint32_t set)
+{
+    vkCmdBindDescriptorSets(cmdBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipeline_layout_,
+                            set,
+                            1,
+                            &descriptorSet,
+                            static_cast<uint32_t>(dynamicOffsets.size()),
+                            dynamicOffsets.data());
+}
+
+void VulkanPipeline::pushConstants(VkCommandBuffer cmdBuffer, const void* data, uint32_t size, uint32_t offset)
+{
+    // 与更新的区间有重叠的范围，它们的着色器阶段都需要给出
+    VkShaderStageFlags stageFlags = 0;
+    for (const auto& range : push_constant_ranges_) {
+        if (offset < range.offset + range.size && range.offset < offset + size) {
+            stageFlags |= range.stageFlags;
+        }
+    }
+
+    if (stageFlags == 0) {
+        LOG_ERROR("Push constants [{}, {}) are not declared in the pipeline layout.", offset, offset + size);
+        return;
+    }
+
+    vkCmdPushConstants(cmdBuffer, pipeline_layout_, stageFlags, offset, size, data);
+}
+
+void VulkanPipeline::drawPushed(VkCommandBuffer cmdBuffer,
+                                uint32_t vertexCount,
+                                const VkDescriptorBufferInfo& vertexBuffer,
+                                const void* pushData,
+                                uint32_t pushSize)
+{
+    pushConstants(cmdBuffer, pushData, pushSize);
+
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer.buffer, &vertexBuffer.offset);
+
+    vkCmdDraw(cmdBuffer, vertexCount, 1, 0, 0);
+}
+
+void VulkanPipeline::drawIndexedPushed(VkCommandBuffer cmdBuffer,
+                                       uint32_t indicesCount,
+                                       const VkDescriptorBufferInfo& vertexBuffer,
+                                       const VkDescriptorBufferInfo& indexBuffer,
+                                       const void* pushData,
+                                       uint32_t pushSize)
+{
+    pushConstants(cmdBuffer, pushData, pushSize);
+
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer.buffer, &vertexBuffer.offset);
+    vkCmdBindIndexBuffer(cmdBuffer, indexBuffer.buffer, indexBuffer.offset, VK_INDEX_TYPE_UINT32);
+
+    vkCmdDrawIndexed(cmdBuffer, indicesCount, 1, 0, 0, 0);
+}
+
 } // yu::vk
@@ -6,6 +6,8 @@
 
 #include "device.hpp"
 #include "pipeline_builder.hpp"
+#include "pipeline_registry.hpp"
+#include "descriptor_layout_cache.hpp"
 
 namespace yu::vk {
 
@@ -16,8 +18,48 @@ public:
                 VkRenderPass renderPass,
                 VkDescriptorSetLayout descriptorSetLayout,
                 PipelineBuilder& pipelineBuilder);
+
+    /**
+     * @brief 通过注册表创建流水线，状态相同的流水线和布局会被共享，销毁时只是归还给注册表
+     */
+    void create(const VulkanDevice& device,
+                VkRenderPass renderPass,
+                VkDescriptorSetLayout descriptorSetLayout,
+                PipelineBuilder& pipelineBuilder,
+                PipelineRegistry& registry);
+
+    /**
+     * @brief 通过着色器反射生成描述符布局和流水线布局，描述符布局由 layoutCache 共享，
+     *        可以通过 getDescriptorSetLayout 取得后分配描述符集
+     */
+    void create(const VulkanDevice& device,
+                VkRenderPass renderPass,
+                PipelineBuilder& pipelineBuilder,
+                PipelineRegistry& registry,
+                DescriptorLayoutCache& layoutCache);
+
+    /**
+     * @brief 在工作线程上编译流水线，编译完成之前绘制会使用 fallback 流水线（如果有的话），否则跳过绘制。
+     *        fallback 流水线需要与本流水线的描述符布局兼容
+     */
+    void createAsync(const VulkanDevice& device,
+                     VkRenderPass renderPass,
+                     VkDescriptorSetLayout descriptorSetLayout,
+                     PipelineBuilder& pipelineBuilder,
+                     TaskQueue& taskQueue,
+                     VulkanPipeline* fallback = nullptr);
     void destroy();
 
+    VkPipelineLayout getPipelineLayout() const { return pipeline_layout_; }
+
+    VkDescriptorSetLayout getDescriptorSetLayout(uint32_t set = 0) const
+    {
+        return set < descriptor_set_layouts_.size() ? descriptor_set_layouts_[set] : VK_NULL_HANDLE;
+    }
+
+    // 流水线是否已经编译完成，可以用来绘制
+    bool isReady();
+
     [[deprecated("Hard code vertices in shader")]]
     void draw(VkCommandBuffer cmdBuffer,
               VkDescriptorBufferInfo* pConstantBuffer = nullptr,
@@ -37,11 +79,82 @@ public:
                      VkDescriptorBufferInfo* pIndexBuffer,
                      VkDescriptorBufferInfo* pConstantBuffer = nullptr,
                      VkDescriptorSet descriptorSet = nullptr);
+
+    /**
+     * @brief 绑定流水线，之后的 drawDynamic、drawIndexedDynamic 不会重复绑定；流水线还不可用时返回 false
+     */
+    bool bind(VkCommandBuffer cmdBuffer);
+
+    /**
+     * @brief 动态偏移的绘制，需要先调用 bind。描述符集中的动态 uniform 指向整个 DynamicBuffer，
+     *        每次绘制只改变 allocConstantBuffer 给出的偏移，不需要写入描述符
+     */
+    void drawDynamic(VkCommandBuffer cmdBuffer,
+                     uint32_t vertexCount,
+                     const VkDescriptorBufferInfo& vertexBuffer,
+                     VkDescriptorSet descriptorSet,
+                     uint32_t dynamicOffset);
+
+    void drawIndexedDynamic(VkCommandBuffer cmdBuffer,
+                            uint32_t indicesCount,
+                            const VkDescriptorBufferInfo& vertexBuffer,
+                            const VkDescriptorBufferInfo& indexBuffer,
+                            VkDescriptorSet descriptorSet,
+                            uint32_t dynamicOffset);
+
+    // 绑定描述符集，配合 drawPushed、drawIndexedPushed 在一次渲染中只绑定一次
+    void bindDescriptorSet(VkCommandBuffer cmdBuffer,
+                           VkDescriptorSet descriptorSet,
+                           const std::vector<uint32_t>& dynamicOffsets = {},
+                           uint32_t set = 0);
+
+    /**
+     * @brief 更新推送常量，范围需要在 PipelineBuilder::setPushConstantRanges 中声明或者由着色器反射得到
+     */
+    void pushConstants(VkCommandBuffer cmdBuffer, const void* data, uint32_t size, uint32_t offset = 0);
+
+    /**
+     * @brief 推送常量的绘制，需要先调用 bind。每次绘制的数据（不超过 128 字节）通过 vkCmdPushConstants 写入命令缓冲区，
+     *        不需要从 DynamicBuffer 分配，也不需要绑定描述符集
+     */
+    void drawPushed(VkCommandBuffer cmdBuffer,
+                    uint32_t vertexCount,
+                    const VkDescriptorBufferInfo& vertexBuffer,
+                    const void* pushData,
+                    uint32_t pushSize);
+
+    void drawIndexedPushed(VkCommandBuffer cmdBuffer,
+                           uint32_t indicesCount,
+                           const VkDescriptorBufferInfo& vertexBuffer,
+                           const VkDescriptorBufferInfo& indexBuffer,
+                           const void* pushData,
+                           uint32_t pushSize);
+
+    const std::vector<VkPushConstantRange>& getPushConstantRanges() const { return push_constant_ranges_; }
+private:
+    void createPipelineLayout(VkDescriptorSetLayout descriptorSetLayout);
+
+    // 取得当前用于绘制的流水线，异步编译没有完成时返回 fallback 的流水线
+    VkPipeline resolvePipeline();
+
 private:
     const VulkanDevice* device_ = nullptr;
 
     VkPipeline pipeline_{};
     VkPipelineLayout pipeline_layout_{};
+
+    // 流水线布局中的推送常量范围
+    std::vector<VkPushConstantRange> push_constant_ranges_;
+
+    // 反射生成的描述符布局，归 DescriptorLayoutCache 所有
+    std::vector<VkDescriptorSetLayout> descriptor_set_layouts_;
+
+    // 异步编译的流水线
+    std::shared_future<VkPipeline> pending_pipeline_{};
+    VulkanPipeline* fallback_ = nullptr;
+
+    // 不为空时流水线和布局归注册表所有
+    PipelineRegistry* registry_ = nullptr;
 };
 
 } // yu::vk
\ No newline at end of file
@@ -3,6 +3,7 @@
 //
 
 #include <common/common.hpp>
+#include <common/hash.hpp>
 #include <logger.hpp>
 #include "pipeline_builder.hpp"
 #include "initializers.hpp"
@@ -17,18 +18,34 @@ void PipelineBuilder::create(const VulkanDevice& device)
 
 void PipelineBuilder::destroy()
 {
+    // 着色器模块在编译过程中仍然被使用，需要等待异步的编译完成
+    waitForPendingPipelines();
+
+    // 模块归着色器缓存所有，这里只是归还
     for (auto& module : shader_modules_) {
-        vkDestroyShaderModule(device_->getHandle(), module, nullptr);
+        device_->getShaderCache()->release(module);
     }
+    shader_modules_.clear();
+    shader_stages_.clear();
+    shader_hashes_.clear();
+    shader_reflections_.clear();
+    push_constant_ranges_.clear();
 }
 
 void PipelineBuilder::setShader(const std::vector<std::string_view>& shaders)
 {
     for (auto shader : shaders) {
-        auto shaderModule = LoadShader(GetSpvShaderFile(shader.data()), device_->getHandle());
-        assert(shaderModule != VK_NULL_HANDLE);
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        uint64_t codeHash = 0;
+        if (!device_->getShaderCache()->acquire(GetSpvShaderFile(shader.data()), shaderModule, codeHash)) {
+            LOG_FATAL("Failed to load shader: {}", shader);
+        }
 
         shader_modules_.push_back(shaderModule);
+        shader_hashes_.push_back(codeHash);
+
+        auto pReflection = device_->getShaderCache()->getReflection(shaderModule);
+        shader_reflections_.push_back(pReflection != nullptr ? *pReflection : ShaderReflection{});
 
         auto shaderStage = pipelineShaderStageCreateInfo();
         shaderStage.stage = GetShaderType(shader);
@@ -42,13 +59,30 @@ void PipelineBuilder::setShader(const std::vector<std::string_view>& shaders)
 void PipelineBuilder::setVertexInputState(const std::vector<VkVertexInputBindingDescription>& binding,
                                           const std::vector<VkVertexInputAttributeDescription>& layout)
 {
+    vertex_bindings_ = binding;
+    vertex_attributes_ = layout;
+
     vertex_input_state_ = pipelineVertexInputStateCreateInfo();
     vertex_input_state_.pNext = nullptr;
     vertex_input_state_.flags = 0;
-    vertex_input_state_.vertexBindingDescriptionCount = static_cast<uint32_t>(binding.size());
-    vertex_input_state_.pVertexBindingDescriptions = binding.data();
-    vertex_input_state_.vertexAttributeDescriptionCount = static_cast<uint32_t>(layout.size());
-    vertex_input_state_.pVertexAttributeDescriptions = layout.data();
+    vertex_input_state_.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_bindings_.size());
+    vertex_input_state_.pVertexBindingDescriptions = vertex_bindings_.data();
+    vertex_input_state_.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attributes_.size());
+    vertex_input_state_.pVertexAttributeDescriptions = vertex_attributes_.data();
+}
+
+bool PipelineBuilder::setVertexInputFromReflection()
+{
+    auto vertexReflection = std::find_if(shader_reflections_.begin(), shader_reflections_.end(),
+                                         [](const auto& reflection) { return reflection.stage == VK_SHADER_STAGE_VERTEX_BIT; });
+    if (vertexReflection == shader_reflections_.end() || vertexReflection->vertexInputs.empty()) {
+        LOG_WARN("No reflected vertex input, set the vertex shader before calling setVertexInputFromReflection.");
+        return false;
+    }
+
+    setVertexInputState({vertexInputBindingDescription(0, vertexReflection->vertexStride, VK_VERTEX_INPUT_RATE_VERTEX)},
+                        vertexReflection->vertexInputs);
+    return true;
 }
 
 void PipelineBuilder::setInputAssemblyState(VkBool32 bPrimitiveRestart, VkPrimitiveTopology topology)
@@ -64,8 +98,10 @@ void PipelineBuilder::setRasterizationState(VkCullModeFlags cullMode, VkPolygonM
 
 void PipelineBuilder::setColorBlendState(const std::vector<VkPipelineColorBlendAttachmentState>& attStates)
 {
+    blend_attachments_ = attStates;
+
     color_blend_state_state_ =
-        pipelineColorBlendStateCreateInfo(static_cast<uint32_t>(attStates.size()), attStates.data());
+        pipelineColorBlendStateCreateInfo(static_cast<uint32_t>(blend_attachments_.size()), blend_attachments_.data());
     color_blend_state_state_.logicOpEnable = VK_FALSE;
     color_blend_state_state_.logicOp = VK_LOGIC_OP_NO_OP;
     color_blend_state_state_.blendConstants[0] = 1.0f;
@@ -76,7 +112,8 @@ void PipelineBuilder::setColorBlendState(const std::vector<VkPipelineColorBlendA
 
 void PipelineBuilder::setDynamicState(const std::vector<VkDynamicState>& dynamicStates)
 {
-    dynamic_state_ = pipelineDynamicStateCreateInfo(dynamicStates);
+    dynamic_states_ = dynamicStates;
+    dynamic_state_ = pipelineDynamicStateCreateInfo(dynamic_states_);
 }
 
 void PipelineBuilder::setViewPortState()
@@ -101,11 +138,242 @@ void PipelineBuilder::setMultisampleState(VkSampleCountFlagBits sampleCount)
 }
 
 void PipelineBuilder::createPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline& pipeline)
+{
+    setDefaultStates();
+
+    pipeline = compile(renderPass, pipelineLayout);
+}
+
+std::shared_future<VkPipeline> PipelineBuilder::createPipelineAsync(TaskQueue& taskQueue,
+                                                                    VkRenderPass renderPass,
+                                                                    VkPipelineLayout pipelineLayout)
+{
+    // 默认状态在提交的线程上设置好，工作线程只读取拷贝过去的状态
+    setDefaultStates();
+
+    auto future = taskQueue.enqueue([builder = *this, renderPass, pipelineLayout]
+                                    {
+                                        return builder.compile(renderPass, pipelineLayout);
+                                    }).share();
+
+    pending_pipelines_.push_back(future);
+
+    return future;
+}
+
+void PipelineBuilder::waitForPendingPipelines()
+{
+    for (auto& pending : pending_pipelines_) {
+        if (pending.valid()) {
+            pending.wait();
+        }
+    }
+    pending_pipelines_.clear();
+}
+
+std::vector<uint8_t> PipelineBuilder::computeStateKey()
+{
+    setDefaultStates();
+
+    // 创建信息中含有指针和填充字节，所以逐个字段地写入
+    std::vector<uint8_t> key;
+    key.reserve(512);
+
+    AppendKey(key, shader_stages_.size());
+    for (size_t i = 0; i < shader_stages_.size(); ++i) {
+        AppendKey(key, shader_stages_[i].stage);
+        AppendKey(key, shader_hashes_[i]);
+        // 哈希冲突的两份代码对应不同的模块
+        AppendKey(key, shader_stages_[i].module);
+        AppendKey(key, std::string_view{shader_stages_[i].pName});
+    }
+
+    AppendKey(key, vertex_bindings_.size());
+    for (const auto& binding : vertex_bindings_) {
+        AppendKey(key, binding);
+    }
+    AppendKey(key, vertex_attributes_.size());
+    for (const auto& attribute : vertex_attributes_) {
+        AppendKey(key, attribute);
+    }
+
+    AppendKey(key, input_assembly_state_.topology);
+    AppendKey(key, input_assembly_state_.primitiveRestartEnable);
+
+    AppendKey(key, raster_state_.depthClampEnable);
+    AppendKey(key, raster_state_.rasterizerDiscardEnable);
+    AppendKey(key, raster_state_.polygonMode);
+    AppendKey(key, raster_state_.cullMode);
+    AppendKey(key, raster_state_.frontFace);
+    AppendKey(key, raster_state_.depthBiasEnable);
+    AppendKey(key, raster_state_.depthBiasConstantFactor);
+    AppendKey(key, raster_state_.depthBiasClamp);
+    AppendKey(key, raster_state_.depthBiasSlopeFactor);
+    AppendKey(key, raster_state_.lineWidth);
+
+    AppendKey(key, color_blend_state_state_.logicOpEnable);
+    AppendKey(key, color_blend_state_state_.logicOp);
+    AppendKey(key, color_blend_state_state_.blendConstants);
+    AppendKey(key, blend_attachments_.size());
+    for (const auto& attachment : blend_attachments_) {
+        AppendKey(key, attachment);
+    }
+
+    AppendKey(key, dynamic_states_.size());
+    for (auto state : dynamic_states_) {
+        AppendKey(key, state);
+    }
+
+    AppendKey(key, viewport_state_.viewportCount);
+    AppendKey(key, viewport_state_.scissorCount);
+
+    AppendKey(key, depth_stencil_state_.depthTestEnable);
+    AppendKey(key, depth_stencil_state_.depthWriteEnable);
+    AppendKey(key, depth_stencil_state_.depthCompareOp);
+    AppendKey(key, depth_stencil_state_.depthBoundsTestEnable);
+    AppendKey(key, depth_stencil_state_.stencilTestEnable);
+    AppendKey(key, depth_stencil_state_.front);
+    AppendKey(key, depth_stencil_state_.back);
+    AppendKey(key, depth_stencil_state_.minDepthBounds);
+    AppendKey(key, depth_stencil_state_.maxDepthBounds);
+
+    AppendKey(key, multisample_state_.rasterizationSamples);
+    AppendKey(key, multisample_state_.sampleShadingEnable);
+    AppendKey(key, multisample_state_.minSampleShading);
+    AppendKey(key, multisample_state_.alphaToCoverageEnable);
+    AppendKey(key, multisample_state_.alphaToOneEnable);
+
+    return key;
+}
+
+uint64_t PipelineBuilder::computeStateHash()
+{
+    auto key = computeStateKey();
+    return HashBytes(key.data(), key.size());
+}
+
+std::vector<VkDescriptorSetLayoutBinding> PipelineBuilder::getReflectedBindings(uint32_t set, bool dynamicUniformBuffers) const
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+    for (const auto& reflection : shader_reflections_) {
+        for (const auto& reflected : reflection.bindings) {
+            if (reflected.set != set) {
+                continue;
+            }
+
+            auto binding = reflected.binding;
+            if (dynamicUniformBuffers && binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            }
+            if (binding.descriptorCount == 0) {
+                LOG_WARN("Runtime sized descriptor array at set {} binding {} is reflected as a single descriptor.",
+                         set, binding.binding);
+                binding.descriptorCount = 1;
+            }
+
+            // 多个阶段使用同一个绑定时合并阶段标志
+            auto it = std::find_if(bindings.begin(), bindings.end(),
+                                   [&binding](const auto& b) { return b.binding == binding.binding; });
+            if (it == bindings.end()) {
+                bindings.push_back(binding);
+                continue;
+            }
+
+            if (it->descriptorType != binding.descriptorType || it->descriptorCount != binding.descriptorCount) {
+                LOG_ERROR("Descriptor mismatch between shader stages at set {} binding {}.", set, binding.binding);
+            }
+            it->stageFlags |= binding.stageFlags;
+        }
+    }
+
+    return bindings;
+}
+
+void PipelineBuilder::setDescriptorSetLayout(uint32_t set, VkDescriptorSetLayout descriptorSetLayout)
+{
+    set_layout_overrides_[set] = descriptorSetLayout;
+}
+
+VkDescriptorSetLayout PipelineBuilder::getDescriptorSetLayoutOverride(uint32_t set) const
+{
+    auto it = set_layout_overrides_.find(set);
+    return it != set_layout_overrides_.end() ? it->second : VK_NULL_HANDLE;
+}
+
+uint32_t PipelineBuilder::getReflectedSetCount() const
+{
+    uint32_t count = 0;
+    for (const auto& [set, layout] : set_layout_overrides_) {
+        count = std::max(count, set + 1);
+    }
+    for (const auto& reflection : shader_reflections_) {
+        for (const auto& reflected : reflection.bindings) {
+            count = std::max(count, reflected.set + 1);
+        }
+    }
+
+    return count;
+}
+
+std::vector<VkPushConstantRange> PipelineBuilder::getReflectedPushConstantRanges() const
+{
+    VkPushConstantRange merged{};
+    merged.offset = UINT32_MAX;
+    uint32_t end = 0;
+
+    for (const auto& reflection : shader_reflections_) {
+        for (const auto& range : reflection.pushConstantRanges) {
+            merged.stageFlags |= range.stageFlags;
+            merged.offset = std::min(merged.offset, range.offset);
+            end = std::max(end, range.offset + range.size);
+        }
+    }
+
+    if (merged.stageFlags == 0) {
+        return {};
+    }
+
+    merged.size = end - merged.offset;
+    return {merged};
+}
+
+void PipelineBuilder::setPushConstantRanges(const std::vector<VkPushConstantRange>& ranges)
+{
+    const auto maxSize = device_->getProperties().device_properties.limits.maxPushConstantsSize;
+
+    uint32_t end = 0;
+    for (const auto& range : ranges) {
+        end = std::max(end, range.offset + range.size);
+    }
+
+    if (end > maxSize) {
+        LOG_ERROR("Push constant ranges need {} bytes, but the device only supports {} bytes.", end, maxSize);
+        return;
+    }
+    if (end > MaxPortablePushConstantSize) {
+        LOG_WARN("Push constant ranges need {} bytes, some devices only support {} bytes.", end, MaxPortablePushConstantSize);
+    }
+
+    push_constant_ranges_ = ranges;
+}
+
+std::vector<VkPushConstantRange> PipelineBuilder::getPushConstantRanges() const
+{
+    if (!push_constant_ranges_.empty()) {
+        return push_constant_ranges_;
+    }
+
+    return getReflectedPushConstantRanges();
+}
+
+void PipelineBuilder::setDefaultStates()
 {
     if (shader_stages_.empty()) {
         LOG_FATAL("No available shader, set the shader before create pipeline");
     }
 
+    // 没有设置顶点输入时没有顶点缓冲区，例如顶点写在着色器中的情况；需要反射的输入时调用 setVertexInputFromReflection
     if (EntityNotSet(vertex_input_state_)) {
         vertex_input_state_ = pipelineVertexInputStateCreateInfo();
         vertex_input_state_.vertexBindingDescriptionCount = 0;
@@ -120,26 +388,25 @@ void PipelineBuilder::createPipeline(VkRenderPass renderPass, VkPipelineLayout p
         setRasterizationState();
     }
 
-    std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(1);
-    blendAttachmentStates[0] = pipelineColorBlendAttachmentState(static_cast<VkColorComponentFlagBits>(0xf), VK_FALSE);
-    blendAttachmentStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
-    blendAttachmentStates[0].colorBlendOp = VK_BLEND_OP_ADD;
-    blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     if (EntityNotSet(color_blend_state_state_)) {
+        std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(1);
+        blendAttachmentStates[0] = pipelineColorBlendAttachmentState(static_cast<VkColorComponentFlagBits>(0xf), VK_FALSE);
+        blendAttachmentStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
+        blendAttachmentStates[0].colorBlendOp = VK_BLEND_OP_ADD;
+        blendAttachmentStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        blendAttachmentStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        blendAttachmentStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        blendAttachmentStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+
         setColorBlendState(blendAttachmentStates);
     }
 
-    std::vector<VkDynamicState> dynamicStateEnables = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR,
-        VK_DYNAMIC_STATE_BLEND_CONSTANTS
-    };
     if (EntityNotSet(dynamic_state_)) {
-
-        setDynamicState(dynamicStateEnables);
+        setDynamicState({
+                            VK_DYNAMIC_STATE_VIEWPORT,
+                            VK_DYNAMIC_STATE_SCISSOR,
+                            VK_DYNAMIC_STATE_BLEND_CONSTANTS
+                        });
     }
 
     if (EntityNotSet(viewport_state_)) {
@@ -153,29 +420,51 @@ void PipelineBuilder::createPipeline(VkRenderPass renderPass, VkPipelineLayout p
     if (EntityNotSet(multisample_state_)) {
         setMultisampleState();
     }
+}
+
+VkPipeline PipelineBuilder::compile(VkRenderPass renderPass, VkPipelineLayout pipelineLayout) const
+{
+    // 构建器可能被拷贝过，所以指针要重新指向自己保存的数据
+    auto vertexInputState = vertex_input_state_;
+    vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_bindings_.size());
+    vertexInputState.pVertexBindingDescriptions = vertex_bindings_.data();
+    vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attributes_.size());
+    vertexInputState.pVertexAttributeDescriptions = vertex_attributes_.data();
+
+    auto colorBlendState = color_blend_state_state_;
+    colorBlendState.attachmentCount = static_cast<uint32_t>(blend_attachments_.size());
+    colorBlendState.pAttachments = blend_attachments_.data();
+
+    auto dynamicState = dynamic_state_;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamic_states_.size());
+    dynamicState.pDynamicStates = dynamic_states_.data();
 
     auto pipelineInfo = pipelineCreateInfo();
     pipelineInfo.stageCount = static_cast<uint32_t>(shader_stages_.size());
     pipelineInfo.pStages = shader_stages_.data();
-    pipelineInfo.pVertexInputState = &vertex_input_state_;
+    pipelineInfo.pVertexInputState = &vertexInputState;
     pipelineInfo.pInputAssemblyState = &input_assembly_state_;
     pipelineInfo.pRasterizationState = &raster_state_;
     pipelineInfo.pTessellationState = nullptr;
-    pipelineInfo.pColorBlendState = &color_blend_state_state_;
+    pipelineInfo.pColorBlendState = &colorBlendState;
     pipelineInfo.pMultisampleState = &multisample_state_;
     pipelineInfo.pViewportState = &viewport_state_;
     pipelineInfo.pDepthStencilState = &depth_stencil_state_;
-    pipelineInfo.pDynamicState = &dynamic_state_;
+    pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
 
+    // 流水线缓存是内部同步的，可以在多个线程上同时使用
+    VkPipeline pipeline = VK_NULL_HANDLE;
     VK_CHECK(vkCreateGraphicsPipelines(device_->getHandle(),
                                        device_->getPipelineCache(),
                                        1,
                                        &pipelineInfo,
                                        nullptr,
                                        &pipeline));
+
+    return pipeline;
 }
 
 } // yu::vk
\ No newline at end of file
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <future>
+#include <common/task_queue.hpp>
 #include "device.hpp"
 
 namespace yu::vk {
@@ -20,6 +22,11 @@ public:
     void setShader(const std::vector<std::string_view>& shaders);
     void setVertexInputState(const std::vector<VkVertexInputBindingDescription>& binding,
                              const std::vector<VkVertexInputAttributeDescription>& layout);
+    /**
+     * @brief 按照顶点着色器反射的输入生成单个紧密排列的顶点绑定，需要在 setShader 之后调用；
+     *        没有反射到顶点输入时返回 false，顶点输入保持不变
+     */
+    bool setVertexInputFromReflection();
     void setInputAssemblyState(VkBool32 bPrimitiveRestart = VK_FALSE,
                                VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
@@ -36,13 +43,67 @@ public:
     void setMultisampleState(VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT);
 
     void createPipeline(VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkPipeline& pipeline);
+
+    /**
+     * @brief 把流水线的编译提交到工作线程上，返回的 future 在编译完成后给出流水线句柄。
+     *        提交时会拷贝当前的状态，之后对构建器的修改不会影响这次编译
+     */
+    std::shared_future<VkPipeline> createPipelineAsync(TaskQueue& taskQueue,
+                                                       VkRenderPass renderPass,
+                                                       VkPipelineLayout pipelineLayout);
+
+    // 等待所有异步编译的任务结束
+    void waitForPendingPipelines();
+
+    /**
+     * @brief 计算构建器全部状态的哈希，包括着色器的 SPIR-V 内容，不包括渲染通道和流水线布局。
+     *        没有设置的状态会先被填上默认值，所以与实际创建出的流水线一致
+     */
+    uint64_t computeStateHash();
+    // 参与哈希的全部状态，着色器以 SPIR-V 内容的哈希表示，用于在缓存命中时确认状态确实相同
+    std::vector<uint8_t> computeStateKey();
+
+    /**
+     * @brief 合并各个着色器阶段反射得到的某个描述符集的绑定。框架中的常量通过 DynamicBuffer 以动态偏移绑定，
+     *        所以 uniform buffer 默认反射为 UNIFORM_BUFFER_DYNAMIC
+     */
+    std::vector<VkDescriptorSetLayoutBinding> getReflectedBindings(uint32_t set, bool dynamicUniformBuffers = true) const;
+    uint32_t getReflectedSetCount() const;
+
+    // 合并各个阶段的推送常量，得到覆盖所有阶段的一个范围
+    std::vector<VkPushConstantRange> getReflectedPushConstantRanges() const;
+
+    /**
+     * @brief 声明流水线布局中的推送常量范围，用来传递每次绘制都会变化的少量数据，例如物体的变换矩阵。
+     *        所有设备都至少支持 MaxPortablePushConstantSize 字节，超过时会检查设备的限制
+     */
+    void setPushConstantRanges(const std::vector<VkPushConstantRange>& ranges);
+    // 声明的推送常量范围，没有声明时返回反射得到的范围
+    std::vector<VkPushConstantRange> getPushConstantRanges() const;
+
+    static constexpr uint32_t MaxPortablePushConstantSize = 128;
+
+    /**
+     * @brief 指定某个描述符集使用外部的布局而不是反射生成的布局，例如无绑定纹理表
+     */
+    void setDescriptorSetLayout(uint32_t set, VkDescriptorSetLayout descriptorSetLayout);
+    VkDescriptorSetLayout getDescriptorSetLayoutOverride(uint32_t set) const;
+
 private:
+    void setDefaultStates();
+    VkPipeline compile(VkRenderPass renderPass, VkPipelineLayout pipelineLayout) const;
 
 private:
     const VulkanDevice* device_ = nullptr;
 
     std::vector<VkShaderModule> shader_modules_;
     std::vector<VkPipelineShaderStageCreateInfo> shader_stages_;
+    // 每个着色器 SPIR-V 代码的哈希
+    std::vector<uint64_t> shader_hashes_;
+    // 每个着色器的反射信息
+    std::vector<ShaderReflection> shader_reflections_;
+    std::unordered_map<uint32_t, VkDescriptorSetLayout> set_layout_overrides_;
+    std::vector<VkPushConstantRange> push_constant_ranges_;
 
     VkPipelineVertexInputStateCreateInfo vertex_input_state_{};
     VkPipelineInputAssemblyStateCreateInfo input_assembly_state_{};
@@ -55,6 +116,14 @@ private:
 
     VkPipelineDepthStencilStateCreateInfo depth_stencil_state_{};
     VkPipelineMultisampleStateCreateInfo multisample_state_{};
+
+    // 创建信息中指针所指向的数据由构建器自己保存，编译时再设置指针，这样构建器可以被安全地拷贝到工作线程
+    std::vector<VkVertexInputBindingDescription> vertex_bindings_;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes_;
+    std::vector<VkPipelineColorBlendAttachmentState> blend_attachments_;
+    std::vector<VkDynamicState> dynamic_states_;
+
+    std::vector<std::shared_future<VkPipeline>> pending_pipelines_;
 };
 
 } // yu::vk
\ No newline at end of file
@@ -0,0 +1,160 @@
+﻿#include <logger.hpp>
+#include <common/hash.hpp>
+#include "pipeline_registry.hpp"
+#include "initializers.hpp"
+#include "error.hpp"
+
+namespace yu::vk {
+
+void PipelineRegistry::create(const VulkanDevice& device)
+{
+    device_ = &device;
+    hit_count_ = 0;
+    miss_count_ = 0;
+}
+
+void PipelineRegistry::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!pipelines_.empty() || !layouts_.empty()) {
+        LOG_WARN("Pipeline registry still has {} pipelines and {} layouts in use.", pipelines_.size(), layouts_.size());
+    }
+
+    for (auto& [key, entry] : pipelines_) {
+        vkDestroyPipeline(device_->getHandle(), entry.handle, nullptr);
+    }
+    pipelines_.clear();
+    pipeline_keys_.clear();
+
+    for (auto& [key, entry] : layouts_) {
+        vkDestroyPipelineLayout(device_->getHandle(), entry.handle, nullptr);
+    }
+    layouts_.clear();
+    layout_keys_.clear();
+}
+
+VkPipelineLayout PipelineRegistry::acquireLayout(VkDescriptorSetLayout descriptorSetLayout,
+                                                 const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+    if (descriptorSetLayout != VK_NULL_HANDLE) {
+        return acquireLayout(std::vector{descriptorSetLayout}, pushConstantRanges);
+    }
+
+    return acquireLayout(std::vector<VkDescriptorSetLayout>{}, pushConstantRanges);
+}
+
+VkPipelineLayout PipelineRegistry::acquireLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts,
+                                                 const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+    std::vector<uint8_t> state;
+    AppendKey(state, descriptorSetLayouts.size());
+    for (auto setLayout : descriptorSetLayouts) {
+        AppendKey(state, setLayout);
+    }
+    AppendKey(state, pushConstantRanges.size());
+    for (const auto& range : pushConstantRanges) {
+        AppendKey(state, range);
+    }
+    uint64_t key = HashBytes(state.data(), state.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (auto it = FindEntry(layouts_, key, state); it != layouts_.end()) {
+        it->second.refCount += 1;
+        return it->second.handle;
+    }
+
+    auto pipelineLayoutInfo = pipelineLayoutCreateInfo(static_cast<uint32_t>(descriptorSetLayouts.size()));
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+    VkPipelineLayout pipelineLayout;
+    VK_CHECK(vkCreatePipelineLayout(device_->getHandle(), &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+    layouts_[key] = {pipelineLayout, 1, std::move(state)};
+    layout_keys_[pipelineLayout] = key;
+
+    return pipelineLayout;
+}
+
+void PipelineRegistry::releaseLayout(VkPipelineLayout pipelineLayout)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto keyIt = layout_keys_.find(pipelineLayout);
+    if (keyIt == layout_keys_.end()) {
+        LOG_ERROR("Pipeline layout is not owned by the registry.");
+        return;
+    }
+
+    auto& entry = layouts_[keyIt->second];
+    if (--entry.refCount == 0) {
+        vkDestroyPipelineLayout(device_->getHandle(), entry.handle, nullptr);
+        layouts_.erase(keyIt->second);
+        layout_keys_.erase(keyIt);
+    }
+}
+
+VkPipeline PipelineRegistry::acquirePipeline(PipelineBuilder& pipelineBuilder,
+                                             VkRenderPass renderPass,
+                                             VkPipelineLayout pipelineLayout)
+{
+    auto state = pipelineBuilder.computeStateKey();
+    AppendKey(state, renderPass);
+    AppendKey(state, pipelineLayout);
+    const uint64_t hash = HashBytes(state.data(), state.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        uint64_t key = hash;
+        if (auto it = FindEntry(pipelines_, key, state); it != pipelines_.end()) {
+            it->second.refCount += 1;
+            hit_count_ += 1;
+            return it->second.handle;
+        }
+    }
+
+    // 编译比较耗时，不持有锁，这样其他线程可以同时取得已经存在的流水线
+    VkPipeline pipeline;
+    pipelineBuilder.createPipeline(renderPass, pipelineLayout, pipeline);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 其他线程可能已经创建了同样的流水线，此时丢弃自己创建的；解锁期间探测的空位也可能已被占用，重新查找
+    uint64_t key = hash;
+    if (auto it = FindEntry(pipelines_, key, state); it != pipelines_.end()) {
+        vkDestroyPipeline(device_->getHandle(), pipeline, nullptr);
+        it->second.refCount += 1;
+        hit_count_ += 1;
+        return it->second.handle;
+    }
+
+    pipelines_[key] = {pipeline, 1, std::move(state)};
+    pipeline_keys_[pipeline] = key;
+    miss_count_ += 1;
+
+    return pipeline;
+}
+
+void PipelineRegistry::releasePipeline(VkPipeline pipeline)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto keyIt = pipeline_keys_.find(pipeline);
+    if (keyIt == pipeline_keys_.end()) {
+        LOG_ERROR("Pipeline is not owned by the registry.");
+        return;
+    }
+
+    auto& entry = pipelines_[keyIt->second];
+    if (--entry.refCount == 0) {
+        vkDestroyPipeline(device_->getHandle(), entry.handle, nullptr);
+        pipelines_.erase(keyIt->second);
+        pipeline_keys_.erase(keyIt);
+    }
+}
+
+} // yu::vk
\ No newline at end of file
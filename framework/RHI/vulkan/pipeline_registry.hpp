@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include "device.hpp"
+#include "pipeline_builder.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 流水线注册表，按照构建器状态的哈希复用已经创建的流水线，流水线布局按照描述符布局复用。
+ *        渲染通道以句柄参与哈希，兼容但不是同一个的渲染通道不会共享流水线
+ */
+class PipelineRegistry
+{
+public:
+    void create(const VulkanDevice& device);
+    void destroy();
+
+    /**
+     * @brief 取得与描述符布局和推送常量范围对应的流水线布局，引用计数加一
+     */
+    VkPipelineLayout acquireLayout(VkDescriptorSetLayout descriptorSetLayout,
+                                   const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+    VkPipelineLayout acquireLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts,
+                                   const std::vector<VkPushConstantRange>& pushConstantRanges);
+    void releaseLayout(VkPipelineLayout pipelineLayout);
+
+    /**
+     * @brief 取得与构建器状态一致的流水线，不存在时才会创建，引用计数加一
+     */
+    VkPipeline acquirePipeline(PipelineBuilder& pipelineBuilder,
+                               VkRenderPass renderPass,
+                               VkPipelineLayout pipelineLayout);
+    void releasePipeline(VkPipeline pipeline);
+
+    size_t getPipelineCount() const { return pipelines_.size(); }
+    uint32_t getHitCount() const { return hit_count_; }
+    uint32_t getMissCount() const { return miss_count_; }
+
+private:
+    template<typename T>
+    struct Entry
+    {
+        T handle = VK_NULL_HANDLE;
+        uint32_t refCount = 0;
+        // 参与哈希的状态，命中时比较，防止哈希碰撞时返回别的对象
+        std::vector<uint8_t> state;
+    };
+
+    /**
+     * @brief 以哈希为起点线性探测，找到状态相同的项；没有时 key 停在第一个空位上，返回 end
+     */
+    template<typename T>
+    static typename std::unordered_map<uint64_t, Entry<T>>::iterator
+    FindEntry(std::unordered_map<uint64_t, Entry<T>>& entries, uint64_t& key, const std::vector<uint8_t>& state)
+    {
+        for (auto it = entries.find(key); it != entries.end(); it = entries.find(++key)) {
+            if (it->second.state == state) {
+                return it;
+            }
+        }
+        return entries.end();
+    }
+
+    const VulkanDevice* device_ = nullptr;
+
+    std::unordered_map<uint64_t, Entry<VkPipeline>> pipelines_;
+    std::unordered_map<VkPipeline, uint64_t> pipeline_keys_;
+
+    std::unordered_map<uint64_t, Entry<VkPipelineLayout>> layouts_;
+    std::unordered_map<VkPipelineLayout, uint64_t> layout_keys_;
+
+    std::mutex mutex_{};
+    uint32_t hit_count_ = 0;
+    uint32_t miss_count_ = 0;
+};
+
+} // yu::vk
\ No newline at end of file
@@ -18,40 +18,80 @@ void Renderer::create(const VulkanDevice& device, SwapChain* swapChain, const Mo
     const uint32_t commandBuffersPerFrame = 8;
     frame_commands_.create(device, swapChain->getFrameCount(), commandBuffersPerFrame);
 
-    // 创建动态的常量缓冲区，用于设定 uniform、索引、顶点数据
-    const uint32_t constantBuffersMemSize = 200 * 1024 * 1024;
-    constant_buffer_.create(device, swapChain->getFrameCount(), constantBuffersMemSize, "Uniforms");
+    // 创建动态的常量缓冲区，用于设定 uniform、索引、顶点数据；实际用量可以通过 getUsageStats 查看
+    const uint32_t constantBuffersMemSize = 16 * 1024 * 1024;
+    constant_buffer_.create(device, swapChain->getFrameCount(), constantBuffersMemSize, "Uniforms", allow_constant_buffer_grow_);
 
-    // 创建描述符堆，用来创建相应的描述符
+    // 创建描述符堆，用来创建相应的描述符，数量为单个池页的大小，用完时会追加新的池页
     const uint32_t cbvDescriptorCount = 2000;
     const uint32_t srvDescriptorCount = 8000;
     const uint32_t samplerDescriptorCount = 20;
     const uint32_t uavDescriptorCount = 10;
-    descriptor_pool_.create(device, cbvDescriptorCount, srvDescriptorCount, samplerDescriptorCount, uavDescriptorCount);
-
-    // 创建一个顶点缓冲区，用于上传顶点、索引数据
+    descriptor_pool_.create(device,
+                            cbvDescriptorCount,
+                            srvDescriptorCount,
+                            samplerDescriptorCount,
+                            uavDescriptorCount,
+                            swapChain->getFrameCount());
+
+    // 创建描述符集缓存，绑定内容相同的描述符集只写入一次
+    descriptor_set_cache_.create(device, descriptor_pool_, swapChain->getFrameCount());
+    constant_buffer_.setDescriptorSetCache(&descriptor_set_cache_);
+
+    // 创建无绑定纹理表
+    if (device.getProperties().support_descriptor_indexing) {
+        bindless_table_ = std::make_unique<BindlessTable>();
+        bindless_table_->create(device);
+    }
+
+    // 创建上传堆，用于向 GPU 上传资源，例如图片；上传堆是环形缓冲区，只需要容纳同时在上传的数据
+    const uint32_t uploadHeapMemSize = 128 * 1024 * 1024;
+    upload_heap_.create(device, uploadHeapMemSize, use_transfer_queue_);
+
+    // 创建一个顶点缓冲区，用于上传顶点、索引数据，数据经由上传堆暂存
     const uint32_t vertexMemSize = (1 * 128) * 1024 * 1024;
-    static_buffer_.create(device, vertexMemSize, true, "VertexData");
-
-    // 创建上传堆，用于向 GPU 上传资源，例如图片
-    const uint32_t uploadHeapMemSize = 1000 * 1024 * 1024;
-    upload_heap_.create(device, uploadHeapMemSize);
+    static_buffer_.create(device, swapChain->getFrameCount(), vertexMemSize, upload_heap_, "VertexData");
     
+    // 创建流水线注册表，状态相同的流水线只会被编译一次
+    pipeline_registry_.create(device);
+    descriptor_layout_cache_.create(device);
+
     // 创建 GPU timer
     gpu_timer_.create(device, swapChain->getFrameCount());
+
+    // 时间线的记录器，GPU 时间戳在帧数个帧之后读回
+    trace_recorder_.create(device, swapChain->getFrameCount());
+    gpu_timer_.setTraceRecorder(&trace_recorder_);
+
+    // 创建后台任务线程，留一个核心给渲染线程；工作线程使用单独保留的槽位，不会占用渲染线程和加载线程的槽位
+    const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+    task_queue_.create(std::clamp(hardwareThreads > 1 ? hardwareThreads - 1 : 1, 1u, MaxWorkerThreadSlots));
 }
 
 void Renderer::destroy()
 {
 //    async_pool_.flush();
+    task_queue_.destroy();
     frame_commands_.destroy();
     constant_buffer_.destroy();
+    static_buffer_.destroy(&descriptor_set_cache_);
+    descriptor_set_cache_.destroy();
+    if (bindless_table_) {
+        bindless_table_->destroy();
+        bindless_table_.reset();
+    }
     descriptor_pool_.destroy();
-    static_buffer_.destroy();
     upload_heap_.destory();
+    gpu_timer_.setTraceRecorder(nullptr);
     gpu_timer_.destroy();
+    trace_recorder_.destroy();
+    pipeline_registry_.destroy();
+    descriptor_layout_cache_.destroy();
     
-    imGui_->destroy();
+    // 无窗口运行时不会创建 UI
+    if (imGui_) {
+        imGui_->destroy();
+    }
 }
 
 void Renderer::createWindowSizeDependency(uint32_t width, uint32_t height)
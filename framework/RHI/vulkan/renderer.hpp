@@ -14,8 +14,13 @@
 #include "upload_heap.hpp"
 #include "imgui.hpp"
 #include "gpu_time.hpp"
+#include "pipeline_registry.hpp"
+#include "descriptor_layout_cache.hpp"
+#include "descriptor_set_cache.hpp"
+#include "bindless_table.hpp"
 
 #include <common/mouse_tracker.hpp>
+#include <common/task_queue.hpp>
 
 namespace yu::vk {
 
@@ -23,7 +28,7 @@ class Renderer
 {
 public:
     Renderer() = default;
-    ~Renderer() = default;
+    virtual ~Renderer() = default;
 
     virtual void create(const VulkanDevice& device, SwapChain* swapChain, const MouseTracker& mouseTracker);
     virtual void destroy();
@@ -39,6 +44,10 @@ public:
     void createUI(const VulkanInstance& instance, GLFWwindow* window);
     
     const std::vector<TimeStamp>& getTimings() const { return time_stamps_; }
+    const std::vector<GPUScopeStats>& getScopeStats() const { return gpu_timer_.getScopeStats(); }
+    void resetScopeStats() { gpu_timer_.resetScopeStats(); }
+    TraceRecorder& getTraceRecorder() { return trace_recorder_; }
+    DynamicBuffer::UsageStats getConstantBufferStats() const { return constant_buffer_.getUsageStats(); }
     
 protected:
     const VulkanDevice* device_ = nullptr;
@@ -47,9 +56,20 @@ protected:
 
     FrameCommands frame_commands_;
     DynamicBuffer constant_buffer_;
+    // 常量缓冲区空间不足时是否追加缓冲区，需要在调用 Renderer::create 之前设置；
+    // 追加的缓冲区与环形缓冲区不是同一个 VkBuffer，只有按照 allocConstantBuffer 返回的缓冲区取得描述符集的渲染器才能打开
+    bool allow_constant_buffer_grow_ = false;
     DescriptorPool descriptor_pool_;
+    DescriptorSetCache descriptor_set_cache_;
+    // 设备支持描述符索引时才会创建
+    std::unique_ptr<BindlessTable> bindless_table_;
     StaticBuffer static_buffer_;
     UploadHeap upload_heap_;
+    // 上传堆是否提交到传输队列，需要在调用 Renderer::create 之前设置；
+    // 打开后渲染器要在每一帧的命令缓冲区中调用 upload_heap_.recordAcquireBarriers 取回资源的所有权
+    bool use_transfer_queue_ = false;
+    PipelineRegistry pipeline_registry_;
+    DescriptorLayoutCache descriptor_layout_cache_;
 
     VkRect2D rect_scissor_{};
     VkViewport viewport_{};
@@ -59,9 +79,13 @@ protected:
     
     GPUTimeStamp gpu_timer_{}; 
     std::vector<TimeStamp> time_stamps_;
+    TraceRecorder trace_recorder_;
     
     std::unique_ptr<ImGUI> imGui_ = nullptr;
     San::AsyncPool async_pool_;
+
+    // 用于异步编译流水线等后台任务
+    TaskQueue task_queue_;
 };
 
 } // namespace yu::vk
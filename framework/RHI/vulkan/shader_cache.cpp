@@ -0,0 +1,121 @@
+﻿#include <logger.hpp>
+#include <common/hash.hpp>
+#include "shader_cache.hpp"
+#include "vulkan_utils.hpp"
+
+namespace yu::vk {
+
+void ShaderCache::create(VkDevice device)
+{
+    device_ = device;
+}
+
+void ShaderCache::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!modules_.empty()) {
+        LOG_WARN("Shader cache still has {} modules in use.", modules_.size());
+    }
+
+    for (auto& [module, entry] : modules_) {
+        vkDestroyShaderModule(device_, module, nullptr);
+    }
+    modules_.clear();
+    hash_modules_.clear();
+    file_modules_.clear();
+}
+
+bool ShaderCache::acquire(std::string_view fileName, VkShaderModule& shaderModule, uint64_t& codeHash)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 文件已经读取过，直接使用记录的模块
+    if (auto it = file_modules_.find(std::string{fileName}); it != file_modules_.end()) {
+        auto& entry = modules_.at(it->second);
+        entry.refCount += 1;
+        shaderModule = it->second;
+        codeHash = entry.hash;
+        return true;
+    }
+
+    auto shaderCode = LoadShaderCode(fileName);
+    if (shaderCode.empty()) {
+        return false;
+    }
+
+    codeHash = HashBytes(shaderCode.data(), shaderCode.size());
+
+    // 路径不同但内容相同的文件共享模块
+    auto [begin, end] = hash_modules_.equal_range(codeHash);
+    for (auto it = begin; it != end; ++it) {
+        auto& entry = modules_.at(it->second);
+        if (entry.code == shaderCode) {
+            entry.refCount += 1;
+            shaderModule = it->second;
+            file_modules_[std::string{fileName}] = shaderModule;
+            return true;
+        }
+    }
+
+    shaderModule = CreateShaderModule(shaderCode, device_);
+    if (shaderModule == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    auto& entry = modules_[shaderModule];
+    entry.hash = codeHash;
+    entry.refCount = 1;
+    if (!ReflectShader(reinterpret_cast<const uint32_t*>(shaderCode.data()), shaderCode.size() / sizeof(uint32_t),
+                       entry.reflection)) {
+        LOG_WARN("Failed to reflect shader: {}.", fileName);
+    }
+    entry.code = std::move(shaderCode);
+
+    hash_modules_.emplace(codeHash, shaderModule);
+    file_modules_[std::string{fileName}] = shaderModule;
+
+    return true;
+}
+
+const ShaderReflection* ShaderCache::getReflection(VkShaderModule shaderModule)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = modules_.find(shaderModule);
+    if (it == modules_.end()) {
+        return nullptr;
+    }
+
+    return &it->second.reflection;
+}
+
+void ShaderCache::release(VkShaderModule shaderModule)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = modules_.find(shaderModule);
+    if (it == modules_.end()) {
+        LOG_ERROR("Shader module is not owned by the shader cache.");
+        return;
+    }
+
+    if (--it->second.refCount == 0) {
+        vkDestroyShaderModule(device_, shaderModule, nullptr);
+
+        // 模块销毁后需要重新读取文件，所以也要移除路径的记录
+        std::erase_if(file_modules_, [shaderModule](const auto& item) { return item.second == shaderModule; });
+
+        auto [begin, end] = hash_modules_.equal_range(it->second.hash);
+        for (auto hashIt = begin; hashIt != end; ++hashIt) {
+            if (hashIt->second == shaderModule) {
+                hash_modules_.erase(hashIt);
+                break;
+            }
+        }
+
+        modules_.erase(it);
+    }
+}
+
+} // yu::vk
\ No newline at end of file
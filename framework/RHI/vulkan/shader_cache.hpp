@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+#include "shader_reflection.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 设备级别的着色器模块缓存，同一个 spv 文件在进程中只读取和创建一次，内容相同的文件共享同一个模块。
+ *        模块带有引用计数，最后一个使用者归还时才会销毁
+ */
+class ShaderCache
+{
+public:
+    void create(VkDevice device);
+    void destroy();
+
+    /**
+     * @brief 取得着色器文件对应的模块和 SPIR-V 代码的哈希，引用计数加一；读取失败时返回 false
+     */
+    bool acquire(std::string_view fileName, VkShaderModule& shaderModule, uint64_t& codeHash);
+    void release(VkShaderModule shaderModule);
+
+    // 模块创建时反射得到的资源信息，模块被归还之前一直有效
+    const ShaderReflection* getReflection(VkShaderModule shaderModule);
+
+    size_t getModuleCount() const { return modules_.size(); }
+
+private:
+    struct Entry
+    {
+        uint64_t hash = 0;
+        uint32_t refCount = 0;
+        // 保存完整的代码，哈希相同时比较，哈希冲突的两个文件不会共用模块
+        std::vector<char> code;
+        ShaderReflection reflection;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+
+    // 文件路径 -> 模块
+    std::unordered_map<std::string, VkShaderModule> file_modules_;
+    // 代码哈希 -> 模块，哈希冲突时一个哈希对应多个模块
+    std::unordered_multimap<uint64_t, VkShaderModule> hash_modules_;
+    std::unordered_map<VkShaderModule, Entry> modules_;
+
+    std::mutex mutex_{};
+};
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,559 @@
+﻿#include <logger.hpp>
+#include "shader_reflection.hpp"
+#include "vulkan_utils.hpp"
+
+namespace yu::vk {
+
+namespace {
+
+// 只列出反射用到的 SPIR-V 常量，数值见 SPIR-V 规范
+namespace spv {
+
+constexpr uint32_t MagicNumber = 0x07230203;
+// 规范中结构体成员数量的上限
+constexpr uint32_t MaxStructMembers = 16383;
+
+enum Op : uint32_t
+{
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum Decoration : uint32_t
+{
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+enum StorageClass : uint32_t
+{
+    StorageClassUniformConstant = 0,
+    StorageClassInput = 1,
+    StorageClassUniform = 2,
+    StorageClassPushConstant = 9,
+    StorageClassStorageBuffer = 12,
+};
+
+enum Dim : uint32_t
+{
+    DimBuffer = 5,
+    DimSubpassData = 6,
+};
+
+} // namespace spv
+
+struct SpvId
+{
+    uint32_t opcode = 0;
+    // 类型指令的操作数（不含结果 id）
+    std::vector<uint32_t> operands;
+
+    uint32_t set = UINT32_MAX;
+    uint32_t binding = UINT32_MAX;
+    uint32_t location = UINT32_MAX;
+    uint32_t arrayStride = 0;
+    bool builtIn = false;
+    bool block = false;
+    bool bufferBlock = false;
+
+    // 结构体成员的偏移和矩阵步长
+    std::vector<uint32_t> memberOffsets;
+    std::vector<uint32_t> memberMatrixStrides;
+};
+
+class SpvParser
+{
+public:
+    explicit SpvParser(std::vector<SpvId>& ids) : ids_{ids}, sizes_(ids.size(), UnknownSize) {}
+
+    // 类型的操作数都已经经过 validateTypes 的检查。每个类型的大小只计算一次，
+    // 避免成员共享同一个类型时重复展开；损坏的代码中出现循环引用时大小按 0 处理
+    uint32_t typeSize(uint32_t typeId, uint32_t matrixStride = 0, uint32_t depth = 0) const
+    {
+        if (depth > MaxTypeDepth) {
+            return 0;
+        }
+
+        // 带矩阵步长的大小取决于所在的结构体成员，不缓存
+        if (matrixStride != 0 && ids_[typeId].opcode == spv::OpTypeMatrix) {
+            return computeTypeSize(typeId, matrixStride, depth);
+        }
+
+        auto& size = sizes_[typeId];
+        if (size == PendingSize) {
+            return 0;
+        }
+        if (size == UnknownSize) {
+            size = PendingSize;
+            size = computeTypeSize(typeId, 0, depth);
+        }
+        return size;
+    }
+
+    uint32_t computeTypeSize(uint32_t typeId, uint32_t matrixStride, uint32_t depth) const
+    {
+        const auto& type = ids_[typeId];
+        switch (type.opcode) {
+            case spv::OpTypeBool:
+                return 4;
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+                return type.operands[0] / 8;
+            case spv::OpTypeVector:
+                return typeSize(type.operands[0], 0, depth + 1) * type.operands[1];
+            case spv::OpTypeMatrix:
+                return (matrixStride != 0 ? matrixStride : typeSize(type.operands[0], 0, depth + 1)) * type.operands[1];
+            case spv::OpTypeArray:
+                return (type.arrayStride != 0 ? type.arrayStride : typeSize(type.operands[0], 0, depth + 1)) * constant(type.operands[1]);
+            case spv::OpTypeStruct: {
+                uint32_t size = 0;
+                for (size_t i = 0; i < type.operands.size(); ++i) {
+                    const uint32_t offset = i < type.memberOffsets.size() ? type.memberOffsets[i] : 0;
+                    const uint32_t stride = i < type.memberMatrixStrides.size() ? type.memberMatrixStrides[i] : 0;
+                    size = std::max(size, offset + typeSize(type.operands[i], stride, depth + 1));
+                }
+                return size;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    uint32_t constant(uint32_t id) const
+    {
+        const auto& value = ids_[id];
+        return value.opcode == spv::OpConstant && !value.operands.empty() ? value.operands[0] : 1;
+    }
+
+    VkFormat vertexFormat(uint32_t typeId) const
+    {
+        const auto& type = ids_[typeId];
+
+        uint32_t count = 1;
+        const SpvId* component = &type;
+        if (type.opcode == spv::OpTypeVector) {
+            count = type.operands[1];
+            component = &ids_[type.operands[0]];
+        }
+        if (count == 0 || count > 4) {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        if (component->operands.empty() || component->operands[0] != 32) {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        static constexpr VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                                                    VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static constexpr VkFormat sintFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT,
+                                                   VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+        static constexpr VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT,
+                                                   VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+        if (component->opcode == spv::OpTypeFloat) {
+            return floatFormats[count - 1];
+        }
+        if (component->opcode == spv::OpTypeInt) {
+            return component->operands[1] != 0 ? sintFormats[count - 1] : uintFormats[count - 1];
+        }
+
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    bool descriptorType(uint32_t storageClass, uint32_t typeId, VkDescriptorType& type) const
+    {
+        const auto& spvType = ids_[typeId];
+
+        switch (spvType.opcode) {
+            case spv::OpTypeSampledImage:
+                type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                return true;
+            case spv::OpTypeSampler:
+                type = VK_DESCRIPTOR_TYPE_SAMPLER;
+                return true;
+            case spv::OpTypeImage: {
+                // 操作数：采样类型、维度、深度、数组、多重采样、是否采样、格式
+                const uint32_t dim = spvType.operands[1];
+                const uint32_t sampled = spvType.operands[5];
+                if (dim == spv::DimSubpassData) {
+                    type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                } else if (dim == spv::DimBuffer) {
+                    type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                } else {
+                    type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                }
+                return true;
+            }
+            case spv::OpTypeAccelerationStructureKHR:
+                type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+                return true;
+            case spv::OpTypeStruct:
+                if (storageClass == spv::StorageClassStorageBuffer || spvType.bufferBlock) {
+                    type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                } else {
+                    type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @brief 检查所有类型和常量的操作数数量，以及引用的 id 是否在范围内，之后的解析可以直接访问这些操作数
+     */
+    bool validateTypes() const
+    {
+        const auto bound = static_cast<uint32_t>(ids_.size());
+        auto has = [](const SpvId& id, size_t count) { return id.operands.size() >= count; };
+        auto valid = [bound](uint32_t id) { return id < bound; };
+
+        for (const auto& id : ids_) {
+            bool ok = true;
+            switch (id.opcode) {
+                case spv::OpTypeInt:
+                    ok = has(id, 2);
+                    break;
+                case spv::OpTypeFloat:
+                    ok = has(id, 1);
+                    break;
+                case spv::OpTypeVector:
+                case spv::OpTypeMatrix:
+                    ok = has(id, 2) && valid(id.operands[0]);
+                    break;
+                case spv::OpTypeImage:
+                    // 采样类型、维度、深度、数组、多重采样、是否采样、格式
+                    ok = has(id, 7) && valid(id.operands[0]);
+                    break;
+                case spv::OpTypeSampledImage:
+                case spv::OpTypeRuntimeArray:
+                    ok = has(id, 1) && valid(id.operands[0]);
+                    break;
+                case spv::OpTypeArray:
+                    ok = has(id, 2) && valid(id.operands[0]) && valid(id.operands[1]);
+                    break;
+                case spv::OpTypeStruct:
+                    ok = std::all_of(id.operands.begin(), id.operands.end(), valid);
+                    break;
+                case spv::OpTypePointer:
+                    ok = has(id, 2) && valid(id.operands[1]);
+                    break;
+                default:
+                    break;
+            }
+
+            if (!ok) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    static constexpr uint32_t MaxTypeDepth = 64;
+    static constexpr uint32_t UnknownSize = UINT32_MAX;
+    static constexpr uint32_t PendingSize = UINT32_MAX - 1;
+
+    std::vector<SpvId>& ids_;
+    mutable std::vector<uint32_t> sizes_;
+};
+
+VkShaderStageFlagBits ExecutionModelToStage(uint32_t executionModel)
+{
+    switch (executionModel) {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default: return VK_SHADER_STAGE_ALL;
+    }
+}
+
+} // namespace
+
+bool ReflectShader(const uint32_t* pCode, size_t wordCount, ShaderReflection& reflection)
+{
+    if (pCode == nullptr || wordCount < 5 || pCode[0] != spv::MagicNumber) {
+        LOG_ERROR("Invalid SPIR-V code.");
+        return false;
+    }
+
+    // 头部的第 4 个字是 id 的上界。编译器生成的 id 是紧凑的，上界不会超过代码的字数，
+    // 超过时当作损坏的代码处理，避免按照损坏的上界分配内存
+    const uint32_t bound = pCode[3];
+    if (bound == 0 || bound > wordCount) {
+        LOG_ERROR("Invalid id bound {} in SPIR-V code of {} words.", bound, wordCount);
+        return false;
+    }
+    std::vector<SpvId> ids(bound);
+
+    struct Variable
+    {
+        uint32_t id;
+        uint32_t typeId;
+        uint32_t storageClass;
+    };
+    std::vector<Variable> variables;
+
+    bool hasEntryPoint = false;
+
+    // 第一遍：收集类型、常量、变量和修饰
+    size_t offset = 5;
+    while (offset < wordCount) {
+        const uint32_t opcode = pCode[offset] & 0xffff;
+        const uint32_t count = pCode[offset] >> 16;
+        if (count == 0 || offset + count > wordCount) {
+            LOG_ERROR("Corrupted SPIR-V instruction stream.");
+            return false;
+        }
+        const uint32_t* ops = pCode + offset + 1;
+        // 指令的操作数数量（不含指令头）
+        const uint32_t operandCount = count - 1;
+        bool malformed = false;
+
+        switch (opcode) {
+            case spv::OpEntryPoint:
+                if (operandCount < 1) {
+                    malformed = true;
+                } else if (hasEntryPoint) {
+                    LOG_WARN("Shader has multiple entry points, only the first one is reflected.");
+                } else {
+                    reflection.stage = ExecutionModelToStage(ops[0]);
+                    hasEntryPoint = true;
+                }
+                break;
+            case spv::OpTypeBool:
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+            case spv::OpTypeVector:
+            case spv::OpTypeMatrix:
+            case spv::OpTypeImage:
+            case spv::OpTypeSampler:
+            case spv::OpTypeSampledImage:
+            case spv::OpTypeArray:
+            case spv::OpTypeRuntimeArray:
+            case spv::OpTypeStruct:
+            case spv::OpTypePointer:
+            case spv::OpTypeAccelerationStructureKHR:
+                if (operandCount < 1 || ops[0] >= bound) {
+                    malformed = true;
+                    break;
+                }
+                ids[ops[0]].opcode = opcode;
+                ids[ops[0]].operands.assign(ops + 1, ops + operandCount);
+                break;
+            case spv::OpConstant:
+                // 结果类型、结果 id、数值
+                if (operandCount < 3 || ops[1] >= bound) {
+                    malformed = true;
+                    break;
+                }
+                ids[ops[1]].opcode = opcode;
+                ids[ops[1]].operands.assign(ops + 2, ops + operandCount);
+                break;
+            case spv::OpVariable:
+                // 结果类型、结果 id、存储类型
+                if (operandCount < 3 || ops[0] >= bound || ops[1] >= bound) {
+                    malformed = true;
+                    break;
+                }
+                variables.push_back({ops[1], ops[0], ops[2]});
+                break;
+            case spv::OpDecorate: {
+                // 目标 id、修饰，带参数的修饰再多一个操作数
+                const bool needsArgument = operandCount >= 2 &&
+                    (ops[1] == spv::DecorationDescriptorSet || ops[1] == spv::DecorationBinding ||
+                     ops[1] == spv::DecorationLocation || ops[1] == spv::DecorationArrayStride);
+                if (operandCount < 2 || ops[0] >= bound || (needsArgument && operandCount < 3)) {
+                    malformed = true;
+                    break;
+                }
+                const uint32_t argument = needsArgument ? ops[2] : 0;
+                auto& id = ids[ops[0]];
+                switch (ops[1]) {
+                    case spv::DecorationDescriptorSet: id.set = argument; break;
+                    case spv::DecorationBinding: id.binding = argument; break;
+                    case spv::DecorationLocation: id.location = argument; break;
+                    case spv::DecorationArrayStride: id.arrayStride = argument; break;
+                    case spv::DecorationBuiltIn: id.builtIn = true; break;
+                    case spv::DecorationBlock: id.block = true; break;
+                    case spv::DecorationBufferBlock: id.bufferBlock = true; break;
+                    default: break;
+                }
+                break;
+            }
+            case spv::OpMemberDecorate: {
+                // 结构体 id、成员序号、修饰，偏移和矩阵步长再多一个操作数
+                const bool needsArgument = operandCount >= 3 &&
+                    (ops[2] == spv::DecorationOffset || ops[2] == spv::DecorationMatrixStride);
+                if (operandCount < 3 || ops[0] >= bound || ops[1] > spv::MaxStructMembers ||
+                    (needsArgument && operandCount < 4)) {
+                    malformed = true;
+                    break;
+                }
+
+                auto& id = ids[ops[0]];
+                const uint32_t member = ops[1];
+                if (ops[2] == spv::DecorationOffset) {
+                    id.memberOffsets.resize(std::max<size_t>(id.memberOffsets.size(), member + 1));
+                    id.memberOffsets[member] = ops[3];
+                } else if (ops[2] == spv::DecorationMatrixStride) {
+                    id.memberMatrixStrides.resize(std::max<size_t>(id.memberMatrixStrides.size(), member + 1));
+                    id.memberMatrixStrides[member] = ops[3];
+                } else if (ops[2] == spv::DecorationBuiltIn) {
+                    id.builtIn = true;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (malformed) {
+            LOG_ERROR("Malformed SPIR-V instruction (opcode {}) at word {}.", opcode, offset);
+            return false;
+        }
+
+        offset += count;
+    }
+
+    if (!hasEntryPoint) {
+        LOG_ERROR("SPIR-V code has no entry point.");
+        return false;
+    }
+
+    SpvParser parser{ids};
+    if (!parser.validateTypes()) {
+        LOG_ERROR("SPIR-V code has malformed type declarations.");
+        return false;
+    }
+
+    // 第二遍：根据变量的存储类型生成反射信息
+    for (const auto& variable : variables) {
+        const auto& pointer = ids[variable.typeId];
+        if (pointer.opcode != spv::OpTypePointer) {
+            continue;
+        }
+        uint32_t typeId = pointer.operands[1];
+        const auto& decoration = ids[variable.id];
+
+        switch (variable.storageClass) {
+            case spv::StorageClassUniformConstant:
+            case spv::StorageClassUniform:
+            case spv::StorageClassStorageBuffer: {
+                if (decoration.binding == UINT32_MAX) {
+                    break;
+                }
+
+                uint32_t descriptorCount = 1;
+                if (ids[typeId].opcode == spv::OpTypeArray) {
+                    descriptorCount = parser.constant(ids[typeId].operands[1]);
+                    typeId = ids[typeId].operands[0];
+                } else if (ids[typeId].opcode == spv::OpTypeRuntimeArray) {
+                    descriptorCount = 0;
+                    typeId = ids[typeId].operands[0];
+                }
+
+                VkDescriptorType type;
+                if (!parser.descriptorType(variable.storageClass, typeId, type)) {
+                    LOG_WARN("Unsupported descriptor type at binding {}.", decoration.binding);
+                    break;
+                }
+
+                ReflectedBinding binding{};
+                binding.set = decoration.set == UINT32_MAX ? 0 : decoration.set;
+                binding.binding.binding = decoration.binding;
+                binding.binding.descriptorType = type;
+                binding.binding.descriptorCount = descriptorCount;
+                binding.binding.stageFlags = reflection.stage;
+                reflection.bindings.push_back(binding);
+                break;
+            }
+            case spv::StorageClassPushConstant: {
+                const auto& type = ids[typeId];
+                uint32_t begin = UINT32_MAX;
+                for (auto memberOffset : type.memberOffsets) {
+                    begin = std::min(begin, memberOffset);
+                }
+                if (begin == UINT32_MAX) {
+                    begin = 0;
+                }
+
+                // 大小未知（循环或者不支持的类型）时，减去起始偏移会得到一个巨大的范围
+                uint32_t end = parser.typeSize(typeId);
+                if (end <= begin) {
+                    LOG_ERROR("Push constant block has an invalid size {} (members begin at {}).", end, begin);
+                    return false;
+                }
+
+                VkPushConstantRange range{};
+                range.stageFlags = reflection.stage;
+                range.offset = begin;
+                range.size = end - begin;
+                reflection.pushConstantRanges.push_back(range);
+                break;
+            }
+            case spv::StorageClassInput: {
+                if (reflection.stage != VK_SHADER_STAGE_VERTEX_BIT ||
+                    decoration.builtIn || ids[typeId].builtIn || decoration.location == UINT32_MAX) {
+                    break;
+                }
+
+                VkVertexInputAttributeDescription attribute{};
+                attribute.location = decoration.location;
+                attribute.binding = 0;
+                attribute.format = parser.vertexFormat(typeId);
+                if (attribute.format == VK_FORMAT_UNDEFINED) {
+                    LOG_WARN("Unsupported vertex input format at location {}.", decoration.location);
+                    break;
+                }
+                reflection.vertexInputs.push_back(attribute);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // 顶点输入按 location 紧密排列
+    std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+              [](const auto& a, const auto& b) { return a.location < b.location; });
+    reflection.vertexStride = 0;
+    for (auto& attribute : reflection.vertexInputs) {
+        attribute.offset = reflection.vertexStride;
+        reflection.vertexStride += SizeOfFormat(attribute.format);
+    }
+
+    std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+              [](const auto& a, const auto& b) { return a.set != b.set ? a.set < b.set : a.binding.binding < b.binding.binding; });
+
+    return true;
+}
+
+} // yu::vk
\ No newline at end of file
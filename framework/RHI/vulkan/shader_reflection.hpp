@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace yu::vk {
+
+/**
+ * @brief 着色器中的一个资源绑定，descriptorCount 为 0 表示运行时大小的数组
+ */
+struct ReflectedBinding
+{
+    uint32_t set = 0;
+    VkDescriptorSetLayoutBinding binding{};
+};
+
+/**
+ * @brief 从 SPIR-V 中反射得到的资源信息
+ */
+struct ShaderReflection
+{
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+    std::vector<ReflectedBinding> bindings;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+    // 顶点着色器的输入，按 location 排序，offset 按紧密排列计算，binding 都为 0
+    std::vector<VkVertexInputAttributeDescription> vertexInputs;
+    uint32_t vertexStride = 0;
+};
+
+/**
+ * @brief 解析 SPIR-V 代码，得到描述符绑定、推送常量和顶点输入；只支持单入口点的着色器
+ */
+bool ReflectShader(const uint32_t* pCode, size_t wordCount, ShaderReflection& reflection);
+
+} // yu::vk
\ No newline at end of file
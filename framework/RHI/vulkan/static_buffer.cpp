@@ -2,17 +2,21 @@
 // Created by 秋鱼 on 2022/6/17.
 //
 
+#include <logger.hpp>
 #include <common/math_utils.hpp>
 #include "static_buffer.hpp"
+#include "descriptor_set_cache.hpp"
 #include "initializers.hpp"
 #include "error.hpp"
 
 namespace yu::vk {
 
-void StaticBuffer::create(const VulkanDevice& device, uint32_t totalSize, bool bUseStaging, std::string_view name)
+void StaticBuffer::create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, bool bUseStaging, std::string_view name)
 {
     device_ = &device;
     total_size_ = totalSize;
+    pending_frees_ = std::vector<std::vector<std::pair<uint32_t, uint32_t>>>(numberOfFrames);
+    resetRanges();
 
     use_video_buffer_ = bUseStaging;
 
@@ -45,7 +49,7 @@ void StaticBuffer::create(const VulkanDevice& device, uint32_t totalSize, bool b
     // 创建显存上的缓冲区，前面创建的缓冲区成为暂存缓冲区
     if (bUseStaging) {
 #ifdef USE_VMA
-        VK_CHECK(device_->createBufferVMA(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_CHECK(device_->createBufferVMA(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                       VMA_MEMORY_USAGE_GPU_ONLY,
                                       total_size_,
                                       &video_buffer_,
@@ -54,7 +58,7 @@ void StaticBuffer::create(const VulkanDevice& device, uint32_t totalSize, bool b
                                       nullptr,
                                       name));
 #else
-        VK_CHECK(device_->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_CHECK(device_->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                        total_size_,
                                        &video_buffer_,
@@ -65,8 +69,43 @@ void StaticBuffer::create(const VulkanDevice& device, uint32_t totalSize, bool b
     }
 }
 
-void StaticBuffer::destroy()
+void StaticBuffer::create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, UploadHeap& uploadHeap, std::string_view name)
 {
+    device_ = &device;
+    upload_heap_ = &uploadHeap;
+    total_size_ = totalSize;
+    pending_frees_ = std::vector<std::vector<std::pair<uint32_t, uint32_t>>>(numberOfFrames);
+    resetRanges();
+
+    use_video_buffer_ = true;
+
+#ifdef USE_VMA
+    VK_CHECK(device_->createBufferVMA(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VMA_MEMORY_USAGE_GPU_ONLY,
+                                      total_size_,
+                                      &video_buffer_,
+                                      &video_allocation_,
+                                      false,
+                                      nullptr,
+                                      name));
+#else
+    VK_CHECK(device_->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   total_size_,
+                                   &video_buffer_,
+                                   &video_memory_,
+                                   false,
+                                   nullptr));
+#endif
+}
+
+void StaticBuffer::destroy(DescriptorSetCache* pDescriptorSetCache)
+{
+    if (pDescriptorSetCache != nullptr) {
+        pDescriptorSetCache->invalidate(video_buffer_);
+        pDescriptorSetCache->invalidate(buffer_);
+    }
+
     if (use_video_buffer_) {
 #ifdef USE_VMA
         vmaDestroyBuffer(device_->getAllocator(), video_buffer_, video_allocation_);
@@ -89,6 +128,27 @@ void StaticBuffer::destroy()
         buffer_ = VK_NULL_HANDLE;
     }
 
+    destroyScratchBuffer();
+
+    if (!allocations_.empty()) {
+        LOG_WARN("Static buffer still has {} allocations in use.", allocations_.size());
+    }
+    allocations_.clear();
+    free_ranges_.clear();
+    pending_frees_.clear();
+}
+
+void StaticBuffer::resetRanges()
+{
+    dirty_ranges_.clear();
+    allocations_.clear();
+    free_ranges_.clear();
+    free_ranges_[0] = total_size_;
+    for (auto& frees : pending_frees_) {
+        frees.clear();
+    }
+    frame_index_ = 0;
+    used_size_ = 0;
 }
 bool StaticBuffer::allocBuffer(uint32_t numberOfElements,
                                uint32_t elementSizeInByte,
@@ -98,15 +158,29 @@ bool StaticBuffer::allocBuffer(uint32_t numberOfElements,
     std::lock_guard<std::mutex> lock(mutex_);
 
     uint32_t size = AlignUp(numberOfElements * elementSizeInByte, 256u);
-    assert(memory_offset_ + size < total_size_);
 
-    *pData = (void*) (data_ + memory_offset_);
+    if (!upload_heap_ && data_ == nullptr) {
+        LOG_ERROR("The staging memory of the static buffer has been released.");
+        return false;
+    }
 
-    pDesc->buffer = use_video_buffer_ ? video_buffer_ : buffer_;
-    pDesc->offset = memory_offset_;
-    pDesc->range = size;
+    // 上传堆中的拷贝在分配时就记录了，调用者写入之前其他线程就可能提交它，所以只能在分配时给出数据
+    if (upload_heap_) {
+        LOG_ERROR("Static buffer staged through the upload heap must be initialized with pInitData.");
+        return false;
+    }
+
+    uint32_t offset;
+    if (!allocRange(size, pDesc, offset)) {
+        return false;
+    }
 
-    memory_offset_ += size;
+    *pData = (void*) (data_ + offset);
+
+    // 新写入的区域在下一次 uploadData 时拷贝到显存
+    if (use_video_buffer_) {
+        addDirtyRange(offset, size);
+    }
 
     return true;
 }
@@ -116,6 +190,21 @@ bool StaticBuffer::allocBuffer(uint32_t numberOfElements,
                                const void* pInitData,
                                VkDescriptorBufferInfo* pDesc)
 {
+    if (upload_heap_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        uint32_t size = AlignUp(numberOfElements * elementSizeInByte, 256u);
+
+        uint32_t offset;
+        if (!allocRange(size, pDesc, offset)) {
+            return false;
+        }
+
+        allocStaging(offset, numberOfElements * elementSizeInByte, pInitData);
+
+        return true;
+    }
+
     void* pData;
     if (allocBuffer(numberOfElements, elementSizeInByte, &pData, pDesc)) {
         memcpy(pData, pInitData, numberOfElements * elementSizeInByte);
@@ -125,17 +214,323 @@ bool StaticBuffer::allocBuffer(uint32_t numberOfElements,
     return false;
 }
 
+bool StaticBuffer::allocRange(uint32_t size, VkDescriptorBufferInfo* pDesc, uint32_t& offset)
+{
+    // 找到能容纳 size 的最小空闲区域，减少碎片
+    auto best = free_ranges_.end();
+    for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it) {
+        if (it->second >= size && (best == free_ranges_.end() || it->second < best->second)) {
+            best = it;
+        }
+    }
+
+    if (best == free_ranges_.end()) {
+        LOG_ERROR("Static buffer is out of memory, {} bytes requested, {} bytes used of {}.",
+                  size, used_size_, total_size_);
+        return false;
+    }
+
+    offset = best->first;
+    uint32_t remaining = best->second - size;
+    free_ranges_.erase(best);
+    if (remaining > 0) {
+        free_ranges_[offset + size] = remaining;
+    }
+
+    allocations_[offset] = {size, pDesc};
+    used_size_ += size;
+
+    pDesc->buffer = use_video_buffer_ ? video_buffer_ : buffer_;
+    pDesc->offset = offset;
+    pDesc->range = size;
+
+    return true;
+}
+
+void StaticBuffer::freeBuffer(const VkDescriptorBufferInfo& desc)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto allocIt = allocations_.find(static_cast<uint32_t>(desc.offset));
+    if (allocIt == allocations_.end()) {
+        LOG_ERROR("The buffer range at offset {} is not allocated from this static buffer.", desc.offset);
+        return;
+    }
+
+    // 这一帧之前提交的绘制可能还在读取这个区域，等到这一帧的槽位再次轮到时才回收
+    pending_frees_[frame_index_].emplace_back(allocIt->first, allocIt->second.size);
+    allocations_.erase(allocIt);
+}
+
+void StaticBuffer::beginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 新的一帧的槽位上一轮释放的区域已经不再被 GPU 使用
+    frame_index_ = (frame_index_ + 1) % static_cast<uint32_t>(pending_frees_.size());
+    for (auto [offset, size] : pending_frees_[frame_index_]) {
+        releaseRange(offset, size);
+    }
+    pending_frees_[frame_index_].clear();
+}
+
+void StaticBuffer::releaseRange(uint32_t offset, uint32_t size)
+{
+    used_size_ -= size;
+
+    // 与前后相邻的空闲区域合并
+    auto next = free_ranges_.lower_bound(offset);
+    if (next != free_ranges_.end() && offset + size == next->first) {
+        size += next->second;
+        next = free_ranges_.erase(next);
+    }
+
+    if (next != free_ranges_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+
+    free_ranges_[offset] = size;
+}
+
+bool StaticBuffer::defragment(VkCommandBuffer cmdBuf)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 已经是紧凑的，不需要移动
+    if (free_ranges_.size() <= 1 && (free_ranges_.empty() || free_ranges_.begin()->first == used_size_)) {
+        return false;
+    }
+
+    VkBuffer deviceBuffer = use_video_buffer_ ? video_buffer_ : buffer_;
+
+    assert(cmdBuf != VK_NULL_HANDLE || !use_video_buffer_);
+
+    // 之前的绘制可能还在读取这些数据
+    if (use_video_buffer_) {
+        auto barrier = memoryBarrier();
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuf,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // 按照偏移从低到高，把每个分配移动到紧挨着前一个分配的位置
+    std::map<uint32_t, Allocation> compacted;
+    std::vector<VkBufferCopy> toScratch;
+    std::vector<VkBufferCopy> fromScratch;
+    uint32_t scratchSize = 0;
+    uint32_t cursor = 0;
+    for (auto& [offset, allocation] : allocations_) {
+        if (offset != cursor) {
+            // 系统内存中的数据直接移动；有显存缓冲区时暂存数据也要保持一致，之后的 uploadData 才不会覆盖
+            if (data_) {
+                memmove(data_ + cursor, data_ + offset, allocation.size);
+            }
+
+            toScratch.push_back({offset, scratchSize, allocation.size});
+            fromScratch.push_back({scratchSize, cursor, allocation.size});
+            scratchSize += allocation.size;
+
+            if (allocation.pDesc) {
+                allocation.pDesc->offset = cursor;
+            }
+        }
+
+        compacted[cursor] = allocation;
+        cursor += allocation.size;
+    }
+    allocations_ = std::move(compacted);
+
+    // 显存中的移动经由临时缓冲区完成：源和目标在同一个缓冲区中可能重叠，
+    // 先把要移动的分配全部拷贝出去，再拷贝回新的位置，命令的数量与分配之间的间隙无关
+    if (use_video_buffer_ && scratchSize > 0) {
+        createScratchBuffer(scratchSize);
+
+        vkCmdCopyBuffer(cmdBuf, deviceBuffer, scratch_buffer_, static_cast<uint32_t>(toScratch.size()), toScratch.data());
+
+        auto barrier = memoryBarrier();
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuf,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        vkCmdCopyBuffer(cmdBuf, scratch_buffer_, deviceBuffer, static_cast<uint32_t>(fromScratch.size()), fromScratch.data());
+    }
+    used_size_ = cursor;
+
+    // 调用时 GPU 已经不再使用旧的数据，等待回收的区域随着整理一起回收
+    for (auto& frees : pending_frees_) {
+        frees.clear();
+    }
+
+    free_ranges_.clear();
+    if (cursor < total_size_) {
+        free_ranges_[cursor] = total_size_ - cursor;
+    }
+
+    if (use_video_buffer_) {
+        auto barrier = memoryBarrier();
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuf,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    return true;
+}
+
+void StaticBuffer::createScratchBuffer(uint32_t size)
+{
+    if (size <= scratch_size_) {
+        return;
+    }
+
+    // 上一次整理的拷贝已经执行完，旧的临时缓冲区可以直接释放
+    destroyScratchBuffer();
+    scratch_size_ = size;
+
+#ifdef USE_VMA
+    VK_CHECK(device_->createBufferVMA(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VMA_MEMORY_USAGE_GPU_ONLY,
+                                      scratch_size_,
+                                      &scratch_buffer_,
+                                      &scratch_allocation_,
+                                      false,
+                                      nullptr,
+                                      "StaticBufferScratch"));
+#else
+    VK_CHECK(device_->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   scratch_size_,
+                                   &scratch_buffer_,
+                                   &scratch_memory_,
+                                   false,
+                                   nullptr));
+#endif
+}
+
+void StaticBuffer::destroyScratchBuffer()
+{
+    if (scratch_buffer_ == VK_NULL_HANDLE) {
+        return;
+    }
+
+#ifdef USE_VMA
+    vmaDestroyBuffer(device_->getAllocator(), scratch_buffer_, scratch_allocation_);
+#else
+    vkFreeMemory(device_->getHandle(), scratch_memory_, nullptr);
+    vkDestroyBuffer(device_->getHandle(), scratch_buffer_, nullptr);
+#endif
+    scratch_buffer_ = VK_NULL_HANDLE;
+    scratch_size_ = 0;
+}
+
+void StaticBuffer::allocStaging(uint32_t offset, uint32_t size, const void* pInitData)
+{
+    // 每次最多暂存上传堆的四分之一，更大的数据分块上传，分块之间上传堆可以回收已经完成的部分
+    const auto maxChunkSize = static_cast<uint32_t>(std::min<uint64_t>(upload_heap_->getSize() / 4, UINT32_MAX));
+    const auto* pSrc = static_cast<const uint8_t*>(pInitData);
+
+    for (uint32_t done = 0; done < size; done += maxChunkSize) {
+        const uint32_t chunkSize = std::min(maxChunkSize, size - done);
+
+        // 空间不足时 beginAlloc 会等待之前的上传完成，分块总能分配成功
+        auto* pStaging = upload_heap_->beginAlloc(chunkSize, 256);
+        memcpy(pStaging, pSrc + done, chunkSize);
+
+        VkBufferCopy region;
+        region.srcOffset = static_cast<VkDeviceSize>(pStaging - upload_heap_->basePtr());
+        region.dstOffset = offset + done;
+        region.size = chunkSize;
+        upload_heap_->addBufferCopy(video_buffer_, region);
+
+        // 拷贝需要与数据在同一次提交中，所以添加拷贝之后才结束分配
+        upload_heap_->endAlloc();
+    }
+
+    // 所有分块拷贝完成后才能作为顶点和索引数据读取
+    auto barrier = bufferMemoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    barrier.buffer = video_buffer_;
+    barrier.offset = offset;
+    barrier.size = size;
+    upload_heap_->addBufferPostBarrier(barrier);
+}
+
+void StaticBuffer::markDirty(const VkDescriptorBufferInfo& desc)
+{
+    if (!use_video_buffer_ || upload_heap_)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    addDirtyRange(static_cast<uint32_t>(desc.offset), static_cast<uint32_t>(desc.range));
+}
+
+void StaticBuffer::addDirtyRange(uint32_t offset, uint32_t size)
+{
+    uint32_t end = offset + size;
+
+    // 与重叠或者相邻的脏区域合并，保证区域之间互不相邻，拷贝时区域数量最少
+    auto it = dirty_ranges_.upper_bound(offset);
+    if (it != dirty_ranges_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second >= offset) {
+            offset = prev->first;
+            end = std::max(end, prev->first + prev->second);
+            it = dirty_ranges_.erase(prev);
+        }
+    }
+
+    while (it != dirty_ranges_.end() && it->first <= end) {
+        end = std::max(end, it->first + it->second);
+        it = dirty_ranges_.erase(it);
+    }
+
+    dirty_ranges_[offset] = end - offset;
+}
+
 void StaticBuffer::uploadData(VkCommandBuffer cmdBuf)
 {
-    if (!use_video_buffer_)
+    if (!use_video_buffer_ || upload_heap_ || buffer_ == VK_NULL_HANDLE)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (dirty_ranges_.empty())
         return;
 
-    VkBufferCopy region;
-    region.srcOffset = 0;
-    region.dstOffset = 0;
-    region.size = total_size_;
+    // 只拷贝上次上传之后写入的区域
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(dirty_ranges_.size());
+    for (auto& [offset, size] : dirty_ranges_) {
+        VkBufferCopy region;
+        region.srcOffset = offset;
+        region.dstOffset = offset;
+        region.size = size;
+        regions.push_back(region);
+    }
+    dirty_ranges_.clear();
+
+    vkCmdCopyBuffer(cmdBuf, buffer_, video_buffer_, static_cast<uint32_t>(regions.size()), regions.data());
 
-    vkCmdCopyBuffer(cmdBuf, buffer_, video_buffer_, 1, &region);
+    auto barrier = memoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuf,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 void StaticBuffer::freeUploadHeap()
@@ -154,6 +549,12 @@ void StaticBuffer::freeUploadHeap()
     device_memory_ = VK_NULL_HANDLE;
 #endif
     buffer_ = VK_NULL_HANDLE;
+    data_ = nullptr;
+
+    if (!dirty_ranges_.empty()) {
+        LOG_WARN("Static buffer staging memory is released with {} ranges not uploaded.", dirty_ranges_.size());
+        dirty_ranges_.clear();
+    }
 }
 
 } // yu::vk
\ No newline at end of file
@@ -4,17 +4,26 @@
 
 #pragma once
 
+#include <map>
 #include "device.hpp"
+#include "upload_heap.hpp"
 
 namespace yu::vk {
 
+class DescriptorSetCache;
+
 class StaticBuffer
 {
 public:
-    void create(const VulkanDevice& device, uint32_t totalSize, bool bUseStaging, std::string_view name);
-    void destroy();
+    // numberOfFrames 是同时在 GPU 上执行的帧数，释放的区域要等这么多帧之后才能重新分配
+    void create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, bool bUseStaging, std::string_view name);
+    // 只在显存上创建缓冲区，数据经由上传堆暂存，不再需要单独的暂存缓冲区
+    void create(const VulkanDevice& device, uint32_t numberOfFrames, uint32_t totalSize, UploadHeap& uploadHeap, std::string_view name);
+    // 传入描述符集缓存时，先释放缓存中引用了这个缓冲区的描述符集
+    void destroy(DescriptorSetCache* pDescriptorSetCache = nullptr);
 
     // 分配足够大小的缓冲区，让 pData 指向缓冲区的起始，并设置对应的描述符缓冲区信息
+    // 使用上传堆时不能使用这个重载，数据需要在分配时通过 pInitData 给出
     bool allocBuffer(uint32_t numberOfElements,
                      uint32_t elementSizeInByte,
                      void** pData,
@@ -26,18 +35,66 @@ public:
                      const void* pInitData,
                      VkDescriptorBufferInfo* pDesc);
 
-    // 如果使用了设备上的暂存缓冲区，这个方法会将上传堆(upload heap)中的数据转移到设备上
+    // 释放分配的区域，desc 是分配时得到的描述符缓冲区信息；之前提交的绘制可能还在读取，区域在 numberOfFrames 帧之后才能重新分配
+    void freeBuffer(const VkDescriptorBufferInfo& desc);
+
+    // 切换到下一帧，回收这一帧的槽位上一轮释放的区域
+    void beginFrame();
+
+    /**
+     * @brief 把所有分配移动到缓冲区的开头，合并空闲区域；分配时传入的 VkDescriptorBufferInfo 会被更新为新的偏移，
+     *        所以它在释放之前需要保持地址不变。有显存缓冲区时移动通过 cmdBuf 中的拷贝完成，
+     *        调用时不能有还在使用旧偏移的绘制，也不能有还没有提交的上传或者还没有执行完的上一次整理，
+     *        等待回收的区域会被直接回收；返回是否移动了数据
+     */
+    bool defragment(VkCommandBuffer cmdBuf);
+
+    uint32_t getUsedSize() const { return used_size_; }
+    uint32_t getTotalSize() const { return total_size_; }
+
+    // 如果使用了设备上的暂存缓冲区，这个方法会把上次上传之后写入的区域转移到设备上；使用上传堆时拷贝由上传堆记录，不需要调用
     void uploadData(VkCommandBuffer cmdBuf);
 
-    // 如果使用了设备上的暂存缓冲区，那么释放上传堆(upload heap)
+    // 通过 allocBuffer 得到的指针修改了已经上传的数据后，标记这个区域需要重新上传
+    void markDirty(const VkDescriptorBufferInfo& desc);
+
+    // 如果使用了设备上的暂存缓冲区，那么释放上传堆(upload heap)，之后不能再分配；
+    // 使用上传堆时每个区域的暂存空间在上传完成后由上传堆回收，不需要调用
     void freeUploadHeap();
 
+private:
+    // 把 pInitData 暂存到上传堆，并记录拷贝到显存缓冲区的命令
+    void allocStaging(uint32_t offset, uint32_t size, const void* pInitData);
+    bool allocRange(uint32_t size, VkDescriptorBufferInfo* pDesc, uint32_t& offset);
+    // 整理碎片时使用的临时缓冲区，只在需要更大的空间时重新创建
+    void createScratchBuffer(uint32_t size);
+    void destroyScratchBuffer();
+    void resetRanges();
+    // 把区域放回空闲区域，与前后相邻的合并
+    void releaseRange(uint32_t offset, uint32_t size);
+    void addDirtyRange(uint32_t offset, uint32_t size);
+
 private:
     const VulkanDevice* device_ = nullptr;
+    UploadHeap* upload_heap_ = nullptr;
 
     char* data_ = nullptr;
-    uint32_t memory_offset_ = 0;
     uint32_t total_size_ = 0;
+    uint32_t used_size_ = 0;
+
+    struct Allocation
+    {
+        uint32_t size;
+        VkDescriptorBufferInfo* pDesc;  // 整理碎片时需要更新的描述符信息
+    };
+    // 按照偏移排序的分配和空闲区域，空闲区域释放时与相邻的合并
+    std::map<uint32_t, Allocation> allocations_;
+    std::map<uint32_t, uint32_t> free_ranges_;
+    // 每一帧释放、还在等待 GPU 使用完的区域，轮到这一帧的槽位时才放回空闲区域
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> pending_frees_{};
+    uint32_t frame_index_ = 0;
+    // 暂存缓冲区中写入后还没有拷贝到显存的区域，相邻的区域会被合并
+    std::map<uint32_t, uint32_t> dirty_ranges_;
 
     VkBuffer buffer_{};
     VkBuffer video_buffer_{};
@@ -45,12 +102,17 @@ private:
     std::mutex mutex_{};
     bool use_video_buffer_ = true;
 
+    VkBuffer scratch_buffer_{};
+    uint32_t scratch_size_ = 0;
+
 #ifdef USE_VMA
     VmaAllocation buffer_allocation_{};
     VmaAllocation video_allocation_{};
+    VmaAllocation scratch_allocation_{};
 #else
     VkDeviceMemory device_memory_{};
     VkDeviceMemory video_memory_{};
+    VkDeviceMemory scratch_memory_{};
 #endif
 };
 
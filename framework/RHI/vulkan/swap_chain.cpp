@@ -190,6 +190,31 @@ void SwapChain::createWindowSizeDependency(VkSurfaceKHR surface, bool VSync)
     image_index_ = 0;
 }
 
+/**
+ * @brief 创建离屏的图像环，图像的使用方式与交换链图像一致，只是不需要 surface，也不会显示到屏幕上
+ */
+void SwapChain::createHeadless(uint32_t width, uint32_t height, uint32_t imageCount)
+{
+    bHeadless_ = true;
+    surface_ = VK_NULL_HANDLE;
+
+    // 按照离屏图像的最终布局重新创建 render pass
+    destroyRenderPass();
+    createRenderPass();
+
+    // 图像数量不少于同时处理的帧数，等到当前帧的栅栏之后，轮换到的图像一定不再被 GPU 使用
+    image_count_ = std::max(imageCount, FRAMES_IN_FLIGHT);
+
+    createOffscreenImages(width, height);
+    if (bCreate_depth_) {
+        createDepthImage(width, height);
+    }
+
+    createFrameBuffers(width, height);
+
+    image_index_ = 0;
+}
+
 void SwapChain::destroyWindowSizeDependency()
 {
     destroyRenderPass();
@@ -203,6 +228,13 @@ void SwapChain::destroyWindowSizeDependency()
         vkDestroyImageView(device_->getHandle(), image_view, nullptr);
     }
 
+    // 离屏图像是自己创建的，需要自己释放；交换链的图像随交换链一起销毁
+    for (size_t i = 0; i < image_memories_.size(); ++i) {
+        vkDestroyImage(device_->getHandle(), images_[i], nullptr);
+        vkFreeMemory(device_->getHandle(), image_memories_[i], nullptr);
+    }
+    image_memories_.clear();
+
     // 摧毁交换链
     if (swap_chain_ != VK_NULL_HANDLE) {
         vkDestroySwapchainKHR(device_->getHandle(), swap_chain_, nullptr);
@@ -274,6 +306,27 @@ void SwapChain::createImageAndRTV()
     }
 }
 
+void SwapChain::createOffscreenImages(uint32_t width, uint32_t height)
+{
+    images_.resize(image_count_);
+    image_memories_.resize(image_count_);
+    image_views_.resize(image_count_);
+
+    for (uint32_t i = 0; i < image_count_; i++) {
+        CreateImage(*device_,
+                    width,
+                    height,
+                    format_,
+                    VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    images_[i],
+                    image_memories_[i]);
+
+        CreateImageView(device_->getHandle(), images_[i], format_, VK_IMAGE_ASPECT_COLOR_BIT, image_views_[i]);
+    }
+}
+
 void SwapChain::createDepthImage(uint32_t width, uint32_t height)
 {
     auto depthFormat = GetDepthFormat(
@@ -316,7 +369,8 @@ void SwapChain::createRenderPass()
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // 离屏图像没有呈现操作，转换为传输源布局以便读回
+    colorAttachment.finalLayout = bHeadless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentDescription* pDepthAttachment = nullptr;
     VkAttachmentDescription depthAttachment{};
@@ -386,6 +440,12 @@ uint32_t SwapChain::waitForSwapChain()
 {
     vkWaitForFences(device_->getHandle(), 1, &cmdBuf_executed_fences_[current_frame_], VK_TRUE, UINT64_MAX);
 
+    // 离屏图像按顺序轮换，索引在 present 中前进，不需要向交换链请求
+    if (bHeadless_) {
+        vkResetFences(device_->getHandle(), 1, &cmdBuf_executed_fences_[current_frame_]);
+        return image_index_;
+    }
+
     VK_CHECK(vkAcquireNextImageKHR(device_->getHandle(),
                                    swap_chain_,
                                    UINT64_MAX,
@@ -421,14 +481,57 @@ void SwapChain::submit(VkQueue queue, VkCommandBuffer cmdBuffer, VkPipelineStage
     VkFence CmdBufExecutedFences;
     getSemaphores(&ImageAvailableSemaphore, &RenderFinishedSemaphores, &CmdBufExecutedFences);
 
+    // 无窗口时没有获取图像和呈现的操作，不等待也不发出二值信号量，帧之间只靠栅栏同步
     auto submit_info = submitInfo();
     submit_info.pNext = nullptr;
-    submit_info.waitSemaphoreCount = 1;
+    submit_info.waitSemaphoreCount = bHeadless_ ? 0 : 1;
     submit_info.pWaitSemaphores = &ImageAvailableSemaphore;
     submit_info.pWaitDstStageMask = &submitWaitStage;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &cmdBuffer;
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = bHeadless_ ? 0 : 1;
+    submit_info.pSignalSemaphores = &RenderFinishedSemaphores;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, CmdBufExecutedFences));
+}
+
+void SwapChain::submit(VkQueue queue,
+                       VkCommandBuffer cmdBuffer,
+                       VkSemaphore timelineSemaphore,
+                       uint64_t waitValue,
+                       VkPipelineStageFlags timelineWaitStage,
+                       VkPipelineStageFlags submitWaitStage)
+{
+    if (timelineSemaphore == VK_NULL_HANDLE || waitValue == 0) {
+        submit(queue, cmdBuffer, submitWaitStage);
+        return;
+    }
+
+    VkSemaphore ImageAvailableSemaphore;
+    VkSemaphore RenderFinishedSemaphores;
+    VkFence CmdBufExecutedFences;
+    getSemaphores(&ImageAvailableSemaphore, &RenderFinishedSemaphores, &CmdBufExecutedFences);
+
+    // 二值信号量的等待值会被忽略，但数量需要与等待的信号量一致
+    VkSemaphore waitSemaphores[] = {ImageAvailableSemaphore, timelineSemaphore};
+    VkPipelineStageFlags waitStages[] = {submitWaitStage, timelineWaitStage};
+    uint64_t waitValues[] = {0, waitValue};
+
+    // 无窗口时跳过图像可用的信号量，只等待时间线信号量
+    const uint32_t first = bHeadless_ ? 1 : 0;
+
+    auto timelineInfo = timelineSemaphoreSubmitInfo();
+    timelineInfo.waitSemaphoreValueCount = 2 - first;
+    timelineInfo.pWaitSemaphoreValues = waitValues + first;
+
+    auto submit_info = submitInfo();
+    submit_info.pNext = &timelineInfo;
+    submit_info.waitSemaphoreCount = 2 - first;
+    submit_info.pWaitSemaphores = waitSemaphores + first;
+    submit_info.pWaitDstStageMask = waitStages + first;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmdBuffer;
+    submit_info.signalSemaphoreCount = bHeadless_ ? 0 : 1;
     submit_info.pSignalSemaphores = &RenderFinishedSemaphores;
 
     VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, CmdBufExecutedFences));
@@ -440,6 +543,13 @@ void SwapChain::submit(VkQueue queue, VkCommandBuffer cmdBuffer, VkPipelineStage
  */
 VkResult SwapChain::present()
 {
+    // 离屏图像不需要呈现，直接轮换到下一帧和下一张图像
+    if (bHeadless_) {
+        current_frame_ = (current_frame_ + 1) % FRAMES_IN_FLIGHT;
+        image_index_ = (image_index_ + 1) % image_count_;
+        return VK_SUCCESS;
+    }
+
     auto present = presentInfo();
     present.pNext = nullptr;
     present.waitSemaphoreCount = 1;
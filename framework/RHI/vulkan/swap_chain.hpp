@@ -17,6 +17,13 @@ public:
     void createWindowSizeDependency(VkSurfaceKHR surface, bool VSync = false);
     void destroyWindowSizeDependency();
 
+    /**
+     * @brief 无窗口模式，创建离屏图像组成的图像环代替交换链，waitForSwapChain、submit、present 的用法不变。
+     *        渲染通道结束时图像转换为传输源布局，可以直接读回；尺寸变化时先调用 destroyWindowSizeDependency 再重新创建
+     */
+    void createHeadless(uint32_t width, uint32_t height, uint32_t imageCount = 3);
+    bool isHeadless() const { return bHeadless_; }
+
     VkImage getCurrentBackBuffer() { return images_[image_index_]; }
     VkImageView getCurrentBackBufferRTV() { return image_views_[image_index_]; }
     VkFramebuffer getCurrentFrameBuffer() const { return frame_buffers_[image_index_]; }
@@ -29,6 +36,13 @@ public:
     uint32_t waitForSwapChain();
     void getSemaphores(VkSemaphore* pImageAvailableSemaphore, VkSemaphore* pRenderFinishedSemaphores, VkFence* pCmdBufExecutedFences);
     void submit(VkQueue queue, VkCommandBuffer cmdBuffer, VkPipelineStageFlags submitWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    // 额外等待时间线信号量达到 waitValue，例如等待上传堆的异步上传完成
+    void submit(VkQueue queue,
+                VkCommandBuffer cmdBuffer,
+                VkSemaphore timelineSemaphore,
+                uint64_t waitValue,
+                VkPipelineStageFlags timelineWaitStage,
+                VkPipelineStageFlags submitWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
     
     VkResult present();
 
@@ -39,6 +53,7 @@ public:
 private:
     void getSurfaceFormat();
     void createImageAndRTV();
+    void createOffscreenImages(uint32_t width, uint32_t height);
 
     void createDepthImage(uint32_t width, uint32_t height);
     void destroyDepthImage();
@@ -67,6 +82,10 @@ private:
     std::vector<VkImageView> image_views_;
     std::vector<VkFramebuffer> frame_buffers_;
 
+    // 无窗口模式下离屏图像的内存
+    bool bHeadless_ = false;
+    std::vector<VkDeviceMemory> image_memories_;
+
     bool bCreate_depth_ = false;
     VkImage depth_image_;
     VkImageView depth_image_view_;
@@ -2,7 +2,9 @@
 // Created by 秋鱼 on 2022/6/19.
 //
 
+#include <logger.hpp>
 #include "texture.hpp"
+#include "descriptor_set_cache.hpp"
 #include "error.hpp"
 #include "initializers.hpp"
 
@@ -113,8 +115,24 @@ void Texture::createDepthStencil(const VulkanDevice& device,
     create(device, imageInfo, name);
 }
 
-void Texture::destory()
+void Texture::destory(DescriptorSetCache* pDescriptorSetCache)
 {
+    if (pDescriptorSetCache != nullptr) {
+        for (auto view : views_) {
+            pDescriptorSetCache->invalidate(view);
+        }
+    }
+    views_.clear();
+
+    if (bindless_table_ != nullptr) {
+        bindless_table_->unregisterTexture(bindless_index_);
+        vkDestroyImageView(device_->getHandle(), bindless_view_, nullptr);
+
+        bindless_table_ = nullptr;
+        bindless_view_ = VK_NULL_HANDLE;
+        bindless_index_ = UINT32_MAX;
+    }
+
 #ifdef USE_VMA
     if (image_ != VK_NULL_HANDLE) {
         vmaDestroyImage(device_->getAllocator(), image_, image_allocation_);
@@ -160,6 +178,7 @@ void Texture::createRTV(VkImageView* pImageView, int mipLevel, VkFormat format)
 
     viewInfo.subresourceRange.baseArrayLayer = 0;
     VK_CHECK(vkCreateImageView(device_->getHandle(), &viewInfo, nullptr, pImageView));
+    views_.push_back(*pImageView);
 }
 
 void Texture::createSRV(VkImageView* pImageView, int mipLevel)
@@ -191,6 +210,21 @@ void Texture::createSRV(VkImageView* pImageView, int mipLevel)
     viewInfo.subresourceRange.baseArrayLayer = 0;
 
     VK_CHECK(vkCreateImageView(device_->getHandle(), &viewInfo, nullptr, pImageView));
+    views_.push_back(*pImageView);
+}
+
+uint32_t Texture::registerBindless(BindlessTable& table, VkSampler sampler)
+{
+    if (bindless_table_ != nullptr) {
+        return bindless_index_;
+    }
+
+    createSRV(&bindless_view_);
+
+    bindless_table_ = &table;
+    bindless_index_ = table.registerTexture(bindless_view_, sampler);
+
+    return bindless_index_;
 }
 
 void Texture::createDSV(VkImageView* pImageView)
@@ -213,6 +247,7 @@ void Texture::createDSV(VkImageView* pImageView)
     bitmap_.mip_level = 1;
 
     VK_CHECK(vkCreateImageView(device_->getHandle(), &viewInfo, nullptr, pImageView));
+    views_.push_back(*pImageView);
 }
 
 void Texture::createCubeSRV(VkImageView* pImageView)
@@ -228,6 +263,7 @@ void Texture::createCubeSRV(VkImageView* pImageView)
     viewInfo.subresourceRange.layerCount = bitmap_.depth;
 
     VK_CHECK(vkCreateImageView(device_->getHandle(), &viewInfo, nullptr, pImageView));
+    views_.push_back(*pImageView);
 }
 
 void Texture::createFromFile2D(const VulkanDevice& device,
@@ -302,6 +338,16 @@ void Texture::createVulkanImage(std::string_view name, VkImageUsageFlags flags)
 
 void Texture::upload(UploadHeap& uploadHeap)
 {
+    auto bytesPerPixel = static_cast<uint32_t>(SizeOfFormat(format_));
+
+    // 每次最多暂存上传堆的四分之一，更大的 mip 按行分块上传，分块之间上传堆可以回收已经完成的部分
+    const uint64_t maxChunkSize = uploadHeap.getSize() / 4;
+    const uint64_t maxRowSize = static_cast<uint64_t>(bitmap_.width) * bytesPerPixel;
+    if (maxRowSize > maxChunkSize) {
+        LOG_ERROR("A row of {} bytes does not fit in the upload heap of {} bytes.", maxRowSize, uploadHeap.getSize());
+        return;
+    }
+
     // 前置 barrier
     {
         auto barrier = imageMemoryBarrier();
@@ -317,44 +363,44 @@ void Texture::upload(UploadHeap& uploadHeap)
     }
 
     // 上传图片
-    auto bytesPerPixel = static_cast<uint32_t>(SizeOfFormat(format_));
-
     uint32_t width = bitmap_.width, height = bitmap_.height;
-    uint32_t imgDataOffset = 0;
+    size_t imgDataOffset = 0;
     for (auto face = 0; face < static_cast<int>(bitmap_.depth); ++face) {
         for (auto mip = 0; mip < static_cast<int>(bitmap_.mip_level); ++mip) {
             auto w = std::max<uint32_t>(width >> mip, 1);
             auto h = std::max<uint32_t>(height >> mip, 1);
 
-            auto uploadSize = static_cast<uint32_t>(w * h * bytesPerPixel);
-            auto* pixels = uploadHeap.beginAlloc(uploadSize, 512);
-
-            // 如果没有成功从上传堆中分配到足够大小的空间，先把已经暂存的数据上传到设备，再进行尝试分配
-            if (!pixels) {
-                uploadHeap.flushAndFinish(true);
-                pixels = uploadHeap.alloc(uploadSize, 512);
+            const uint64_t rowSize = static_cast<uint64_t>(w) * bytesPerPixel;
+            const auto rowsPerChunk = static_cast<uint32_t>(std::min<uint64_t>(h, maxChunkSize / rowSize));
+            const auto* img = bitmap_.pixels.data() + imgDataOffset;
 
-                assert(pixels);
+            for (uint32_t row = 0; row < h; row += rowsPerChunk) {
+                const uint32_t rows = std::min(rowsPerChunk, h - row);
+                const uint64_t uploadSize = rowSize * rows;
+
+                // 分块不超过上传堆的四分之一，空间不足时 beginAlloc 会等待之前的上传完成，总能分配成功
+                auto* pixels = uploadHeap.beginAlloc(uploadSize, 512);
+
+                // 拷贝图片数据到上传堆
+                std::memcpy(pixels, img + rowSize * row, uploadSize);
+
+                VkBufferImageCopy region{};
+                region.bufferOffset = static_cast<VkDeviceSize>(pixels - uploadHeap.basePtr());
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.layerCount = 1;
+                region.imageSubresource.baseArrayLayer = face;
+                region.imageSubresource.mipLevel = mip;
+                region.imageOffset.y = static_cast<int32_t>(row);
+                region.imageExtent.width = w;
+                region.imageExtent.height = rows;
+                region.imageExtent.depth = 1;
+                uploadHeap.addImageCopy(image_, region);
+
+                // 拷贝需要与数据在同一次提交中，所以添加拷贝之后才结束分配
+                uploadHeap.endAlloc();
             }
 
-            // 拷贝图片数据到上传堆
-            // ...
-            const auto* img = bitmap_.pixels.data() + imgDataOffset;
-            std::memcpy(pixels, img, uploadSize);
-            imgDataOffset += static_cast<uint32_t>(w * h * bytesPerPixel);
-
-            uploadHeap.endAlloc();
-
-            VkBufferImageCopy region{};
-            region.bufferOffset = static_cast<uint32_t>(pixels - uploadHeap.basePtr());;
-            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            region.imageSubresource.layerCount = 1;
-            region.imageSubresource.baseArrayLayer = face;
-            region.imageSubresource.mipLevel = mip;
-            region.imageExtent.width = w;
-            region.imageExtent.height = h;
-            region.imageExtent.depth = 1;
-            uploadHeap.addImageCopy(image_, region);
+            imgDataOffset += rowSize * h;
         }
     }
 
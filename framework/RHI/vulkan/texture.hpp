@@ -9,11 +9,14 @@
 
 #include "common/stb_inc.hpp"
 #include "upload_heap.hpp"
+#include "bindless_table.hpp"
 
 //#undef USE_VMA
 
 namespace yu::vk {
 
+class DescriptorSetCache;
+
 class Texture
 {
 public:
@@ -41,13 +44,22 @@ public:
                           std::string_view fileName,
                           VkImageUsageFlags flags = 0);
 
-    void destory();
+    /**
+     * @brief 传入描述符集缓存时，先释放缓存中引用了这个纹理创建的视图的描述符集
+     */
+    void destory(DescriptorSetCache* pDescriptorSetCache = nullptr);
 
     void createRTV(VkImageView* pImageView, int mipLevel, VkFormat format);
     void createSRV(VkImageView* pImageView, int mipLevel = -1);
     void createDSV(VkImageView* pImageView);
     void createCubeSRV(VkImageView* pImageView);
 
+    /**
+     * @brief 创建一个着色器资源视图并注册到无绑定纹理表中，返回着色器中使用的索引；纹理销毁时自动注销
+     */
+    uint32_t registerBindless(BindlessTable& table, VkSampler sampler);
+    uint32_t getBindlessIndex() const { return bindless_index_; }
+
     uint32_t getWidth() const { return info_.width; }
     uint32_t getHeight() const { return info_.height; }
     VkFormat getFormat() const { return format_; }
@@ -66,6 +78,13 @@ private:
     
     Bitmap bitmap_{};
 
+    // 由这个纹理创建的视图，销毁时用来清理描述符集缓存
+    std::vector<VkImageView> views_;
+
+    BindlessTable* bindless_table_ = nullptr;
+    VkImageView bindless_view_{};
+    uint32_t bindless_index_ = UINT32_MAX;
+
 #ifdef USE_VMA
     VmaAllocation image_allocation_{};
 #else
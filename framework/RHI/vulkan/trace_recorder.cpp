@@ -0,0 +1,300 @@
+﻿#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <logger.hpp>
+#include "trace_recorder.hpp"
+#include "ext_calibrated_timestamps.hpp"
+
+namespace yu::vk {
+
+// GPU 事件使用固定的线程编号，CPU 线程从 FirstCpuThread 开始编号
+constexpr uint32_t GpuTimeStampsThread = 0;
+constexpr uint32_t GpuScopesThread = 1;
+constexpr uint32_t FirstCpuThread = 2;
+
+static std::atomic<TraceRecorder*> ActiveRecorder{nullptr};
+static std::atomic<uint32_t> NextThreadId{FirstCpuThread};
+
+struct OpenScope
+{
+    std::string name;
+    uint64_t begin;
+};
+
+// 每个线程自己的范围栈，不需要加锁
+static thread_local std::vector<OpenScope> OpenScopes;
+static thread_local uint32_t ThreadId = 0;
+
+static uint32_t CurrentThreadId()
+{
+    if (ThreadId == 0) {
+        ThreadId = NextThreadId.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ThreadId;
+}
+
+static std::string EscapeJson(std::string_view str)
+{
+    std::string escaped;
+    escaped.reserve(str.size());
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+uint64_t TraceRecorder::Now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+TraceRecorder* TraceRecorder::GetActive()
+{
+    return ActiveRecorder.load(std::memory_order_acquire);
+}
+
+void TraceRecorder::create(const VulkanDevice& device, uint32_t gpuLatencyFrames)
+{
+    device_ = &device;
+    gpu_latency_frames_ = gpuLatencyFrames;
+    support_calibration_ = device.getProperties().support_calibrated_timestamps;
+    get_calibrated_timestamps_ = support_calibration_ ? LoadCalibratedTimestampsEXT(device.getHandle()) : nullptr;
+    ns_per_tick_ = device.getProperties().device_properties.limits.timestampPeriod;
+}
+
+void TraceRecorder::destroy()
+{
+    if (isCapturing()) {
+        LOG_WARN("Trace capture is not finished, write the events recorded so far.");
+        writeTrace();
+    }
+
+    get_calibrated_timestamps_ = nullptr;
+    calibrated_ = false;
+}
+
+void TraceRecorder::beginCapture(uint32_t frameCount, std::string_view path)
+{
+    if (isCapturing()) {
+        LOG_WARN("A trace is already being captured.");
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+    }
+
+    path_ = path;
+    frames_left_ = std::max(frameCount, 1u);
+    calibrated_ = false;
+    capture_begin_ = Now();
+    capture_end_ = UINT64_MAX;
+
+    state_.store(State::Recording, std::memory_order_relaxed);
+    ActiveRecorder.store(this, std::memory_order_release);
+
+    LOG_INFO("Start capturing a trace of {} frames.", frames_left_);
+}
+
+void TraceRecorder::nextFrame()
+{
+    auto state = state_.load(std::memory_order_relaxed);
+    if (state == State::Idle) {
+        return;
+    }
+
+    calibrate();
+
+    if (state == State::Recording) {
+        if (--frames_left_ == 0) {
+            capture_end_ = Now();
+            frames_left_ = gpu_latency_frames_;
+            state_.store(State::Draining, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // 最后一帧的 GPU 时间戳已经读回
+    if (frames_left_ == 0) {
+        writeTrace();
+        return;
+    }
+    --frames_left_;
+}
+
+void TraceRecorder::calibrate()
+{
+    // 每一帧重新校准，避免两个时钟之间的漂移累积
+    if (support_calibration_) {
+        calibrated_ = GetCalibratedTimestamps(get_calibrated_timestamps_, device_->getHandle(), calibration_gpu_tick_, calibration_cpu_time_);
+    }
+}
+
+void TraceRecorder::calibrateApproximately(uint64_t gpuTick, uint64_t cpuNanoseconds)
+{
+    if (support_calibration_ && calibrated_) {
+        return;
+    }
+
+    calibration_gpu_tick_ = gpuTick;
+    calibration_cpu_time_ = cpuNanoseconds;
+    calibrated_ = true;
+}
+
+uint64_t TraceRecorder::toCpuTime(uint64_t gpuTick) const
+{
+    // 时间戳可能早于校准的时刻，所以用有符号的差值
+    auto ticks = static_cast<int64_t>(gpuTick - calibration_gpu_tick_);
+    return calibration_cpu_time_ + static_cast<int64_t>(static_cast<double>(ticks) * ns_per_tick_);
+}
+
+void TraceRecorder::beginCpuScope(std::string_view name)
+{
+    OpenScopes.push_back({std::string{name}, Now()});
+}
+
+void TraceRecorder::endCpuScope()
+{
+    if (OpenScopes.empty()) {
+        return;
+    }
+
+    auto scope = std::move(OpenScopes.back());
+    OpenScopes.pop_back();
+
+    if (state_.load(std::memory_order_relaxed) != State::Recording || scope.begin < capture_begin_) {
+        return;
+    }
+
+    TraceEvent event{};
+    event.name = std::move(scope.name);
+    event.tid = CurrentThreadId();
+    event.begin = scope.begin;
+    event.duration = Now() - scope.begin;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+void TraceRecorder::addCpuCounter(std::string_view name, float value)
+{
+    if (state_.load(std::memory_order_relaxed) != State::Recording) {
+        return;
+    }
+
+    TraceEvent event{};
+    event.name = name;
+    event.phase = 'C';
+    event.tid = CurrentThreadId();
+    event.begin = Now();
+    event.value = value;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+void TraceRecorder::addGpuEvent(std::string_view name,
+                                uint64_t beginTick,
+                                uint64_t endTick,
+                                GpuTrack track,
+                                const std::vector<std::pair<std::string_view, uint64_t>>& args)
+{
+    if (!isCapturing() || !calibrated_) {
+        return;
+    }
+
+    auto begin = toCpuTime(beginTick);
+    auto end = toCpuTime(endTick);
+
+    // 只保留捕获期间内提交的工作
+    if (begin < capture_begin_ || begin > capture_end_ || end < begin) {
+        return;
+    }
+
+    TraceEvent event{};
+    event.name = name;
+    event.tid = track == GpuTrack::Scopes ? GpuScopesThread : GpuTimeStampsThread;
+    event.begin = begin;
+    event.duration = end - begin;
+    for (const auto& [key, value] : args) {
+        event.args.emplace_back(key, value);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+void TraceRecorder::writeTrace()
+{
+    ActiveRecorder.store(nullptr, std::memory_order_release);
+    state_.store(State::Idle, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::ofstream file(path_, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_ERROR("Failed to open trace file: {}", path_);
+        events_.clear();
+        return;
+    }
+
+    // Chrome trace 的时间以微秒为单位，相对于捕获开始的时刻
+    auto toMicroseconds = [this](uint64_t time) {
+        return static_cast<double>(static_cast<int64_t>(time - capture_begin_)) * 1e-3;
+    };
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << GpuTimeStampsThread << R"(,"args":{"name":"GPU Time Stamps"}},)" << "\n";
+    file << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << GpuScopesThread << R"(,"args":{"name":"GPU Scopes"}})";
+
+    for (const auto& event : events_) {
+        file << ",\n{\"name\":\"" << EscapeJson(event.name) << "\",\"ph\":\"" << event.phase
+             << "\",\"pid\":1,\"tid\":" << event.tid
+             << ",\"ts\":" << toMicroseconds(event.begin);
+
+        if (event.phase == 'C') {
+            file << ",\"args\":{\"value\":" << event.value << "}}";
+        } else {
+            file << ",\"dur\":" << static_cast<double>(event.duration) * 1e-3;
+            if (!event.args.empty()) {
+                file << ",\"args\":{";
+                for (size_t i = 0; i < event.args.size(); ++i) {
+                    file << (i > 0 ? "," : "") << "\"" << EscapeJson(event.args[i].first) << "\":" << event.args[i].second;
+                }
+                file << "}";
+            }
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    LOG_INFO("Trace with {} events is written to {}.", events_.size(), path_);
+    events_.clear();
+}
+
+TraceScope::TraceScope(std::string_view name)
+{
+    recorder_ = TraceRecorder::GetActive();
+    if (recorder_ != nullptr) {
+        recorder_->beginCpuScope(name);
+    }
+}
+
+TraceScope::~TraceScope()
+{
+    if (recorder_ != nullptr) {
+        recorder_->endCpuScope();
+    }
+}
+
+} // yu::vk
\ No newline at end of file
@@ -0,0 +1,120 @@
+﻿#pragma once
+
+#include <atomic>
+#include <mutex>
+#include "device.hpp"
+
+namespace yu::vk {
+
+/**
+ * @brief 把一段时间内 CPU 和 GPU 的事件记录到同一条时间线上，结束后写成 Chrome trace 格式的 JSON，
+ *        可以用 chrome://tracing 或者 Perfetto UI 打开。GPU 时间戳通过 VK_EXT_calibrated_timestamps 换算到 CPU 时钟，
+ *        不支持时用每一帧的第一个时间戳近似地对齐
+ */
+class TraceRecorder
+{
+public:
+    enum class GpuTrack
+    {
+        // GPUTimeStamp::getTimeStamp 记录的相邻时间戳之间的区间
+        TimeStamps,
+        // GPUTimeStamp::beginScope 记录的嵌套范围
+        Scopes,
+    };
+
+    /**
+     * @brief gpuLatencyFrames 为 GPU 时间戳延迟读取的帧数，捕获结束后还会等待这么多帧再写入文件
+     */
+    void create(const VulkanDevice& device, uint32_t gpuLatencyFrames);
+    void destroy();
+
+    // 捕获接下来 frameCount 帧的事件，完成后写入 path
+    void beginCapture(uint32_t frameCount, std::string_view path);
+    bool isCapturing() const { return state_.load(std::memory_order_relaxed) != State::Idle; }
+
+    // 每一帧调用一次，由 GPUTimeStamp::beginFrame 调用
+    void nextFrame();
+
+    // CPU 范围，可以在任意线程中嵌套，一般通过 TraceScope 使用
+    void beginCpuScope(std::string_view name);
+    void endCpuScope();
+    void addCpuCounter(std::string_view name, float value);
+
+    // GPU 事件，时间为时间戳查询的结果
+    void addGpuEvent(std::string_view name,
+                     uint64_t beginTick,
+                     uint64_t endTick,
+                     GpuTrack track,
+                     const std::vector<std::pair<std::string_view, uint64_t>>& args = {});
+    // 不支持校准时间戳时，用某个 GPU 时间戳和记录它时的 CPU 时间对齐
+    void calibrateApproximately(uint64_t gpuTick, uint64_t cpuNanoseconds);
+
+    // 与 std::chrono::steady_clock 一致的时间，以纳秒为单位
+    static uint64_t Now();
+    // 正在捕获的记录器，没有捕获时为空
+    static TraceRecorder* GetActive();
+
+private:
+    enum class State
+    {
+        Idle,
+        Recording,
+        // CPU 的记录已经结束，等待最后几帧的 GPU 时间戳
+        Draining,
+    };
+
+    struct TraceEvent
+    {
+        std::string name;
+        char phase = 'X';
+        uint32_t tid = 0;
+        uint64_t begin = 0;
+        uint64_t duration = 0;
+        float value = 0.0f;
+        std::vector<std::pair<std::string, uint64_t>> args;
+    };
+
+    void calibrate();
+    uint64_t toCpuTime(uint64_t gpuTick) const;
+    void writeTrace();
+
+private:
+    const VulkanDevice* device_ = nullptr;
+    uint32_t gpu_latency_frames_ = 0;
+    bool support_calibration_ = false;
+    // 从当前设备加载的 vkGetCalibratedTimestampsEXT
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps_ = nullptr;
+
+    std::atomic<State> state_{State::Idle};
+    std::string path_{};
+    uint32_t frames_left_ = 0;
+    uint64_t capture_begin_ = 0;
+    uint64_t capture_end_ = 0;
+
+    // 一对同时刻的 GPU 时间戳和 CPU 时间
+    bool calibrated_ = false;
+    uint64_t calibration_gpu_tick_ = 0;
+    uint64_t calibration_cpu_time_ = 0;
+    double ns_per_tick_ = 1.0;
+
+    std::mutex mutex_{};
+    std::vector<TraceEvent> events_;
+};
+
+/**
+ * @brief 在作用域内记录一个 CPU 范围，只在有记录器正在捕获时生效
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(std::string_view name);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceRecorder* recorder_ = nullptr;
+};
+
+} // yu::vk
\ No newline at end of file
@@ -2,24 +2,36 @@
 // Created by 秋鱼 on 2022/6/19.
 //
 
+#include <logger.hpp>
 #include "upload_heap.hpp"
+#include "trace_recorder.hpp"
 #include "initializers.hpp"
 #include "error.hpp"
 #include "common/math_utils.hpp"
 
 namespace yu::vk {
 
-void UploadHeap::create(const VulkanDevice& device, uint64_t totalSize)
+void UploadHeap::create(const VulkanDevice& device, uint64_t totalSize, bool bUseTransferQueue)
 {
     device_ = &device;
 
-    allocating_.reset();
-    flushing_.reset();
+    epoch_ = 0;
+    writers_ = 0;
+
+    // 选择提交上传命令的队列
+    if (bUseTransferQueue) {
+        queue_ = device_->getTransferQueue();
+        queue_family_index_ = device_->getTransferQueueIndex();
+    } else {
+        queue_ = device_->getGraphicsQueue();
+        queue_family_index_ = device_->getGraphicsQueueIndex();
+    }
+    ownership_transfer_ = queue_family_index_ != device_->getGraphicsQueueIndex();
 
     // 创建命令池和命令缓冲区
     {
         auto poolInfo = commandPoolCreateInfo();
-        poolInfo.queueFamilyIndex = device_->getGraphicsQueueIndex();
+        poolInfo.queueFamilyIndex = queue_family_index_;
         poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
         VK_CHECK(vkCreateCommandPool(device_->getHandle(), &poolInfo, nullptr, &command_pool_));
 
@@ -37,11 +49,13 @@ void UploadHeap::create(const VulkanDevice& device, uint64_t totalSize)
                                        false,
                                        (void**) (&data_begin)));
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device_->getHandle(), buffer_, &memReqs);
-
+        // 内存可能比缓冲区大，超出缓冲区的部分不能作为拷贝的源
         data_curr = data_begin;
-        data_end = data_begin + memReqs.size;
+        data_end = data_begin + totalSize;
+        data_tail = data_begin;
+        submitted_end_ = data_begin;
+
+        non_coherent_atom_size_ = device_->getProperties().device_properties.limits.nonCoherentAtomSize;
     }
 
     // 创建用于同步的 fence
@@ -50,6 +64,15 @@ void UploadHeap::create(const VulkanDevice& device, uint64_t totalSize)
         VK_CHECK(vkCreateFence(device_->getHandle(), &fenceInfo, nullptr, &fence_));
     }
 
+    // 创建时间线信号量，每次提交把它的值加一，作为这次提交的票据
+    if (device_->getProperties().support_timeline_semaphore) {
+        auto typeInfo = semaphoreTypeCreateInfo(VK_SEMAPHORE_TYPE_TIMELINE, 0);
+        auto semaphoreInfo = semaphoreCreateInfo();
+        semaphoreInfo.pNext = &typeInfo;
+        VK_CHECK(vkCreateSemaphore(device_->getHandle(), &semaphoreInfo, nullptr, &timeline_semaphore_));
+        timeline_value_ = 0;
+    }
+
     // 开始记录缓冲区命令
     {
         auto beginInfo = commandBufferBeginInfo();
@@ -59,105 +82,401 @@ void UploadHeap::create(const VulkanDevice& device, uint64_t totalSize)
 
 void UploadHeap::destory()
 {
+    // 等待所有异步提交完成
+    wait(timeline_value_);
+
     vkDestroyBuffer(device_->getHandle(), buffer_, nullptr);
     vkUnmapMemory(device_->getHandle(), device_memory_);
     vkFreeMemory(device_->getHandle(), device_memory_, nullptr);
 
-    vkFreeCommandBuffers(device_->getHandle(), command_pool_, 1, &command_buffer_);
+    for (auto& submission : in_flight_) {
+        free_command_buffers_.push_back(submission.command_buffer);
+    }
+    in_flight_.clear();
+    free_command_buffers_.push_back(command_buffer_);
+
+    vkFreeCommandBuffers(device_->getHandle(),
+                         command_pool_,
+                         static_cast<uint32_t>(free_command_buffers_.size()),
+                         free_command_buffers_.data());
+    free_command_buffers_.clear();
     vkDestroyCommandPool(device_->getHandle(), command_pool_, nullptr);
 
     vkDestroyFence(device_->getHandle(), fence_, nullptr);
+
+    if (timeline_semaphore_ != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_->getHandle(), timeline_semaphore_, nullptr);
+        timeline_semaphore_ = VK_NULL_HANDLE;
+    }
+}
+
+bool UploadHeap::canEverFit(uint64_t size, uint64_t align) const
+{
+    // 整个缓冲区都空闲时从开头分配，仍然要给 data_tail 留出一个字节
+    auto* pBegin = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uint64_t>(data_begin), align));
+    if (pBegin + AlignUp(size, align) < data_end) {
+        return true;
+    }
+
+    LOG_ERROR("Upload heap allocation of {} bytes does not fit in the heap of {} bytes.", size, getSize());
+    return false;
 }
 
 uint8_t* UploadHeap::alloc(uint64_t size, uint64_t align)
 {
-    flushing_.wait();
+    if (!canEverFit(size, align)) {
+        return nullptr;
+    }
 
-    uint8_t* pRet = nullptr;
-    {
-        std::unique_lock lock{mutex_};
+    size = AlignUp(size, align);
+
+    bool bRecycled = false;
+    uint8_t* curr = data_curr.load(std::memory_order_relaxed);
+    while (true) {
+        uint8_t* tail = data_tail.load(std::memory_order_acquire);
+        uint8_t* pRet = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uint64_t>(curr), align));
+
+        // 分配不能追上 data_tail，否则空和满无法区分
+        bool bFits = true;
+        if (curr >= tail) {
+            // 使用中的区域是 [data_tail, data_curr)，末尾的空间不够时绕回开头
+            if (pRet + size >= data_end) {
+                pRet = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uint64_t>(data_begin), align));
+                bFits = pRet + size < tail;
+            }
+        } else {
+            // 已经绕回，空闲的区域是 [data_curr, data_tail)
+            bFits = pRet + size < tail;
+        }
 
-        assert(size < static_cast<uint64_t>(data_begin - data_end));
+        if (!bFits) {
+            // 回收 GPU 已经读完的区域后再试一次；其他线程正在提交时不等待它
+            if (!bRecycled && mutex_.try_lock()) {
+                recycleCommandBuffers();
+                mutex_.unlock();
 
-        data_curr = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uint64_t>(data_curr), align));
-        size = AlignUp(size, align);
+                bRecycled = true;
+                curr = data_curr.load(std::memory_order_relaxed);
+                continue;
+            }
 
-        // 如果空间不足，则分配失败
-        if (data_curr >= data_end || data_curr + size >= data_end) {
             return nullptr;
         }
 
-        pRet = data_curr;
-        data_curr += size;
+        // 其他线程抢先分配时 curr 会被更新为最新的位置，重新计算
+        if (data_curr.compare_exchange_weak(curr, pRet + size, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return pRet;
+        }
     }
-
-    return pRet;
 }
 
 uint8_t* UploadHeap::beginAlloc(uint64_t size, uint64_t align)
 {
+    // 超过上传堆大小的分配等待多久都不会成功
+    if (!canEverFit(size, align)) {
+        return nullptr;
+    }
+
     uint8_t* pRet = nullptr;
 
-    // 如果分配失败，则把先前的数据提交，再进行尝试
+    // 如果分配失败，则等待最早的提交完成，释放它占用的空间后再进行尝试
     while (true) {
+        enterEpoch();
+
         pRet = alloc(size, align);
         if (pRet) {
             break;
         }
 
-        flushAndFinish();
-    }
+        // 提交需要等待当前纪元中的分配结束，所以先离开纪元
+        leaveEpoch();
 
-    allocating_.inc();
+        if (timeline_semaphore_ == VK_NULL_HANDLE) {
+            flushAndFinish();
+        } else {
+            waitForSpace();
+        }
+    }
 
     return pRet;
 }
 
 void UploadHeap::endAlloc()
 {
-    allocating_.dec();
+    leaveEpoch();
+}
+
+void UploadHeap::enterEpoch()
+{
+    while (true) {
+        auto epoch = epoch_.load();
+        if (epoch & 1) {
+            epoch_.wait(epoch);
+            continue;
+        }
+
+        // 先登记再确认纪元没有变化，与 closeEpoch 中先改纪元再检查数量的顺序相对应
+        writers_.fetch_add(1);
+        if (epoch_.load() == epoch) {
+            return;
+        }
+
+        leaveEpoch();
+    }
+}
+
+void UploadHeap::leaveEpoch()
+{
+    if (writers_.fetch_sub(1) == 1) {
+        writers_.notify_all();
+    }
+}
+
+void UploadHeap::closeEpoch()
+{
+    epoch_.fetch_add(1);
+
+    for (auto writers = writers_.load(); writers != 0; writers = writers_.load()) {
+        writers_.wait(writers);
+    }
+}
+
+void UploadHeap::openEpoch()
+{
+    epoch_.fetch_add(1);
+    epoch_.notify_all();
 }
 
 void UploadHeap::addImageCopy(VkImage image, VkBufferImageCopy region)
 {
-    std::unique_lock lock{mutex_};
-    image_copies_.push_back({image, region});
+    auto& lists = thread_lists_[ThreadSlot()];
+    std::unique_lock lock{lists.mutex};
+    lists.image_copies.push_back({image, region});
+}
+
+void UploadHeap::addBufferCopy(VkBuffer buffer, VkBufferCopy region)
+{
+    auto& lists = thread_lists_[ThreadSlot()];
+    std::unique_lock lock{lists.mutex};
+    lists.buffer_copies.push_back({buffer, region});
 }
 
 void UploadHeap::addImagePreBarrier(VkImageMemoryBarrier imageMemBarrier)
 {
-    std::unique_lock lock{mutex_};
-    pre_barriers_.push_back(imageMemBarrier);
+    auto& lists = thread_lists_[ThreadSlot()];
+    std::unique_lock lock{lists.mutex};
+    lists.pre_barriers.push_back(imageMemBarrier);
 }
 
 void UploadHeap::addImagePostBarrier(VkImageMemoryBarrier imageMemBarrier)
 {
-    std::unique_lock lock{mutex_};
-    post_barriers_.push_back(imageMemBarrier);
+    auto& lists = thread_lists_[ThreadSlot()];
+    std::unique_lock lock{lists.mutex};
+    lists.post_barriers.push_back(imageMemBarrier);
+}
+
+void UploadHeap::addBufferPostBarrier(VkBufferMemoryBarrier bufferMemBarrier)
+{
+    auto& lists = thread_lists_[ThreadSlot()];
+    std::unique_lock lock{lists.mutex};
+    lists.buffer_post_barriers.push_back(bufferMemBarrier);
+}
+
+void UploadHeap::gatherThreadLists()
+{
+    for (auto& lists : thread_lists_) {
+        std::unique_lock lock{lists.mutex};
+
+        image_copies_.insert(image_copies_.end(), lists.image_copies.begin(), lists.image_copies.end());
+        buffer_copies_.insert(buffer_copies_.end(), lists.buffer_copies.begin(), lists.buffer_copies.end());
+        pre_barriers_.insert(pre_barriers_.end(), lists.pre_barriers.begin(), lists.pre_barriers.end());
+        post_barriers_.insert(post_barriers_.end(), lists.post_barriers.begin(), lists.post_barriers.end());
+        buffer_post_barriers_.insert(buffer_post_barriers_.end(),
+                                     lists.buffer_post_barriers.begin(),
+                                     lists.buffer_post_barriers.end());
+
+        lists.image_copies.clear();
+        lists.buffer_copies.clear();
+        lists.pre_barriers.clear();
+        lists.post_barriers.clear();
+        lists.buffer_post_barriers.clear();
+    }
 }
 
 void UploadHeap::flush()
 {
+    // 暂存的数据可能跨过了环形缓冲区的末尾
+    uint8_t* curr = data_curr.load();
+    if (curr >= submitted_end_) {
+        flushRange(submitted_end_, curr);
+    } else {
+        flushRange(submitted_end_, data_end);
+        flushRange(data_begin, curr);
+    }
+}
+
+void UploadHeap::flushRange(const uint8_t* begin, const uint8_t* end)
+{
+    if (begin == end) {
+        return;
+    }
+
+    // 刷新的范围需要对齐到 nonCoherentAtomSize，到达内存末尾时用 VK_WHOLE_SIZE
+    auto offset = AlignDown(static_cast<VkDeviceSize>(begin - data_begin), non_coherent_atom_size_);
+    auto last = AlignUp(static_cast<VkDeviceSize>(end - data_begin), non_coherent_atom_size_);
+
     auto range = mappedMemoryRange();
-    range.size = data_curr - data_begin;
     range.memory = device_memory_;
+    range.offset = offset;
+    range.size = last >= static_cast<VkDeviceSize>(data_end - data_begin) ? VK_WHOLE_SIZE : last - offset;
 
     VK_CHECK(vkFlushMappedMemoryRanges(device_->getHandle(), 1, &range));
 }
 
+void UploadHeap::waitForSpace()
+{
+    TraceScope traceScope{"UploadHeap::waitForSpace"};
+
+    UploadTicket ticket = 0;
+    {
+        std::unique_lock lock{mutex_};
+        recycleCommandBuffers();
+
+        if (!in_flight_.empty()) {
+            ticket = in_flight_.front().ticket;
+        } else if (data_curr.load() == submitted_end_) {
+            // 没有正在执行的提交，也没有暂存的数据，缓冲区已经从头开始，直接重试分配
+            return;
+        }
+    }
+
+    // 没有正在执行的提交，空间都被暂存的数据占用，先把它们提交
+    if (ticket == 0) {
+        ticket = flushAsync();
+    }
+
+    wait(ticket);
+}
+
 void UploadHeap::flushAndFinish(bool bDoBarriers)
 {
-    // 确保别的线程没有在 flush 上传堆
-    flushing_.wait();
+    TraceScope traceScope{"UploadHeap::flushAndFinish"};
+
+    // 同一时间只有一个线程提交
+    std::unique_lock lock{mutex_};
+
+    // 关闭当前纪元，新的分配等待提交完成，已经开始的分配先完成
+    closeEpoch();
+
+    if (timeline_semaphore_ != VK_NULL_HANDLE) {
+        // 时间线的值是单调的，等待这次提交也就等待了之前所有的异步提交
+        auto ticket = submitCommands(VK_NULL_HANDLE);
+        in_flight_.push_back({command_buffer_, ticket, data_curr.load()});
+        wait(ticket);
+
+        recycleCommandBuffers();
+        command_buffer_ = nextCommandBuffer();
+    } else {
+        submitCommands(fence_);
+
+        // 等待 GPU 处理完成，然后重置 fence
+        VK_CHECK(vkWaitForFences(device_->getHandle(), 1, &fence_, VK_TRUE, UINT64_MAX));
+        vkResetFences(device_->getHandle(), 1, &fence_);
+    }
+
+    // 重新设置，让命令缓冲区开始记录
+    auto beginInfo = commandBufferBeginInfo();
+    VK_CHECK(vkBeginCommandBuffer(command_buffer_, &beginInfo));
+
+    // 所有数据都已经上传完成，从头开始分配
+    data_curr = data_begin;
+    data_tail = data_begin;
+    submitted_end_ = data_begin;
+
+    openEpoch();
+}
+
+UploadTicket UploadHeap::flushAsync()
+{
+    if (timeline_semaphore_ == VK_NULL_HANDLE) {
+        flushAndFinish();
+        return 0;
+    }
+
+    std::unique_lock lock{mutex_};
+    closeEpoch();
+
+    auto ticket = submitCommands(VK_NULL_HANDLE);
+    in_flight_.push_back({command_buffer_, ticket, data_curr.load()});
+
+    // 已提交的命令缓冲区还在使用，换一个新的继续记录；已经写入的数据在 GPU 读完之前不能覆盖
+    recycleCommandBuffers();
+    command_buffer_ = nextCommandBuffer();
+    submitted_end_ = data_curr.load();
+
+    auto beginInfo = commandBufferBeginInfo();
+    VK_CHECK(vkBeginCommandBuffer(command_buffer_, &beginInfo));
+
+    openEpoch();
+
+    return ticket;
+}
+
+bool UploadHeap::isComplete(UploadTicket ticket) const
+{
+    if (ticket == 0 || timeline_semaphore_ == VK_NULL_HANDLE) {
+        return true;
+    }
+
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(device_->getHandle(), timeline_semaphore_, &value));
+
+    return value >= ticket;
+}
+
+void UploadHeap::wait(UploadTicket ticket) const
+{
+    if (ticket == 0 || timeline_semaphore_ == VK_NULL_HANDLE) {
+        return;
+    }
 
-    // 开始一个 flush 任务
-    flushing_.inc();
+    auto waitInfo = semaphoreWaitInfo();
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline_semaphore_;
+    waitInfo.pValues = &ticket;
 
-    // 等待分配任务完成，确保 flush 时不会有分配任务
-    allocating_.wait();
+    VK_CHECK(vkWaitSemaphores(device_->getHandle(), &waitInfo, UINT64_MAX));
+}
 
+UploadTicket UploadHeap::recordAcquireBarriers(VkCommandBuffer cmdBuffer)
+{
     std::unique_lock lock{mutex_};
+
+    if (image_acquire_barriers_.empty() && buffer_acquire_barriers_.empty()) {
+        return 0;
+    }
+
+    // 获取操作的第一个作用域与信号量等待的阶段相同，保证在释放操作之后执行
+    vkCmdPipelineBarrier(cmdBuffer,
+                         AcquireStages,
+                         AcquireStages,
+                         0,
+                         0,
+                         nullptr,
+                         static_cast<uint32_t>(buffer_acquire_barriers_.size()),
+                         buffer_acquire_barriers_.data(),
+                         static_cast<uint32_t>(image_acquire_barriers_.size()),
+                         image_acquire_barriers_.data());
+    image_acquire_barriers_.clear();
+    buffer_acquire_barriers_.clear();
+
+    return acquire_ticket_;
+}
+
+UploadTicket UploadHeap::submitCommands(VkFence fence)
+{
     flush();
+    gatherThreadLists();
 
     // 上传图片
     // 实施前置的 barrier
@@ -175,29 +494,96 @@ void UploadHeap::flushAndFinish(bool bDoBarriers)
         pre_barriers_.clear();
     }
 
-    for (auto& c : image_copies_) {
+    // 同一张图片的所有 mip 和层用一条命令拷贝
+    std::stable_sort(image_copies_.begin(), image_copies_.end(), [](const IMG_COPY& a, const IMG_COPY& b) {
+        return a.image < b.image;
+    });
+
+    std::vector<VkBufferImageCopy> imageRegions;
+    for (size_t i = 0; i < image_copies_.size();) {
+        auto image = image_copies_[i].image;
+
+        imageRegions.clear();
+        for (; i < image_copies_.size() && image_copies_[i].image == image; ++i) {
+            imageRegions.push_back(image_copies_[i].region);
+        }
+
         vkCmdCopyBufferToImage(command_buffer_,
                                buffer_,
-                               c.image,
+                               image,
                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               1,
-                               &c.region);
+                               static_cast<uint32_t>(imageRegions.size()),
+                               imageRegions.data());
     }
     image_copies_.clear();
 
+    // 上传缓冲区，源和目标都相邻的区域合并成一个，每个目标缓冲区用一条命令拷贝
+    std::stable_sort(buffer_copies_.begin(), buffer_copies_.end(), [](const BUF_COPY& a, const BUF_COPY& b) {
+        return a.buffer < b.buffer || (a.buffer == b.buffer && a.region.dstOffset < b.region.dstOffset);
+    });
+
+    std::vector<VkBufferCopy> bufferRegions;
+    for (size_t i = 0; i < buffer_copies_.size();) {
+        auto buffer = buffer_copies_[i].buffer;
+
+        bufferRegions.clear();
+        for (; i < buffer_copies_.size() && buffer_copies_[i].buffer == buffer; ++i) {
+            const auto& region = buffer_copies_[i].region;
+            if (!bufferRegions.empty()) {
+                auto& last = bufferRegions.back();
+                if (last.srcOffset + last.size == region.srcOffset && last.dstOffset + last.size == region.dstOffset) {
+                    last.size += region.size;
+                    continue;
+                }
+            }
+            bufferRegions.push_back(region);
+        }
+
+        vkCmdCopyBuffer(command_buffer_,
+                        buffer_,
+                        buffer,
+                        static_cast<uint32_t>(bufferRegions.size()),
+                        bufferRegions.data());
+    }
+    buffer_copies_.clear();
+
+    auto ticket = timeline_semaphore_ != VK_NULL_HANDLE ? timeline_value_ + 1 : 0;
+
     // 实施后置的 barrier
-    if (!post_barriers_.empty()) {
+    if (ownership_transfer_) {
+        // 传输队列上只记录释放操作，布局转换写在释放和获取两边，获取操作留给图形队列
+        for (auto& barrier : post_barriers_) {
+            barrier.srcQueueFamilyIndex = queue_family_index_;
+            barrier.dstQueueFamilyIndex = device_->getGraphicsQueueIndex();
+            image_acquire_barriers_.push_back(barrier);
+            image_acquire_barriers_.back().srcAccessMask = 0;
+            barrier.dstAccessMask = 0;
+        }
+        for (auto& barrier : buffer_post_barriers_) {
+            barrier.srcQueueFamilyIndex = queue_family_index_;
+            barrier.dstQueueFamilyIndex = device_->getGraphicsQueueIndex();
+            buffer_acquire_barriers_.push_back(barrier);
+            buffer_acquire_barriers_.back().srcAccessMask = 0;
+            barrier.dstAccessMask = 0;
+        }
+        if (!post_barriers_.empty() || !buffer_post_barriers_.empty()) {
+            acquire_ticket_ = ticket;
+        }
+    }
+
+    if (!post_barriers_.empty() || !buffer_post_barriers_.empty()) {
         vkCmdPipelineBarrier(command_buffer_,
                              VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             ownership_transfer_ ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : AcquireStages,
                              0,
                              0,
                              nullptr,
-                             0,
-                             nullptr,
+                             static_cast<uint32_t>(buffer_post_barriers_.size()),
+                             buffer_post_barriers_.data(),
                              static_cast<uint32_t>(post_barriers_.size()),
                              post_barriers_.data());
         post_barriers_.clear();
+        buffer_post_barriers_.clear();
     }
 
     // 关闭，然后提交命令缓冲区
@@ -212,20 +598,66 @@ void UploadHeap::flushAndFinish(bool bDoBarriers)
     submit_info.signalSemaphoreCount = 0;
     submit_info.pSignalSemaphores = nullptr;
 
-    VK_CHECK(vkQueueSubmit(device_->getGraphicsQueue(), 1, &submit_info, fence_));
+    // 提交完成时把时间线信号量设置为票据的值
+    auto timelineInfo = timelineSemaphoreSubmitInfo();
+    if (timeline_semaphore_ != VK_NULL_HANDLE) {
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &ticket;
 
-    // 等待 GPU 处理完成，然后重置 fence
-    VK_CHECK(vkWaitForFences(device_->getHandle(), 1, &fence_, VK_TRUE, UINT64_MAX));
-    vkResetFences(device_->getHandle(), 1, &fence_);
+        submit_info.pNext = &timelineInfo;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &timeline_semaphore_;
 
-    // 重新设置，让命令缓冲区开始记录
-    auto beginInfo = commandBufferBeginInfo();
-    VK_CHECK(vkBeginCommandBuffer(command_buffer_, &beginInfo));
+        timeline_value_ = ticket;
+    }
 
-    data_curr = data_begin;
+    VK_CHECK(vkQueueSubmit(queue_, 1, &submit_info, fence));
+
+    return ticket;
+}
+
+VkCommandBuffer UploadHeap::nextCommandBuffer()
+{
+    if (!free_command_buffers_.empty()) {
+        auto cmdBuffer = free_command_buffers_.back();
+        free_command_buffers_.pop_back();
+        return cmdBuffer;
+    }
 
-    // flush 操作完成，计数器减一
-    flushing_.dec();
+    VkCommandBuffer cmdBuffer;
+    auto cmdBufferInfo = commandBufferAllocateInfo(command_pool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+    VK_CHECK(vkAllocateCommandBuffers(device_->getHandle(), &cmdBufferInfo, &cmdBuffer));
+
+    return cmdBuffer;
+}
+
+void UploadHeap::recycleCommandBuffers()
+{
+    if (!in_flight_.empty()) {
+        uint64_t completed = 0;
+        VK_CHECK(vkGetSemaphoreCounterValue(device_->getHandle(), timeline_semaphore_, &completed));
+
+        // 提交按顺序完成，完成的提交占用的区域从 data_tail 开始，到它的 data_end 为止
+        while (!in_flight_.empty() && in_flight_.front().ticket <= completed) {
+            data_tail.store(in_flight_.front().data_end, std::memory_order_release);
+            free_command_buffers_.push_back(in_flight_.front().command_buffer);
+            in_flight_.pop_front();
+        }
+    }
+
+    if (!in_flight_.empty()) {
+        return;
+    }
+
+    // 没有正在执行的提交，也没有暂存的数据时整个缓冲区都是空闲的。从头开始分配，
+    // 否则 data_tail 停在中间时，比两侧空闲部分都大的分配永远放不下。
+    // 只有 data_curr 没有被其他线程改变时才重置；先移动 data_curr，此时其他线程看到的空闲区域是 [data_begin, data_tail)，
+    // 再把 data_tail 移到开头，在这之间完成的分配仍然落在 [data_tail, data_curr) 中
+    uint8_t* staged = submitted_end_;
+    if (staged != data_begin && data_curr.compare_exchange_strong(staged, data_begin, std::memory_order_acq_rel)) {
+        data_tail.store(data_begin, std::memory_order_release);
+        submitted_end_ = data_begin;
+    }
 }
 
 } // yu::vk
\ No newline at end of file
@@ -3,49 +3,134 @@
 //
 
 #pragma once
-#include <async.hpp>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <common/thread_slot.hpp>
 #include "device.hpp"
 
 namespace yu::vk {
 
+/**
+ * @brief 上传票据，即一次提交完成时时间线信号量的值，为 0 表示没有需要等待的提交
+ */
+using UploadTicket = uint64_t;
+
+/**
+ * @brief 上传堆，以环形缓冲区的方式分配暂存空间；每次提交记录它占用的区域，GPU 完成后回收，只有环形缓冲区真正满了才会阻塞。
+ *        分配用原子操作完成，拷贝和 barrier 记录在线程私有的列表中，提交时再合并，多个加载线程之间不会互相阻塞
+ */
 class UploadHeap
 {
 public:
-    void create(const VulkanDevice& device, uint64_t totalSize);
+    /**
+     * @brief bUseTransferQueue 为 true 时上传命令提交到传输队列，资源的所有权要在图形队列上用 recordAcquireBarriers 取回；
+     *        默认提交到图形队列，此时 flushAsync 只能在提交图形命令的线程上调用
+     */
+    void create(const VulkanDevice& device, uint64_t totalSize, bool bUseTransferQueue = false);
     void destory();
 
+    // 只分配空间，不会等待提交完成，空间不足时返回空指针
     uint8_t* alloc(uint64_t size, uint64_t align);
+    /**
+     * @brief 在 beginAlloc 和 endAlloc 之间写入数据、添加拷贝，期间不会有提交发生；空间不足时等待之前的提交完成。
+     *        分配比上传堆还大时记录错误并返回空指针，此时不需要调用 endAlloc
+     */
     uint8_t* beginAlloc(uint64_t size, uint64_t align);
     void endAlloc();
 
+    // 拷贝在提交时按照目标合并：同一张图片的所有区域一次拷贝，相邻的缓冲区区域合并成一个
     void addImageCopy(VkImage image, VkBufferImageCopy region);
+    void addBufferCopy(VkBuffer buffer, VkBufferCopy region);
     void addImagePreBarrier(VkImageMemoryBarrier imageMemBarrier);
     void addImagePostBarrier(VkImageMemoryBarrier imageMemBarrier);
+    void addBufferPostBarrier(VkBufferMemoryBarrier bufferMemBarrier);
 
+    // 把暂存、还没有提交的数据刷新到设备可见
     void flush();
     void flushAndFinish(bool bDoBarriers = false);
 
+    /**
+     * @brief 提交暂存的上传命令，不等待 GPU 完成；返回的票据可以轮询，也可以让图形队列的提交等待它。
+     *        设备不支持时间线信号量时退化为 flushAndFinish，返回 0
+     */
+    UploadTicket flushAsync();
+    bool isComplete(UploadTicket ticket) const;
+    void wait(UploadTicket ticket) const;
+
+    /**
+     * @brief 在图形队列的命令缓冲区中记录已提交资源的所有权获取 barrier，返回这个命令缓冲区提交时需要等待的票据
+     */
+    UploadTicket recordAcquireBarriers(VkCommandBuffer cmdBuffer);
+
+    VkSemaphore getTimelineSemaphore() const { return timeline_semaphore_; }
+
     uint8_t* basePtr() const { return data_begin; }
+    uint64_t getSize() const { return static_cast<uint64_t>(data_end - data_begin); }
     VkBuffer getBuffer() const { return buffer_; }
     VkCommandBuffer getCommandBuffer() const { return command_buffer_; }
 
+    // 图形队列等待上传票据、获取所有权时使用的流水线阶段
+    static constexpr VkPipelineStageFlags AcquireStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+private:
+    UploadTicket submitCommands(VkFence fence);
+    VkCommandBuffer nextCommandBuffer();
+    void recycleCommandBuffers();
+    void flushRange(const uint8_t* begin, const uint8_t* end);
+    void waitForSpace();
+    // 分配在上传堆完全空闲时能否放下
+    bool canEverFit(uint64_t size, uint64_t align) const;
+    void gatherThreadLists();
+
+    // 纪元为奇数时正在提交，新的分配需要等待；提交前等待已经进入纪元的分配全部结束
+    void enterEpoch();
+    void leaveEpoch();
+    void closeEpoch();
+    void openEpoch();
+
 private:
     const VulkanDevice* device_ = nullptr;
     VkCommandPool command_pool_{};
     VkCommandBuffer command_buffer_{};
 
+    VkQueue queue_{};
+    uint32_t queue_family_index_ = 0;
+    // 传输队列与图形队列属于不同的队列族时需要转移资源的所有权
+    bool ownership_transfer_ = false;
+
+    // 异步提交的命令缓冲区和上传数据在 GPU 完成之前都不能重新使用
+    struct Submission
+    {
+        VkCommandBuffer command_buffer;
+        UploadTicket ticket;
+        uint8_t* data_end;
+    };
+    std::deque<Submission> in_flight_;
+    std::vector<VkCommandBuffer> free_command_buffers_;
+
+    VkSemaphore timeline_semaphore_{};
+    UploadTicket timeline_value_ = 0;
+
+    // 暂存但还没有提交的数据从这里开始，到 data_curr 结束
+    uint8_t* submitted_end_ = nullptr;
+    VkDeviceSize non_coherent_atom_size_ = 1;
+
     VkBuffer buffer_{};
     VkDeviceMemory device_memory_{};
 
     VkFence fence_{};
 
-    uint8_t* data_begin = nullptr;    // starting position of upload heap
-    uint8_t* data_curr = nullptr;     // current position of upload heap
-    uint8_t* data_end = nullptr;      // ending position of upload heap 
+    uint8_t* data_begin = nullptr;                // starting position of upload heap
+    std::atomic<uint8_t*> data_curr{nullptr};    // current position of upload heap
+    uint8_t* data_end = nullptr;                  // ending position of upload heap 
+    std::atomic<uint8_t*> data_tail{nullptr};    // 环形缓冲区中 GPU 可能还在读取的最早位置，与 data_curr 相等时缓冲区为空
 
-    // 用于同步的计数器
-    San::Sync allocating_{}, flushing_{};
+    // 用于同步分配和提交的纪元，以及当前纪元中正在进行的分配数量
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint32_t> writers_{0};
 
+    // 保护提交相关的状态，同一时间只有一个线程在提交
     std::mutex mutex_{};
 
     struct IMG_COPY
@@ -55,8 +140,33 @@ private:
     };
     std::vector<IMG_COPY> image_copies_;
 
+    struct BUF_COPY
+    {
+        VkBuffer buffer;
+        VkBufferCopy region;
+    };
+    std::vector<BUF_COPY> buffer_copies_;
+
     std::vector<VkImageMemoryBarrier> pre_barriers_;
     std::vector<VkImageMemoryBarrier> post_barriers_;
+    std::vector<VkBufferMemoryBarrier> buffer_post_barriers_;
+
+    // 每个线程槽位各自记录拷贝和 barrier，提交时合并到上面的列表中
+    struct ThreadLists
+    {
+        std::vector<IMG_COPY> image_copies;
+        std::vector<BUF_COPY> buffer_copies;
+        std::vector<VkImageMemoryBarrier> pre_barriers;
+        std::vector<VkImageMemoryBarrier> post_barriers;
+        std::vector<VkBufferMemoryBarrier> buffer_post_barriers;
+        std::mutex mutex{};
+    };
+    std::array<ThreadLists, MaxThreadSlots> thread_lists_{};
+
+    // 等待在图形队列上记录的所有权获取 barrier，以及它们对应的最新票据
+    std::vector<VkImageMemoryBarrier> image_acquire_barriers_;
+    std::vector<VkBufferMemoryBarrier> buffer_acquire_barriers_;
+    UploadTicket acquire_ticket_ = 0;
 };
 
 } // yu::vk
\ No newline at end of file
@@ -45,18 +45,23 @@ VkShaderStageFlagBits GetShaderType(std::string_view fileName)
 }
 
 VkShaderModule LoadShader(std::string_view fileName, VkDevice device)
+{
+    return CreateShaderModule(LoadShaderCode(fileName), device);
+}
+
+std::vector<char> LoadShaderCode(std::string_view fileName)
 {
     std::ifstream is{std::string{fileName}, std::ios::binary | std::ios::in | std::ios::ate};
 
     if (!is.is_open()) {
         LOG_ERROR("Can not open shader file: {}.", fileName);
-        return VK_NULL_HANDLE;
+        return {};
     }
 
     size_t size = is.tellg();
     if (size == 0) {
         LOG_ERROR("Shader file: {} is empty.", fileName);
-        return VK_NULL_HANDLE;
+        return {};
     }
 
     is.seekg(0, std::ios::beg);
@@ -64,10 +69,19 @@ VkShaderModule LoadShader(std::string_view fileName, VkDevice device)
     is.read(shaderCode.data(), size);
     is.close();
 
+    return shaderCode;
+}
+
+VkShaderModule CreateShaderModule(const std::vector<char>& shaderCode, VkDevice device)
+{
+    if (shaderCode.empty()) {
+        return VK_NULL_HANDLE;
+    }
+
     VkShaderModule shaderModule;
     VkShaderModuleCreateInfo moduleCreateInfo{};
     moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleCreateInfo.codeSize = size;
+    moduleCreateInfo.codeSize = shaderCode.size();
     moduleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
 
     VK_CHECK(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &shaderModule));
@@ -10,6 +10,8 @@ namespace yu::vk {
 
 VkShaderStageFlagBits GetShaderType(std::string_view fileName);
 VkShaderModule LoadShader(std::string_view fileName, VkDevice device);
+std::vector<char> LoadShaderCode(std::string_view fileName);
+VkShaderModule CreateShaderModule(const std::vector<char>& shaderCode, VkDevice device);
 uint32_t SizeOfFormat(VkFormat format);
 uint32_t BitSizeOfFormat(VkFormat format);
 
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <ring.hpp>
 
 namespace yu {
@@ -19,6 +20,10 @@ public:
         mem_allocated_in_frame_ = 0;
         allocated_mem_per_backBuffer_ = std::vector<uint32_t>(numberOfBackBuffers, 0);
 
+        frame_high_water_mark_ = 0;
+        in_flight_high_water_mark_ = 0;
+
+        total_size_ = totalSize;
         mem_.create(totalSize);
     }
 
@@ -51,6 +56,15 @@ public:
     void beginFrame()
     {
         allocated_mem_per_backBuffer_[backBuffer_index_] = mem_allocated_in_frame_;
+
+        // 记录单帧和所有在途帧占用的峰值，用来判断环形缓冲区的大小是否合适
+        uint32_t inFlight = 0;
+        for (auto allocated : allocated_mem_per_backBuffer_) {
+            inFlight += allocated;
+        }
+        frame_high_water_mark_ = std::max(frame_high_water_mark_, mem_allocated_in_frame_);
+        in_flight_high_water_mark_ = std::max(in_flight_high_water_mark_, inFlight);
+
         mem_allocated_in_frame_ = 0;
         
         backBuffer_index_ = (backBuffer_index_ + 1) % backBuffers_count_;
@@ -58,14 +72,35 @@ public:
         mem_.free(allocated_mem_per_backBuffer_[backBuffer_index_]);
     }
 
+    uint32_t getSize() const { return total_size_; }
+    // 当前帧已经分配的大小，包含为了避免跨越首尾而跳过的部分
+    uint32_t getFrameUsage() const { return mem_allocated_in_frame_; }
+    // 上一帧分配的大小
+    uint32_t getLastFrameUsage() const
+    {
+        return allocated_mem_per_backBuffer_[(backBuffer_index_ + backBuffers_count_ - 1) % backBuffers_count_];
+    }
+    uint32_t getFrameHighWaterMark() const { return frame_high_water_mark_; }
+    uint32_t getInFlightHighWaterMark() const { return in_flight_high_water_mark_; }
+
+    void resetHighWaterMark()
+    {
+        frame_high_water_mark_ = 0;
+        in_flight_high_water_mark_ = 0;
+    }
+
 private:
     San::Ring mem_;
+    uint32_t total_size_{};
 
     uint32_t backBuffer_index_{};
     uint32_t backBuffers_count_{};
 
     uint32_t mem_allocated_in_frame_{};
     std::vector<uint32_t> allocated_mem_per_backBuffer_{};
+
+    uint32_t frame_high_water_mark_{};
+    uint32_t in_flight_high_water_mark_{};
 };
 
 } // yu
\ No newline at end of file
@@ -41,4 +41,15 @@ inline std::string GetModelFile(const std::string& filename)
     return ModelFilePath() + "/" + filename;
 }
 
+// 运行时生成的缓存文件（例如流水线缓存）所在的目录
+constexpr inline std::string CacheFilePath()
+{
+    return std::string{YU_ROOT_PATH} + "/cache";
+}
+
+inline std::string GetCacheFile(const std::string& filename)
+{
+    return CacheFilePath() + "/" + filename;
+}
+
 } // namespace yu
\ No newline at end of file
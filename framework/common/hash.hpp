@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace yu {
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+/**
+ * @brief 64 位 FNV-1a 哈希，结果与平台和运行次数无关，可以用于落盘数据的校验
+ */
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+inline uint64_t HashString(std::string_view str, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    return HashBytes(str.data(), str.size(), seed);
+}
+
+/**
+ * @brief 将 value 的内存内容并入已有的哈希值中，T 需要是没有填充字节的平凡类型
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T>
+inline uint64_t HashCombine(uint64_t seed, const T& value)
+{
+    return HashBytes(&value, sizeof(T), seed);
+}
+
+/**
+ * @brief 把 value 的内存内容追加到 key 的末尾。缓存在保存哈希的同时保存参与哈希的状态，命中时逐字节比较，排除哈希碰撞
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T>
+inline void AppendKey(std::vector<uint8_t>& key, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    key.insert(key.end(), bytes, bytes + sizeof(T));
+}
+
+inline void AppendKey(std::vector<uint8_t>& key, std::string_view str)
+{
+    AppendKey(key, str.size());
+    key.insert(key.end(), str.begin(), str.end());
+}
+
+} // namespace yu
\ No newline at end of file
@@ -29,6 +29,12 @@ inline T AlignUp(T val, T alignment)
     return (val + alignment - static_cast<T>(1)) & ~(alignment - static_cast<T>(1));
 }
 
+template<typename T>
+inline T AlignDown(T val, T alignment)
+{
+    return val & ~(alignment - static_cast<T>(1));
+}
+
 template<typename T>
 requires std::is_arithmetic_v<T>
 inline bool IsPowerOfTwo(T x)
@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "thread_slot.hpp"
+
+namespace yu {
+
+/**
+ * @brief 简单的工作线程队列，任务按照提交的顺序被空闲的线程取走执行；没有工作线程时任务在提交的线程上直接执行。
+ *        工作线程使用保留给工作线程的槽位，线程数不超过 MaxWorkerThreadSlots
+ */
+class TaskQueue
+{
+public:
+    TaskQueue() = default;
+    ~TaskQueue() { destroy(); }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    void create(uint32_t numberOfThreads)
+    {
+        stop_ = false;
+
+        numberOfThreads = std::min(numberOfThreads, MaxWorkerThreadSlots);
+        workers_.reserve(numberOfThreads);
+        for (uint32_t i = 0; i < numberOfThreads; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    // 等待已提交的任务执行完毕，然后结束所有工作线程
+    void destroy()
+    {
+        {
+            std::unique_lock lock{mutex_};
+            stop_ = true;
+        }
+        cv_.notify_all();
+
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+    }
+
+    template<typename F>
+    auto enqueue(F&& func) -> std::future<std::invoke_result_t<F>>
+    {
+        using R = std::invoke_result_t<F>;
+
+        // packaged_task 只能移动，而 std::function 要求可以拷贝，所以用 shared_ptr 包一层
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+        auto future = task->get_future();
+
+        if (workers_.empty()) {
+            (*task)();
+            return future;
+        }
+
+        {
+            std::unique_lock lock{mutex_};
+            tasks_.emplace([task] { (*task)(); });
+        }
+        cv_.notify_one();
+
+        return future;
+    }
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+private:
+    void workerLoop()
+    {
+        MarkWorkerThread();
+
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock{mutex_};
+                cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+
+                if (stop_ && tasks_.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+
+            task();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+} // namespace yu
\ No newline at end of file
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <logger.hpp>
+
+namespace yu {
+
+// 线程私有资源的槽位数量
+constexpr uint32_t MaxThreadSlots = 32;
+// 其中为工作线程（TaskQueue）保留的槽位数量，工作线程再多也不会占用主线程和加载线程的槽位
+constexpr uint32_t MaxWorkerThreadSlots = 16;
+
+namespace detail {
+
+// 工作线程在使用槽位之前设置，从保留给工作线程的槽位中分配
+inline thread_local bool IsWorkerThread = false;
+
+/**
+ * @brief 线程第一次使用槽位时占用一个空闲的槽位，线程退出时归还，同一时刻一个槽位只属于一个线程。
+ *        低位的槽位给普通线程使用，高位的 MaxWorkerThreadSlots 个槽位给工作线程使用
+ */
+class ThreadSlotReservation
+{
+public:
+    explicit ThreadSlotReservation(bool bWorker)
+    {
+        static_assert(MaxThreadSlots <= 32 && MaxWorkerThreadSlots < MaxThreadSlots);
+
+        constexpr uint32_t GeneralSlots = MaxThreadSlots - MaxWorkerThreadSlots;
+        constexpr uint32_t allMask = MaxThreadSlots == 32 ? ~0u : (1u << MaxThreadSlots) - 1;
+        constexpr uint32_t generalMask = (1u << GeneralSlots) - 1;
+        const uint32_t rangeMask = bWorker ? allMask & ~generalMask : generalMask;
+
+        auto used = used_slots_.load(std::memory_order_relaxed);
+        while (true) {
+            const uint32_t free = ~used & rangeMask;
+            if (free == 0) {
+                // 共用槽位会让两个线程同时录制同一个命令池，不能继续运行
+                LOG_FATAL("All {} {} thread slots are in use.",
+                          bWorker ? MaxWorkerThreadSlots : GeneralSlots,
+                          bWorker ? "worker" : "general");
+                std::abort();
+            }
+
+            slot_ = static_cast<uint32_t>(std::countr_zero(free));
+            // acquire 保证能看到上一个持有者对槽位资源的修改
+            if (used_slots_.compare_exchange_weak(used, used | (1u << slot_), std::memory_order_acquire)) {
+                break;
+            }
+        }
+    }
+
+    ~ThreadSlotReservation()
+    {
+        used_slots_.fetch_and(~(1u << slot_), std::memory_order_release);
+    }
+
+    ThreadSlotReservation(const ThreadSlotReservation&) = delete;
+    ThreadSlotReservation& operator=(const ThreadSlotReservation&) = delete;
+
+    uint32_t get() const { return slot_; }
+
+private:
+    // 每一位表示一个槽位是否被占用
+    static inline std::atomic<uint32_t> used_slots_{0};
+
+    uint32_t slot_{};
+};
+
+} // namespace detail
+
+/**
+ * @brief 返回调用线程独占的槽位，用于索引线程私有的资源（命令池、描述符池等）。
+ *        槽位在线程退出时归还后可以被新的线程使用；同时存活并使用槽位的普通线程不能超过
+ *        MaxThreadSlots - MaxWorkerThreadSlots 个，工作线程不能超过 MaxWorkerThreadSlots 个
+ */
+inline uint32_t ThreadSlot()
+{
+    thread_local const detail::ThreadSlotReservation reservation{detail::IsWorkerThread};
+
+    return reservation.get();
+}
+
+// 把调用线程标记为工作线程，需要在它第一次使用槽位之前调用
+inline void MarkWorkerThread()
+{
+    detail::IsWorkerThread = true;
+}
+
+} // namespace yu
\ No newline at end of file
@@ -28,6 +28,7 @@
 #include <cassert>
 #include <concepts>
 #include <numbers>
+#include <optional>
 
 #ifdef YU_IN_WINDOWS
 #include <Windows.h>
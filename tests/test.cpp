@@ -5,8 +5,13 @@
 #define CATCH_CONFIG_MAIN
 
 #include <catch2/catch.hpp>
+#include <algorithm>
 #include <filesystem>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 #include "win_platform.hpp"
 #include "logger.hpp"
 #include "filesystem.hpp"
@@ -14,11 +19,19 @@
 #include "RHI/vulkan/instance.hpp"
 #include "RHI/vulkan/device.hpp"
 #include "RHI/vulkan/swap_chain.hpp"
+#include "RHI/vulkan/headless_runner.hpp"
+#include "RHI/vulkan/initializers.hpp"
+#include "RHI/vulkan/error.hpp"
+#include "RHI/vulkan/shader_reflection.hpp"
+#include "RHI/vulkan/upload_heap.hpp"
+#include "RHI/vulkan/descriptor_set_cache.hpp"
+#include "RHI/vulkan/texture.hpp"
 
 namespace fs = std::filesystem;
 using namespace yu::vk;
 
-TEST_CASE("test", "[TestLog]")
+// 需要窗口并进入主循环，只能手动运行（catch 的 [.] 标签使它默认不执行），无显示器的环境使用下面的无窗口测试
+TEST_CASE("test", "[.][TestLog]")
 {
     San::LogSystem log;
 
@@ -51,3 +64,592 @@ TEST_CASE("test", "[TestLog]")
 
     platform.terminate(code);
 }
+
+// 每一帧只清屏的渲染器，走与示例相同的 waitForSwapChain/submit/present 流程
+class ClearRenderer : public Renderer
+{
+public:
+    void render() override
+    {
+        auto imageIndex = swap_chain_->waitForSwapChain();
+        image_indices.push_back(imageIndex);
+
+        frame_commands_.beginFrame();
+        auto cmdBuffer = frame_commands_.getNewCommandBuffer();
+
+        auto cmd_buf_info = commandBufferBeginInfo();
+        cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmd_buf_info));
+
+        VkClearValue clearColor{};
+        clearColor.color = {0.1f, 0.2f, 0.23f, 1.0f};
+
+        auto renderPassInfo = renderPassBeginInfo();
+        renderPassInfo.renderPass = swap_chain_->getRenderPass();
+        renderPassInfo.framebuffer = swap_chain_->getFrameBuffer(static_cast<int>(imageIndex));
+        renderPassInfo.renderArea.extent = {width_, height_};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdEndRenderPass(cmdBuffer);
+
+        VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+        swap_chain_->submit(device_->getGraphicsQueue(), cmdBuffer);
+
+        VK_CHECK(swap_chain_->present());
+    }
+
+    std::vector<uint32_t> image_indices;
+};
+
+// 把清屏拆成几条横向的条带，由任务队列的工作线程分别录制到次级命令缓冲区，主命令缓冲区只负责执行
+class SecondaryClearRenderer : public Renderer
+{
+public:
+    void render() override
+    {
+        auto imageIndex = swap_chain_->waitForSwapChain();
+
+        frame_commands_.beginFrame();
+        auto cmdBuffer = frame_commands_.getNewCommandBuffer();
+
+        auto cmd_buf_info = commandBufferBeginInfo();
+        cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmd_buf_info));
+
+        auto renderPass = swap_chain_->getRenderPass();
+        auto framebuffer = swap_chain_->getFrameBuffer(static_cast<int>(imageIndex));
+
+        VkClearValue clearColor{};
+        clearColor.color = {0.1f, 0.2f, 0.23f, 1.0f};
+
+        auto renderPassInfo = renderPassBeginInfo();
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = framebuffer;
+        renderPassInfo.renderArea.extent = {width_, height_};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        std::vector<std::future<VkCommandBuffer>> futures;
+        const uint32_t stripHeight = height_ / StripCount;
+        for (uint32_t i = 0; i < StripCount; ++i) {
+            futures.push_back(task_queue_.enqueue([=, this] {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    recording_threads.insert(std::this_thread::get_id());
+                }
+
+                auto secondary = frame_commands_.beginSecondaryCommandBuffer(renderPass, 0, framebuffer);
+
+                VkClearAttachment attachment{};
+                attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                attachment.colorAttachment = 0;
+                attachment.clearValue.color = {static_cast<float>(i) / StripCount, 0.0f, 0.0f, 1.0f};
+
+                VkClearRect rect{};
+                rect.rect.offset = {0, static_cast<int32_t>(i * stripHeight)};
+                rect.rect.extent = {width_, stripHeight};
+                rect.layerCount = 1;
+
+                vkCmdClearAttachments(secondary, 1, &attachment, 1, &rect);
+
+                VK_CHECK(vkEndCommandBuffer(secondary));
+                return secondary;
+            }));
+        }
+
+        // 按条带的顺序执行，与工作线程完成的先后无关
+        std::vector<VkCommandBuffer> secondaries;
+        for (auto& future : futures) {
+            secondaries.push_back(future.get());
+        }
+        FrameCommands::ExecuteSecondaryCommandBuffers(cmdBuffer, secondaries);
+        secondary_count += static_cast<uint32_t>(secondaries.size());
+
+        vkCmdEndRenderPass(cmdBuffer);
+
+        VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+        swap_chain_->submit(device_->getGraphicsQueue(), cmdBuffer);
+
+        VK_CHECK(swap_chain_->present());
+    }
+
+    static constexpr uint32_t StripCount = 4;
+
+    uint32_t secondary_count = 0;
+    std::set<std::thread::id> recording_threads;
+    std::mutex mutex;
+};
+
+TEST_CASE("headless", "[Headless]")
+{
+    San::LogSystem log;
+
+    HeadlessProperties props{};
+    props.width = 64;
+    props.height = 64;
+    props.image_count = 3;
+
+    HeadlessRunner runner;
+    runner.create("Headless Test", props);
+    REQUIRE(runner.getSwapChain().isHeadless());
+    REQUIRE(runner.getSwapChain().getHandle() == VK_NULL_HANDLE);
+
+    const uint32_t frameCount = 10;
+    ClearRenderer renderer;
+    REQUIRE(runner.run(renderer, frameCount) == frameCount);
+
+    // 离屏图像按顺序轮换
+    REQUIRE(renderer.image_indices.size() == frameCount);
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        REQUIRE(renderer.image_indices[i] == i % props.image_count);
+    }
+
+    runner.destroy();
+}
+
+TEST_CASE("record secondary command buffers on workers", "[Headless][FrameCommands]")
+{
+    San::LogSystem log;
+
+    HeadlessProperties props{};
+    props.width = 64;
+    props.height = 64;
+    props.image_count = 3;
+
+    HeadlessRunner runner;
+    runner.create("Secondary Command Buffer Test", props);
+
+    const uint32_t frameCount = 6;
+    SecondaryClearRenderer renderer;
+    REQUIRE(runner.run(renderer, frameCount) == frameCount);
+
+    CHECK(renderer.secondary_count == frameCount * SecondaryClearRenderer::StripCount);
+    // 单核机器上任务队列也至少有一个工作线程，录制不会发生在渲染线程上
+    CHECK(renderer.recording_threads.count(std::this_thread::get_id()) == 0);
+
+    runner.destroy();
+}
+
+// 按照 SPIR-V 的指令格式拼出代码：指令首字的高 16 位为字数，低 16 位为操作码
+struct SpvBuilder
+{
+    std::vector<uint32_t> words{0x07230203, 0x00010000, 0, 0, 0};
+
+    void op(uint32_t opcode, std::initializer_list<uint32_t> operands)
+    {
+        words.push_back((static_cast<uint32_t>(operands.size() + 1) << 16) | opcode);
+        words.insert(words.end(), operands);
+    }
+};
+
+/**
+ * 对应的 GLSL 片元着色器：
+ *   layout(set = 0, binding = 0) uniform UBO { vec4 color; float scale; };
+ *   layout(set = 0, binding = 1) uniform sampler2D tex;
+ *   layout(set = 1, binding = 0) uniform sampler2D textures[4];
+ *   layout(push_constant) uniform Push { vec4 tint; };
+ */
+static std::vector<uint32_t> MakeReflectionTestShader()
+{
+    SpvBuilder b;
+    b.op(17, {1});                                 // OpCapability Shader
+    b.op(14, {0, 1});                              // OpMemoryModel Logical GLSL450
+    b.op(15, {4, 1, 0x6E69616D, 0});               // OpEntryPoint Fragment %1 "main"
+    b.op(16, {1, 7});                              // OpExecutionMode %1 OriginUpperLeft
+    b.op(71, {10, 34, 0});                         // OpDecorate %10 DescriptorSet 0
+    b.op(71, {10, 33, 0});                         // OpDecorate %10 Binding 0
+    b.op(71, {7, 2});                              // OpDecorate %7 Block
+    b.op(72, {7, 0, 35, 0});                       // OpMemberDecorate %7 0 Offset 0
+    b.op(72, {7, 1, 35, 16});                      // OpMemberDecorate %7 1 Offset 16
+    b.op(71, {13, 34, 0});                         // OpDecorate %13 DescriptorSet 0
+    b.op(71, {13, 33, 1});                         // OpDecorate %13 Binding 1
+    b.op(71, {16, 34, 1});                         // OpDecorate %16 DescriptorSet 1
+    b.op(71, {16, 33, 0});                         // OpDecorate %16 Binding 0
+    b.op(71, {18, 2});                             // OpDecorate %18 Block
+    b.op(72, {18, 0, 35, 0});                      // OpMemberDecorate %18 0 Offset 0
+    b.op(19, {2});                                 // %2 = OpTypeVoid
+    b.op(33, {3, 2});                              // %3 = OpTypeFunction %2
+    b.op(22, {4, 32});                             // %4 = OpTypeFloat 32
+    b.op(23, {5, 4, 4});                           // %5 = OpTypeVector %4 4
+    b.op(21, {6, 32, 0});                          // %6 = OpTypeInt 32 0
+    b.op(30, {7, 5, 4});                           // %7 = OpTypeStruct %5 %4
+    b.op(32, {8, 2, 7});                           // %8 = OpTypePointer Uniform %7
+    b.op(59, {8, 10, 2});                          // %10 = OpVariable %8 Uniform
+    b.op(25, {11, 4, 1, 0, 0, 0, 1, 0});           // %11 = OpTypeImage %4 2D 0 0 0 1 Unknown
+    b.op(27, {12, 11});                            // %12 = OpTypeSampledImage %11
+    b.op(32, {9, 0, 12});                          // %9 = OpTypePointer UniformConstant %12
+    b.op(59, {9, 13, 0});                          // %13 = OpVariable %9 UniformConstant
+    b.op(43, {6, 14, 4});                          // %14 = OpConstant %6 4
+    b.op(28, {15, 12, 14});                        // %15 = OpTypeArray %12 %14
+    b.op(32, {17, 0, 15});                         // %17 = OpTypePointer UniformConstant %15
+    b.op(59, {17, 16, 0});                         // %16 = OpVariable %17 UniformConstant
+    b.op(30, {18, 5});                             // %18 = OpTypeStruct %5
+    b.op(32, {19, 9, 18});                         // %19 = OpTypePointer PushConstant %18
+    b.op(59, {19, 20, 9});                         // %20 = OpVariable %19 PushConstant
+    b.op(54, {2, 1, 0, 3});                        // %1 = OpFunction %2 None %3
+    b.op(248, {21});                               // %21 = OpLabel
+    b.op(253, {});                                 // OpReturn
+    b.op(56, {});                                  // OpFunctionEnd
+
+    b.words[3] = 22;
+    return b.words;
+}
+
+TEST_CASE("reflect descriptor bindings", "[ShaderReflection]")
+{
+    San::LogSystem log;
+
+    const auto code = MakeReflectionTestShader();
+
+    ShaderReflection reflection;
+    REQUIRE(ReflectShader(code.data(), code.size(), reflection));
+    REQUIRE(reflection.stage == VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    REQUIRE(reflection.bindings.size() == 3);
+    CHECK(reflection.bindings[0].set == 0);
+    CHECK(reflection.bindings[0].binding.binding == 0);
+    CHECK(reflection.bindings[0].binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    CHECK(reflection.bindings[0].binding.descriptorCount == 1);
+    CHECK(reflection.bindings[1].set == 0);
+    CHECK(reflection.bindings[1].binding.binding == 1);
+    CHECK(reflection.bindings[1].binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    CHECK(reflection.bindings[2].set == 1);
+    CHECK(reflection.bindings[2].binding.binding == 0);
+    CHECK(reflection.bindings[2].binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    CHECK(reflection.bindings[2].binding.descriptorCount == 4);
+
+    REQUIRE(reflection.pushConstantRanges.size() == 1);
+    CHECK(reflection.pushConstantRanges[0].offset == 0);
+    CHECK(reflection.pushConstantRanges[0].size == 16);
+}
+
+TEST_CASE("reject malformed SPIR-V", "[ShaderReflection]")
+{
+    San::LogSystem log;
+
+    const auto code = MakeReflectionTestShader();
+    ShaderReflection reflection;
+
+    // 错误的魔数
+    auto badMagic = code;
+    badMagic[0] = 0;
+    CHECK_FALSE(ReflectShader(badMagic.data(), badMagic.size(), reflection));
+
+    // 截断在指令中间
+    CHECK_FALSE(ReflectShader(code.data(), code.size() - 3, reflection));
+
+    // id 上界超出代码的长度
+    auto badBound = code;
+    badBound[3] = 0x7fffffff;
+    CHECK_FALSE(ReflectShader(badBound.data(), badBound.size(), reflection));
+
+    // 修饰的目标 id 超出上界
+    auto badId = code;
+    badId[3] = 10;
+    CHECK_FALSE(ReflectShader(badId.data(), badId.size(), reflection));
+
+    // 只有头部
+    CHECK_FALSE(ReflectShader(code.data(), 5, reflection));
+
+    // push constant 块引用自己，大小未知，不能得到一个回绕的范围
+    auto cyclicPush = code;
+    const uint32_t pushStruct[] = {(3u << 16) | 30u, 18, 5};
+    auto it = std::search(cyclicPush.begin(), cyclicPush.end(), std::begin(pushStruct), std::end(pushStruct));
+    REQUIRE(it != cyclicPush.end());
+    it[2] = 18;
+    CHECK_FALSE(ReflectShader(cyclicPush.data(), cyclicPush.size(), reflection));
+}
+
+TEST_CASE("upload heap wraps when idle", "[UploadHeap]")
+{
+    San::LogSystem log;
+
+    InstanceProperties instanceProps{};
+    instanceProps.headless = true;
+    VulkanInstance inst{"Upload Heap Test", instanceProps};
+
+    VulkanDevice device;
+    device.create(inst);
+
+    const uint64_t heapSize = 1024 * 1024;
+    UploadHeap uploadHeap;
+    uploadHeap.create(device, heapSize);
+
+    // 先越过中点，提交并等待完成，此时没有正在执行的提交，data_tail 停在中间
+    auto* first = uploadHeap.beginAlloc(heapSize * 6 / 10, 256);
+    REQUIRE(first != nullptr);
+    uploadHeap.endAlloc();
+    uploadHeap.wait(uploadHeap.flushAsync());
+
+    // 比中点两侧的空闲部分都大的分配需要从头开始，不能一直等待
+    auto* second = uploadHeap.beginAlloc(heapSize * 7 / 10, 256);
+    REQUIRE(second != nullptr);
+    CHECK(second + heapSize * 7 / 10 <= uploadHeap.basePtr() + heapSize);
+    uploadHeap.endAlloc();
+    uploadHeap.flushAndFinish();
+
+    // 比上传堆还大的分配直接失败
+    CHECK(uploadHeap.beginAlloc(heapSize, 256) == nullptr);
+    CHECK(uploadHeap.alloc(heapSize * 2, 256) == nullptr);
+
+    uploadHeap.destory();
+    device.destroy();
+}
+
+TEST_CASE("upload heap on the transfer queue", "[UploadHeap]")
+{
+    San::LogSystem log;
+
+    InstanceProperties instanceProps{};
+    instanceProps.headless = true;
+    VulkanInstance inst{"Transfer Upload Test", instanceProps};
+
+    VulkanDevice device;
+    device.create(inst);
+
+    UploadHeap uploadHeap;
+    uploadHeap.create(device, 1024 * 1024, true);
+
+    const uint32_t size = 4096;
+    VkBuffer deviceBuffer;
+    VkDeviceMemory deviceMemory;
+    VK_CHECK(device.createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 size,
+                                 &deviceBuffer,
+                                 &deviceMemory,
+                                 false,
+                                 nullptr));
+
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    uint8_t* pReadback = nullptr;
+    VK_CHECK(device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 size,
+                                 &readbackBuffer,
+                                 &readbackMemory,
+                                 false,
+                                 (void**) &pReadback));
+
+    // 在传输队列上拷贝到设备缓冲区，所有权的释放由上传堆记录
+    std::vector<uint8_t> expected(size);
+    auto* pStaging = uploadHeap.beginAlloc(size, 256);
+    REQUIRE(pStaging != nullptr);
+    for (uint32_t i = 0; i < size; ++i) {
+        expected[i] = static_cast<uint8_t>(i * 7);
+        pStaging[i] = expected[i];
+    }
+    uploadHeap.addBufferCopy(deviceBuffer, {static_cast<VkDeviceSize>(pStaging - uploadHeap.basePtr()), 0, size});
+
+    auto barrier = bufferMemoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.buffer = deviceBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    uploadHeap.addBufferPostBarrier(barrier);
+    uploadHeap.endAlloc();
+
+    auto ticket = uploadHeap.flushAsync();
+
+    // 图形队列取回所有权，再把数据拷贝到主机可见的缓冲区
+    auto poolInfo = commandPoolCreateInfo();
+    poolInfo.queueFamilyIndex = device.getGraphicsQueueIndex();
+    VkCommandPool commandPool;
+    VK_CHECK(vkCreateCommandPool(device.getHandle(), &poolInfo, nullptr, &commandPool));
+    auto cmdBuffer = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool, true);
+
+    auto acquireTicket = uploadHeap.recordAcquireBarriers(cmdBuffer);
+    if (device.getTransferQueueIndex() != device.getGraphicsQueueIndex()) {
+        CHECK(acquireTicket == ticket);
+    } else {
+        CHECK(acquireTicket == 0);
+    }
+
+    auto readBarrier = memoryBarrier();
+    readBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1,
+                         &readBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    VkBufferCopy region{0, 0, size};
+    vkCmdCopyBuffer(cmdBuffer, deviceBuffer, readbackBuffer, 1, &region);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    // 图形队列的提交在 GPU 上等待上传的票据，主机不等待；不支持时间线信号量时 flushAsync 已经等待完成
+    const uint64_t waitValue = std::max(acquireTicket, ticket);
+    const VkSemaphore timelineSemaphore = uploadHeap.getTimelineSemaphore();
+    const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    auto timelineInfo = timelineSemaphoreSubmitInfo();
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+
+    auto submit = submitInfo();
+    if (waitValue != 0) {
+        submit.pNext = &timelineInfo;
+        submit.waitSemaphoreCount = 1;
+        submit.pWaitSemaphores = &timelineSemaphore;
+        submit.pWaitDstStageMask = &waitStage;
+    }
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &cmdBuffer;
+    VK_CHECK(vkQueueSubmit(device.getGraphicsQueue(), 1, &submit, VK_NULL_HANDLE));
+    VK_CHECK(vkQueueWaitIdle(device.getGraphicsQueue()));
+
+    CHECK(uploadHeap.isComplete(ticket));
+    CHECK(std::equal(expected.begin(), expected.end(), pReadback));
+
+    vkDestroyCommandPool(device.getHandle(), commandPool, nullptr);
+    vkDestroyBuffer(device.getHandle(), readbackBuffer, nullptr);
+    vkFreeMemory(device.getHandle(), readbackMemory, nullptr);
+    vkDestroyBuffer(device.getHandle(), deviceBuffer, nullptr);
+    vkFreeMemory(device.getHandle(), deviceMemory, nullptr);
+    uploadHeap.destory();
+    device.destroy();
+}
+
+TEST_CASE("descriptor set cache writes through update templates", "[DescriptorSetCache]")
+{
+    San::LogSystem log;
+
+    InstanceProperties instanceProps{};
+    instanceProps.headless = true;
+    VulkanInstance inst{"Descriptor Set Cache Test", instanceProps};
+
+    VulkanDevice device;
+    device.create(inst);
+
+    DescriptorPool descriptorPool;
+    descriptorPool.create(device, 16, 16, 4, 4, 2);
+
+    DescriptorSetCache cache;
+    cache.create(device, descriptorPool, 2);
+
+    // 绑定 0 是动态 uniform 缓冲区，绑定 1 是两个元素的 uniform 缓冲区数组，只写入第二个元素
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0),
+        descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 2),
+    };
+    VkDescriptorSetLayout layout;
+    descriptorPool.createDescriptorSetLayout(&bindings, &layout);
+
+    const VkDeviceSize alignment = device.getProperties().device_properties.limits.minUniformBufferOffsetAlignment;
+    const VkDeviceSize range = 64;
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VK_CHECK(device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 std::max(alignment, range) * 4,
+                                 &buffer,
+                                 &memory,
+                                 false,
+                                 nullptr));
+
+    auto makeWrites = [&](VkDeviceSize offset)
+    {
+        auto arrayWrite = BufferDescriptorWrite(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, {buffer, offset, range});
+        arrayWrite.arrayElement = 1;
+        return std::vector<DescriptorWrite>{
+            BufferDescriptorWrite(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, {buffer, 0, range}),
+            arrayWrite,
+        };
+    };
+
+    auto first = cache.getDescriptorSet(layout, makeWrites(0));
+    REQUIRE(first != VK_NULL_HANDLE);
+    CHECK(cache.getDescriptorSet(layout, makeWrites(0)) == first);
+    CHECK(cache.getHitCount() == 1);
+
+    // 绑定的资源不同时写入新的描述符集，但写入的位置相同，继续使用同一个模板
+    auto second = cache.getDescriptorSet(layout, makeWrites(std::max(alignment, range)));
+    CHECK(second != first);
+    CHECK(cache.getMissCount() == 2);
+    CHECK(cache.getTemplateCount() == 1);
+
+    // 只写入绑定 0 时需要另一个模板
+    cache.getDescriptorSet(layout, {BufferDescriptorWrite(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, {buffer, 0, range})});
+    CHECK(cache.getTemplateCount() == 2);
+
+    cache.invalidate(buffer);
+    CHECK(cache.getSetCount() == 0);
+
+    cache.destroy();
+    vkDestroyDescriptorSetLayout(device.getHandle(), layout, nullptr);
+    vkFreeMemory(device.getHandle(), memory, nullptr);
+    vkDestroyBuffer(device.getHandle(), buffer, nullptr);
+    descriptorPool.destroy();
+    device.destroy();
+}
+
+TEST_CASE("bindless table reuses indices of destroyed textures", "[BindlessTable]")
+{
+    San::LogSystem log;
+
+    InstanceProperties instanceProps{};
+    instanceProps.headless = true;
+    VulkanInstance inst{"Bindless Table Test", instanceProps};
+
+    VulkanDevice device;
+    device.create(inst);
+
+    if (!device.getProperties().support_descriptor_indexing) {
+        WARN("Descriptor indexing is not supported, skip the bindless table test.");
+        device.destroy();
+        return;
+    }
+
+    BindlessTable table;
+    table.create(device, 16);
+
+    VkSampler sampler;
+    auto samplerInfo = samplerCreateInfo();
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    VK_CHECK(vkCreateSampler(device.getHandle(), &samplerInfo, nullptr, &sampler));
+
+    auto createTexture = [&](Texture& texture, std::string_view name)
+    {
+        texture.createRenderTarget(device, 4, 4, VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_1_BIT,
+                                   VK_IMAGE_USAGE_SAMPLED_BIT, static_cast<VkImageCreateFlagBits>(0), name);
+    };
+
+    Texture first, second, third;
+    createTexture(first, "bindless 0");
+    createTexture(second, "bindless 1");
+
+    auto firstIndex = first.registerBindless(table, sampler);
+    auto secondIndex = second.registerBindless(table, sampler);
+    CHECK(firstIndex == 0);
+    CHECK(secondIndex == 1);
+    CHECK(first.getBindlessIndex() == firstIndex);
+
+    // 重复注册返回已有的索引
+    CHECK(first.registerBindless(table, sampler) == firstIndex);
+
+    // 销毁的纹理归还索引，之后注册的纹理复用它
+    first.destory();
+    CHECK(first.getBindlessIndex() == UINT32_MAX);
+
+    createTexture(third, "bindless 2");
+    CHECK(third.registerBindless(table, sampler) == firstIndex);
+
+    third.destory();
+    second.destory();
+    vkDestroySampler(device.getHandle(), sampler, nullptr);
+    table.destroy();
+    device.destroy();
+}